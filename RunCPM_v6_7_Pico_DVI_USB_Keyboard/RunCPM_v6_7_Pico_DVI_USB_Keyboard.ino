@@ -85,12 +85,47 @@ File32 lst_dev;
 int lst_open = FALSE;
 #endif
 
+// =========================================================================================
+// Binary trace file
+// =========================================================================================
+#ifdef TRACE
+File32 trace_dev;
+int trace_open = FALSE;
+#endif
+
+// =========================================================================================
+// Machine snapshot file
+// =========================================================================================
+#ifdef SNAPSHOT
+File32 snap_dev;
+#endif
+
+// =========================================================================================
+// Session record/replay file
+// =========================================================================================
+#ifdef REPLAY
+File32 replay_dev;
+#endif
+
 #include "ram.h"
+#ifdef REPLAY
+#include "replay.h"
+#endif
 #include "console.h"
 #include "cpu.h"
+#ifdef COMCACHE
+#include "comcache.h"
+#endif
 #include "disk.h"
 #include "host.h"
+#include "clock.h"
+#ifdef TRACE
+#include "trace.h"
+#endif
 #include "cpm.h"
+#ifdef SNAPSHOT
+#include "snap.h"
+#endif
 #ifdef CCP_INTERNAL
 #include "ccp.h"
 #endif
@@ -127,6 +162,7 @@ void setup(void) {
 
 
   Serial1.begin(SERIALSPD);
+  serial1_tx_begin();   // Console output goes through the serial queue from now on
 #if defined(WAIT_SERIAL)
   while (!Serial1) {    // Wait until serial1 is connected
     digitalWrite(LED, HIGH^LEDinv);
@@ -193,6 +229,7 @@ void setup(void) {
   _puts("" TEXT_NORMAL "]\r\n");
 
 #if BANKS > 1
+  _RamInit();
   _puts("Banked Memory        [" TEXT_BOLD "");
   _puthex8(BANKS);
   _puts("" TEXT_NORMAL "]banks\r\n");
@@ -246,10 +283,17 @@ if (SD.begin(SD_CONFIG)) {
 
 
     if (VersionCCP >= 0x10 || SD.exists(CCPname)) {
+      uint8 ended = FALSE;  // Set when a resumed session ends CP/M on its own
 #ifdef ABDOS
       _PatchBIOS();
 #endif
-      while (true) {
+#ifdef REPLAY
+      _replayOpen();
+#endif
+#ifdef SNAPSHOT
+      ended = _snapResume();
+#endif
+      while (!ended) {
         _puts(CCPHEAD);
         _PatchCPM();
   Status = 0;
@@ -263,6 +307,11 @@ if (SD.begin(SD_CONFIG)) {
         }
         // Loads an autoexec file if it exists and this is the first boot
         // The file contents are loaded at ccpAddr+8 up to 126 bytes then the size loaded is stored at ccpAddr+7
+#ifdef SNAPSHOT
+        if (snapResumed)  // A resumed session doesn't run the autoexec again
+          snapResumed = FALSE;
+        else
+#endif
         if (firstBoot) {
           if (_sys_exists((uint8*)AUTOEXEC)) {
             uint16 cmd = CCPaddr + 8;
@@ -298,7 +347,14 @@ if (SD.begin(SD_CONFIG)) {
         if (lst_dev)
           _sys_fflush(lst_dev);
 #endif
+#ifdef TRACE
+        _traceFlush();
+#endif
+        _console_flush();
       }
+#ifdef REPLAY
+      _replayClose();
+#endif
     } else {
       _puts("\r\n");
       _puts("Unable to load CP/M CCP.\r\nCPU halted.\r\n");
@@ -307,6 +363,10 @@ if (SD.begin(SD_CONFIG)) {
     _puts("\r\n");
     _puts("Unable to initialize SD card.\r\nCPU halted.\r\n");
   }
+#ifdef TRACE
+  _traceFlush();
+#endif
+  _console_flush();
 }
 
 void loop(void) {
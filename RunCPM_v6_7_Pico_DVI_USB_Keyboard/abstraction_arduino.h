@@ -61,14 +61,30 @@ bool _sys_exists(uint8* filename) {
 	return(SD.exists((const char *)filename));
 }
 
+File32 _sys_fopen_r(uint8* filename) {
+	return(SD.open((char*)filename, O_READ));
+}
+
 File32 _sys_fopen_w(uint8* filename) {
 	return(SD.open((char*)filename, O_CREAT | O_WRITE));
 }
 
+File32 _sys_fopen_a(uint8* filename) {
+	return(SD.open((char*)filename, O_CREAT | O_WRITE | O_APPEND));
+}
+
 int _sys_fputc(uint8 ch, File32& f) {
 	return(f.write(ch));
 }
 
+int _sys_fwrite(const uint8* buf, uint32 len, File32& f) {
+	return(f.write(buf, len));
+}
+
+int _sys_fread(uint8* buf, uint32 len, File32& f) {
+	return(f.read(buf, len));
+}
+
 void _sys_fflush(File32& f) {
 	f.flush();
 }
@@ -155,6 +171,176 @@ int _sys_renamefile(uint8* filename, uint8* newname) {
 	return(result);
 }
 
+// Gets the size and modification stamp of a file
+uint8 _sys_filestamp(uint8* filename, uint32* size, uint32* stamp) {
+	File32 f;
+	uint16 date = 0, time = 0;
+	uint8 result = FALSE;
+
+	if ((f = SD.open((char*)filename, O_RDONLY))) {
+		*size = f.size();
+		f.getModifyDateTime(&date, &time);
+		*stamp = ((uint32)date << 16) | time;
+		f.close();
+		result = TRUE;
+	}
+	return(result);
+}
+
+// Copies a whole file on the host, replacing the destination
+uint8 _sys_copyfile(uint8* from, uint8* to) {
+	static uint8 copybuf[COPYBUF];
+	File32 src, dst;
+	int bytesread;
+	uint8 result = FALSE;
+
+	digitalWrite(LED, HIGH ^ LEDinv);
+	if ((src = SD.open((char*)from, O_READ))) {
+		if ((dst = SD.open((char*)to, O_CREAT | O_WRITE | O_TRUNC))) {
+			result = TRUE;
+			while ((bytesread = src.read(copybuf, COPYBUF)) > 0) {
+				if (dst.write(copybuf, bytesread) != (size_t)bytesread) {
+					result = FALSE;
+					break;
+				}
+			}
+			if (bytesread < 0)
+				result = FALSE;
+			dst.close();
+			if (!result)
+				SD.remove((char*)to);
+		}
+		src.close();
+	}
+	digitalWrite(LED, LOW ^ LEDinv);
+	return(result);
+}
+
+// Appends a block to a file, creating it if needed
+uint8 _sys_appendfile(uint8* filename, const uint8* buf, uint32 len) {
+	File32 f;
+	uint8 result = FALSE;
+
+	digitalWrite(LED, HIGH ^ LEDinv);
+	if ((f = SD.open((char*)filename, O_CREAT | O_WRITE | O_APPEND))) {
+		result = f.write(buf, len) == len;
+		f.close();
+	}
+	digitalWrite(LED, LOW ^ LEDinv);
+	return(result);
+}
+
+// Counts the allocation blocks used by the files of a drive, in all user areas
+uint32 _sys_driveblocks(uint8 drive, uint32 blocksize) {
+	uint8 path[2] = { drive, 0 };
+	char name[13];
+	File32 d, u, f;
+	uint32 blocks = 0;
+
+	digitalWrite(LED, HIGH ^ LEDinv);
+	if ((d = SD.open((char*)path))) {
+		while ((u = d.openNextFile())) {
+			u.getName(name, sizeof name);
+			if (u.isDirectory() && strlen(name) == 1 && isxdigit(name[0])) {
+				while ((f = u.openNextFile())) {
+					if (!f.isDirectory())
+						blocks += (f.size() + blocksize - 1) / blocksize;
+					f.close();
+				}
+			}
+			u.close();
+		}
+		d.close();
+	}
+	digitalWrite(LED, LOW ^ LEDinv);
+	return(blocks);
+}
+
+#ifdef REPLAY
+// Sum of the FNV-1a hashes of the name ("A/0/NAME.TYP") and contents of each file of a drive, in any order
+uint32 _sys_drivehash(uint8 drive) {
+	uint8 path[2] = { drive, 0 };
+	char name[13], user[4] = { (char)drive, FOLDERCHAR, 0, FOLDERCHAR };
+	uint8 buf[512];
+	File32 d, u, f;
+	uint32 hash = 0, h;
+	int n, i;
+
+	digitalWrite(LED, HIGH ^ LEDinv);
+	if ((d = SD.open((char*)path))) {
+		while ((u = d.openNextFile())) {
+			u.getName(name, sizeof name);
+			if (u.isDirectory() && strlen(name) == 1 && isxdigit(name[0])) {
+				user[2] = toupper(name[0]);
+				while ((f = u.openNextFile())) {
+					f.getName(name, sizeof name);
+					if (!f.isDirectory() && name[0] != '.') {
+						h = 2166136261UL;
+						for (i = 0; i < 4; ++i)
+							h = (h ^ (uint8)user[i]) * 16777619UL;
+						for (i = 0; name[i]; ++i)
+							h = (h ^ (uint8)name[i]) * 16777619UL;
+						while ((n = f.read(buf, sizeof buf)) > 0)
+							for (i = 0; i < n; ++i)
+								h = (h ^ buf[i]) * 16777619UL;
+						hash += h;
+					}
+					f.close();
+				}
+			}
+			u.close();
+		}
+		d.close();
+	}
+	digitalWrite(LED, LOW ^ LEDinv);
+	return(hash);
+}
+#endif
+
+// Free space on the card in KB (scans the FAT, so callers should cache it)
+uint32 _sys_cardfree(void) {
+	int32_t clusters;
+
+	digitalWrite(LED, HIGH ^ LEDinv);
+	clusters = SD.freeClusterCount();
+	digitalWrite(LED, LOW ^ LEDinv);
+	if (clusters < 0)
+		return(0);
+	return((uint32)((uint64_t)clusters * SD.bytesPerCluster() / 1024));
+}
+
+// Reads the date and time seed ("YYYY-MM-DD HH:MM:SS") from TimeName, as the board has no RTC
+uint8 _sys_gettime(uint8* buf, uint8 len) {
+	File32 f;
+	int n = 0;
+
+	if ((f = SD.open(TimeName, O_READ))) {
+		n = f.read(buf, len - 1);
+		f.close();
+	}
+	if (n < 0)
+		n = 0;
+	buf[n] = 0;
+	return(n > 0);
+}
+
+#ifdef BANKSTORE
+#ifndef BANKSTORE_ATTR
+#define BANKSTORE_ATTR					// Boards place the store in PSRAM
+#endif
+
+static uint8 bankStore[(uint32)BANKS * PAGESIZE] BANKSTORE_ATTR;
+
+// Backing store of the memory banks (see ram.h)
+void _sys_bankread(uint32 offset, uint8* buf, uint16 len) {
+	memcpy(buf, bankStore + offset, len);
+}
+
+void _sys_bankwrite(uint32 offset, uint8* buf, uint16 len) {
+	memcpy(bankStore + offset, buf, len);
+}
+#endif
+
 #ifdef DEBUGLOG
 void _sys_logbuffer(uint8* buffer) {
 #ifdef CONSOLELOG
@@ -197,6 +383,20 @@ bool _sys_extendfile(char* fn, unsigned long fpos)
 	return(result);
 }
 
+// The DMA buffer as one host block, gathered into buf if it straddles two memory pages
+static uint8* _sys_dmablock(uint8* buf) {
+#ifdef BANKSTORE
+	uint8 i;
+
+	if ((dmaAddr & 0x0fff) > 0x1000 - BlkSZ) {
+		for (i = 0; i < BlkSZ; ++i)
+			buf[i] = _RamRead(dmaAddr + i);
+		return(buf);
+	}
+#endif
+	return(_RamSysAddr(dmaAddr));
+}
+
 uint8 _sys_readseq(uint8* filename, long fpos) {
 	uint8 result = 0xff;
 	File32 f;
@@ -230,13 +430,14 @@ uint8 _sys_readseq(uint8* filename, long fpos) {
 uint8 _sys_writeseq(uint8* filename, long fpos) {
 	uint8 result = 0xff;
 	File32 f;
+	uint8 dmabuf[BlkSZ];
 
 	digitalWrite(LED, HIGH ^ LEDinv);
 	if (_sys_extendfile((char*)filename, fpos))
 		f = SD.open((char*)filename, O_RDWR);
 	if (f) {
 		if (f.seek(fpos)) {
-			if (f.write(_RamSysAddr(dmaAddr), BlkSZ))
+			if (f.write(_sys_dmablock(dmabuf), BlkSZ))
 				result = 0x00;
 		} else {
 			result = 0x01;
@@ -293,6 +494,7 @@ uint8 _sys_readrand(uint8* filename, long fpos) {
 uint8 _sys_writerand(uint8* filename, long fpos) {
 	uint8 result = 0xff;
 	File32 f;
+	uint8 dmabuf[BlkSZ];
 
 	digitalWrite(LED, HIGH ^ LEDinv);
 	if (_sys_extendfile((char*)filename, fpos)) {
@@ -300,7 +502,7 @@ uint8 _sys_writerand(uint8* filename, long fpos) {
 	}
 	if (f) {
 		if (f.seek(fpos)) {
-			if (f.write(_RamSysAddr(dmaAddr), BlkSZ))
+			if (f.write(_sys_dmablock(dmabuf), BlkSZ))
 				result = 0x00;
 		} else {
 			result = 0x06;
@@ -349,13 +551,11 @@ uint8 _findnext(uint8 isdir) {
 					fileRecords = bytes / BlkSZ;
 					fileExtents = fileRecords / BlkEX + ((fileRecords & (BlkEX - 1)) ? 1 : 0);
 					fileExtentsUsed = 0;
-					firstFreeAllocBlock = firstBlockAfterDir;
 					_mockupDirEntry(0);
 				} else {
 					fileRecords = 0;
 					fileExtents = 0;
 					fileExtentsUsed = 0;
-					firstFreeAllocBlock = firstBlockAfterDir;
 				}
 				_RamWrite(tmpFCB, filename[0] - '@');
 				_HostnameToFCB(tmpFCB, findNextDirName);
@@ -379,6 +579,7 @@ uint8 _findfirst(uint8 isdir) {
 	fileRecords = 0;
 	fileExtents = 0;
 	fileExtentsUsed = 0;
+	firstFreeAllocBlock = firstBlockAfterDir;	// Blocks are handed out in sequence over the whole search
 	return(_findnext(isdir));
 }
 
@@ -431,6 +632,7 @@ uint8 _findfirstallusers(uint8 isdir) {
 	fileRecords = 0;
 	fileExtents = 0;
 	fileExtentsUsed = 0;
+	firstFreeAllocBlock = firstBlockAfterDir;	// Blocks are handed out in sequence over the whole search
 	return(_findnextallusers(isdir));
 }
 
@@ -497,11 +699,28 @@ uint32 _HardwareIn(const uint32 Port) {
 #include "arduino_hooks.h"
 
 int _kbhit(void) {
+#if USE_DISPLAY
+    display_service();                  // Programs polling the keyboard still get their output drawn
+#endif
+    if (rxQueue.buf) { return(_rb_count(&rxQueue)); }
     if (_kbhit_hook && _kbhit_hook()) { return true; }
     return(Serial1.available());
 }
 
+void _console_flush(void) {
+    if (txQueue.buf) _rb_flush(&txQueue);
+#if USE_DISPLAY
+    display_flush();
+#endif
+}
+
 uint8 _getch(void) {
+    if (!_kbhit()) _console_flush();    // Output is complete before waiting for input
+    if (rxQueue.buf) {
+        int c;
+        while ((c = console_rx_get()) == -1);
+        return(c);
+    }
     while(true) {
         if(_kbhit_hook && _kbhit_hook()) { return _getch_hook(); }
         if(Serial1.available()) { return Serial1.read(); }
@@ -520,14 +739,46 @@ uint8 _getche(void) {
 */
 
 void _putch(uint8 ch) {
-	Serial1.write(ch);
+	if (txQueue.buf) {
+		_rb_put(&txQueue, ch);
+#ifdef SERVICECORE
+		svc_wake();
+#endif
+	} else {
+		Serial1.write(ch);
+	}
         if(_putch_hook) _putch_hook(ch);
 }
 
+void _putchBlock(const uint8* buf, uint32 len) {
+	if (txQueue.buf) {
+		_rb_write(&txQueue, buf, len);
+#ifdef SERVICECORE
+		svc_wake();
+#endif
+	} else {
+		Serial1.write(buf, len);
+	}
+	if (_putblk_hook) {
+		_putblk_hook(buf, len);
+	} else if (_putch_hook) {
+		while (len--)
+			_putch_hook(*buf++);
+	}
+}
+
 void _clrscr(void) {
-	Serial1.print("\e[H\e[J");
+	if (txQueue.buf) {
+		_rb_write(&txQueue, (const uint8*)"\e[H\e[J", 6);
+#ifdef SERVICECORE
+		svc_wake();
+#endif
+	} else {
+		Serial1.print("\e[H\e[J");
+	}
 
 #if USE_DISPLAY
+    display_flush();
     display.fillScreen(0);
     display.setCursor(0, 0);
 #endif
@@ -0,0 +1,1617 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef ABSTRACT_H
+#define ABSTRACT_H
+
+/*
+	POSIX host abstraction (Linux, macOS and the like, see Makefile)
+
+	The disks are the drive folders (A/0, A/1 ... P/F) under the base directory, which is
+	the current one unless -d is given. The console is the terminal in raw mode, or any
+	pipe or file: when the input ends RunCPM exits, so a command script can be run
+	headless with "runcpm < script" or, with STREAMIO, "runcpm -i script -o log -s".
+	With -r the drive folders under its directory are a read-only base and those under
+	the base directory only hold what the session changes (see Overlay drives below).
+
+	Built with MULTIMACHINE (make runcpm-multi) each -d starts another machine, with the
+	-i and -o options that follow it, and the machines run concurrently, one thread each.
+	Their whole state is MACHINE_LOCAL (see globals.h), so the host paths are made from
+	the base directory of the machine instead of the process wide current directory.
+	With -b it runs a manifest of batch jobs instead, on a pool of -j workers. Each job
+	gets a fresh machine thread and its own copy of a drive folder template (cloned when
+	the file system can share the blocks, or with -l an empty overlay of it), and its
+	console log, how it ended, its time and the files it was expected to produce are
+	collected under the -w directory.
+
+	Built with SERVICECORE (make runcpm-svc) the terminal is served by a second thread, as
+	the second core does on the Pico: the output and the input go through the lock free
+	queues of ringbuf.h, and the thread is rung through a pipe as core 1 is through the
+	inter-core FIFO. It runs the same queue protocol on a host where it can be stressed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#if defined(MULTIMACHINE) || defined(SERVICECORE)
+#include <pthread.h>
+#endif
+#ifdef MULTIMACHINE
+#include <setjmp.h>
+#endif
+#if defined(MULTIMACHINE) && defined(SERVICECORE)
+#error "MULTIMACHINE machines have no terminal to serve, build them without SERVICECORE"
+#endif
+
+#define HostOS 0x02
+
+#define TEXT_BOLD "\033[1m"
+#define TEXT_NORMAL "\033[0m"
+
+/* Time abstraction functions */
+/*===============================================================================*/
+unsigned long millis(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return(t.tv_sec * 1000UL + t.tv_nsec / 1000000UL);
+}
+
+unsigned long micros(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return(t.tv_sec * 1000000UL + t.tv_nsec / 1000UL);
+}
+
+// Gets the date and time seed ("YYYY-MM-DD HH:MM:SS") from the host clock
+uint8 _sys_gettime(uint8* buf, uint8 len) {
+	time_t now = time(NULL);
+	struct tm tm;
+
+	return(strftime((char*)buf, len, "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm)) > 0);
+}
+
+/* Host paths */
+/*===============================================================================*/
+#define FOLDERCHAR '/'
+#define HOSTBASE 1024						// Longest base directory
+
+static MACHINE_LOCAL char hostBase[HOSTBASE] = "";	// Base directory of the drive folders, "" or ending in FOLDERCHAR
+
+// Host path of a file or folder given relative to the base directory
+static char* _sys_hostpath(char* path, const void* name) {
+	snprintf(path, FILENAME_MAX, "%s%s", hostBase, (const char*)name);
+	return(path);
+}
+
+/*
+	Overlay drives (-r)
+
+	The drive folders under hostLower are a read-only base seen through the ones under
+	hostBase, the overlay: a file is read from the overlay if it is there, else from the
+	base. Everything written lands in the overlay, a base file being copied up before it
+	is changed. A deleted or renamed base file is hidden by a whiteout, an empty .wh.NAME
+	file next to where its overlay copy would be, and directory searches list the overlay
+	folder then the base one, less the files shadowed or hidden. So a pristine tree can be
+	shared by any number of sessions, each starting from an empty overlay.
+*/
+static MACHINE_LOCAL char hostLower[HOSTBASE] = "";	// Base directory of the read-only drive folders, "" for none
+
+// Host path of a file or folder of the read-only base
+static char* _sys_lowerpath(char* path, const void* name) {
+	snprintf(path, FILENAME_MAX, "%s%s", hostLower, (const char*)name);
+	return(path);
+}
+
+// Host path of the whiteout hiding the base copy of a file
+static char* _sys_whiteout(char* path, const void* name) {
+	const char* n = (const char*)name;
+	const char* f = strrchr(n, FOLDERCHAR);
+
+	f = f ? f + 1 : n;
+	snprintf(path, FILENAME_MAX, "%s%.*s.wh.%s", hostBase, (int)(f - n), n, f);
+	return(path);
+}
+
+// Makes the overlay folders leading to path
+static void _sys_overlaydirs(const char* path) {
+	char dir[FILENAME_MAX];
+	char* p;
+
+	strcpy(dir, path);
+	for (p = dir + strlen(hostBase); (p = strchr(p, FOLDERCHAR)); ++p) {
+		*p = 0;
+		mkdir(dir, S_IRWXU | S_IRWXG | S_IRWXO);
+		*p = FOLDERCHAR;
+	}
+}
+
+// Tells if the base has a copy of a file not hidden by a whiteout
+static uint8 _sys_lowervisible(const void* name) {
+	char path[FILENAME_MAX];
+
+	return(hostLower[0] && !access(_sys_lowerpath(path, name), F_OK) && access(_sys_whiteout(path, name), F_OK));
+}
+
+// Hides the base copy of a file, if there is one
+static void _sys_hidelower(const void* name) {
+	char path[FILENAME_MAX];
+	int fd;
+
+	if (!_sys_lowervisible(name))
+		return;
+	_sys_overlaydirs(_sys_whiteout(path, name));
+	if ((fd = open(path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) >= 0)
+		close(fd);
+}
+
+// Host path a file or folder is read from: the overlay copy, else the base one unless hidden
+static char* _sys_readpath(char* path, const void* name) {
+	char whiteout[FILENAME_MAX];
+
+	_sys_hostpath(path, name);
+	if (hostLower[0] && access(path, F_OK) && access(_sys_whiteout(whiteout, name), F_OK))
+		_sys_lowerpath(path, name);
+	return(path);
+}
+
+// Host path a file is written to, in the overlay. If keep is set its base copy is copied up first
+static char* _sys_writepath(char* path, const void* name, uint8 keep) {
+	char lower[FILENAME_MAX];
+	int src, dst;
+	ssize_t n;
+
+	_sys_hostpath(path, name);
+	if (!hostLower[0] || !access(path, F_OK))
+		return(path);
+	_sys_overlaydirs(path);
+	if (keep && _sys_lowervisible(name) && (src = open(_sys_lowerpath(lower, name), O_RDONLY)) >= 0) {
+		if ((dst = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) >= 0) {
+#ifdef FICLONE
+			if (ioctl(dst, FICLONE, src))
+#endif
+			{
+				while ((n = read(src, lower, sizeof(lower))) > 0)
+					if (write(dst, lower, n) != n)
+						break;
+			}
+			close(dst);
+		}
+		close(src);
+	}
+	unlink(_sys_whiteout(lower, name));		// The overlay copy is the file now, if it gets made
+	return(path);
+}
+
+/* Memory abstraction functions */
+/*===============================================================================*/
+uint16 _RamLoad(uint8* filename, uint16 address, uint16 maxsize) {
+	char path[FILENAME_MAX];
+	FILE* f;
+	uint16 bytesread = 0;
+	int ch;
+
+	if ((f = fopen(_sys_readpath(path, filename), "rb"))) {
+		while ((ch = fgetc(f)) != EOF) {
+			_RamWrite(address++, ch);
+			bytesread++;
+			if (maxsize && bytesread >= maxsize)
+				break;
+		}
+		fclose(f);
+	}
+	return(bytesread);
+}
+
+#ifdef BANKSTORE
+#define BANKSTORE_NSPERKB 15000				// Simulated store speed (about 66MB/s, a QSPI PSRAM)
+
+static MACHINE_LOCAL uint8* bankStore = NULL;
+
+// Waits as long as moving len bytes to or from the store would take
+static void _bankstoreDelay(uint16 len) {
+	struct timespec t;
+	uint64_t until;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	until = t.tv_sec * 1000000000ULL + t.tv_nsec + (uint64_t)len * BANKSTORE_NSPERKB / 1024;
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t);
+	} while (t.tv_sec * 1000000000ULL + t.tv_nsec < until);
+}
+
+// Backing store of the memory banks (see ram.h), a heap block made as slow as PSRAM
+void _sys_bankread(uint32 offset, uint8* buf, uint16 len) {
+	if (!bankStore)
+		bankStore = (uint8*)calloc(BANKS, PAGESIZE);
+	_bankstoreDelay(len);
+	memcpy(buf, bankStore + offset, len);
+}
+
+void _sys_bankwrite(uint32 offset, uint8* buf, uint16 len) {
+	if (!bankStore)
+		bankStore = (uint8*)calloc(BANKS, PAGESIZE);
+	_bankstoreDelay(len);
+	memcpy(bankStore + offset, buf, len);
+}
+#endif
+
+/* Filesystem (disk) abstraction functions */
+/*===============================================================================*/
+#define FILEBASE "./"
+
+typedef struct {
+	uint8 dr;
+	uint8 fn[8];
+	uint8 tp[3];
+	uint8 ex, s1, s2, rc;
+	uint8 al[16];
+	uint8 cr, r0, r1, r2;
+} CPM_FCB;
+
+typedef struct {
+	uint8 dr;
+	uint8 fn[8];
+	uint8 tp[3];
+	uint8 ex, s1, s2, rc;
+	uint8 al[16];
+} CPM_DIRENTRY;
+
+static MACHINE_LOCAL DIR* userdir = NULL;			// User area being searched, in the overlay then in the base
+static MACHINE_LOCAL DIR* lowerdir = NULL;
+static MACHINE_LOCAL uint8 findShadowed = FALSE;	// The overlay has the user area, so it can shadow or hide base files
+static MACHINE_LOCAL uint8 findNextUser = 16;		// Next user area searched by _findnextallusers
+
+bool _sys_exists(uint8* filename) {
+	char path[FILENAME_MAX];
+
+	return(!access(_sys_readpath(path, filename), F_OK));
+}
+
+FILE* _sys_fopen_r(uint8* filename) {
+	char path[FILENAME_MAX];
+
+	return(fopen(_sys_readpath(path, filename), "rb"));
+}
+
+FILE* _sys_fopen_w(uint8* filename) {
+	char path[FILENAME_MAX];
+
+	return(fopen(_sys_writepath(path, filename, FALSE), "wb"));
+}
+
+FILE* _sys_fopen_a(uint8* filename) {
+	char path[FILENAME_MAX];
+
+	return(fopen(_sys_writepath(path, filename, TRUE), "ab"));
+}
+
+int _sys_fputc(uint8 ch, FILE* f) {
+	return(fputc(ch, f));
+}
+
+int _sys_fwrite(const uint8* buf, uint32 len, FILE* f) {
+	return(fwrite(buf, 1, len, f));
+}
+
+int _sys_fread(uint8* buf, uint32 len, FILE* f) {
+	return(fread(buf, 1, len, f));
+}
+
+void _sys_fflush(FILE* f) {
+	fflush(f);
+}
+
+void _sys_fclose(FILE* f) {
+	fclose(f);
+}
+
+int _sys_select(uint8* disk) {
+	char path[FILENAME_MAX];
+	struct stat st;
+
+	return(!stat(_sys_readpath(path, disk), &st) && S_ISDIR(st.st_mode));
+}
+
+long _sys_filesize(uint8* filename) {
+	char path[FILENAME_MAX];
+	struct stat st;
+
+	return(stat(_sys_readpath(path, filename), &st) ? -1 : st.st_size);
+}
+
+int _sys_openfile(uint8* filename) {
+	char path[FILENAME_MAX];
+	FILE* f = fopen(_sys_readpath(path, filename), "rb");
+
+	if (!f)
+		return(0);
+	fclose(f);
+	return(1);
+}
+
+int _sys_makefile(uint8* filename) {
+	char path[FILENAME_MAX];
+	FILE* f = fopen(_sys_writepath(path, filename, FALSE), "wb");
+
+	if (!f)
+		return(0);
+	fclose(f);
+	return(1);
+}
+
+int _sys_deletefile(uint8* filename) {
+	char path[FILENAME_MAX];
+	int result = !unlink(_sys_hostpath(path, filename));
+
+	if (_sys_lowervisible(filename)) {
+		_sys_hidelower(filename);
+		result = TRUE;
+	}
+	return(result);
+}
+
+int _sys_renamefile(uint8* filename, uint8* newname) {
+	char path[FILENAME_MAX], newpath[FILENAME_MAX];
+
+	if (hostLower[0] && access(_sys_readpath(path, filename), F_OK))
+		return(FALSE);
+	if (rename(_sys_writepath(path, filename, TRUE), _sys_writepath(newpath, newname, FALSE)))
+		return(FALSE);
+	_sys_hidelower(filename);
+	return(TRUE);
+}
+
+// Gets the size and modification stamp of a file
+uint8 _sys_filestamp(uint8* filename, uint32* size, uint32* stamp) {
+	char path[FILENAME_MAX];
+	struct stat st;
+
+	if (stat(_sys_readpath(path, filename), &st))
+		return(FALSE);
+	*size = st.st_size;
+	*stamp = (uint32)st.st_mtime;
+	return(TRUE);
+}
+
+// Copies a whole file on the host, replacing the destination
+uint8 _sys_copyfile(uint8* from, uint8* to) {
+	static MACHINE_LOCAL uint8 copybuf[COPYBUF];
+	char frompath[FILENAME_MAX], topath[FILENAME_MAX];
+	FILE *src, *dst;
+	size_t bytesread;
+	uint8 result = FALSE;
+
+	if ((src = fopen(_sys_readpath(frompath, from), "rb"))) {
+		if ((dst = fopen(_sys_writepath(topath, to, FALSE), "wb"))) {
+			result = TRUE;
+			while ((bytesread = fread(copybuf, 1, COPYBUF, src)) > 0) {
+				if (fwrite(copybuf, 1, bytesread, dst) != bytesread) {
+					result = FALSE;
+					break;
+				}
+			}
+			if (ferror(src))
+				result = FALSE;
+			if (fclose(dst))
+				result = FALSE;
+			if (!result)
+				unlink(topath);
+		}
+		fclose(src);
+	}
+	return(result);
+}
+
+// Appends a block to a file, creating it if needed
+uint8 _sys_appendfile(uint8* filename, const uint8* buf, uint32 len) {
+	char path[FILENAME_MAX];
+	FILE* f;
+	uint8 result = FALSE;
+
+	if ((f = fopen(_sys_writepath(path, filename, TRUE), "ab"))) {
+		result = fwrite(buf, 1, len, f) == len;
+		if (fclose(f))
+			result = FALSE;
+	}
+	return(result);
+}
+
+// Calls each for every file of a drive the CP/M directory shows, in all user areas (through the overlay, if any)
+static void _sys_drivewalk(uint8 drive, void (*each)(const char* path, const char* name, struct stat* st, void* arg), void* arg) {
+	char path[FILENAME_MAX];
+	struct dirent* de;
+	struct stat st;
+	char name[24];
+	DIR* d;
+	uint8 user, layer, shadowed;
+
+	for (user = 0; user < 16; ++user) {
+		shadowed = FALSE;
+		for (layer = 0; layer < (hostLower[0] ? 2 : 1); ++layer) {
+			snprintf(path, sizeof(path), "%s%c%c%X", layer ? hostLower : hostBase, drive, FOLDERCHAR, user);
+			if (!(d = opendir(path)))
+				continue;
+			if (!layer)
+				shadowed = TRUE;
+			while ((de = readdir(d))) {
+				if (de->d_name[0] == '.' || strlen(de->d_name) > 12)
+					continue;
+				snprintf(name, sizeof(name), "%c%c%X%c%.12s", drive, FOLDERCHAR, user, FOLDERCHAR, de->d_name);
+				if (layer && shadowed && (!access(_sys_hostpath(path, name), F_OK) || !_sys_lowervisible(name)))
+					continue;						// Shadowed by the overlay or hidden by a whiteout
+				if (!stat(layer ? _sys_lowerpath(path, name) : _sys_hostpath(path, name), &st) && S_ISREG(st.st_mode))
+					each(path, name, &st, arg);
+			}
+			closedir(d);
+		}
+	}
+}
+
+static void _sys_countblocks(const char* path, const char* name, struct stat* st, void* arg) {
+	uint32* count = (uint32*)arg;				// Blocks so far, block size
+
+	count[0] += (st->st_size + count[1] - 1) / count[1];
+}
+
+// Counts the allocation blocks used by the files of a drive, in all user areas
+uint32 _sys_driveblocks(uint8 drive, uint32 blocksize) {
+	uint32 count[2] = { 0, blocksize };
+
+	_sys_drivewalk(drive, _sys_countblocks, count);
+	return(count[0]);
+}
+
+#ifdef REPLAY
+static void _sys_hashfile(const char* path, const char* name, struct stat* st, void* arg) {
+	uint8 buf[4096];
+	uint32 h = 2166136261UL;
+	size_t n, i;
+	FILE* f;
+
+	while (*name)
+		h = (h ^ (uint8)*name++) * 16777619UL;
+	if ((f = fopen(path, "rb"))) {
+		while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+			for (i = 0; i < n; ++i)
+				h = (h ^ buf[i]) * 16777619UL;
+		fclose(f);
+	}
+	*(uint32*)arg += h;
+}
+
+// Sum of the FNV-1a hashes of the name and contents of each file of a drive, so the order they are found in doesn't matter
+uint32 _sys_drivehash(uint8 drive) {
+	uint32 hash = 0;
+
+	_sys_drivewalk(drive, _sys_hashfile, &hash);
+	return(hash);
+}
+#endif
+
+// Free space on the file system holding the disks, in KB
+uint32 _sys_cardfree(void) {
+	struct statvfs v;
+	uint64_t kb;
+
+	if (statvfs(hostBase[0] ? hostBase : ".", &v))
+		return(0);
+	kb = (uint64_t)v.f_bavail * v.f_frsize / 1024;
+	return(kb > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32)kb);
+}
+
+#ifdef DEBUGLOG
+void _sys_logbuffer(uint8* buffer) {
+#ifdef CONSOLELOG
+	puts((char*)buffer);
+#else
+	char path[FILENAME_MAX];
+	FILE* f;
+
+	if ((f = fopen(_sys_hostpath(path, LogName), "a"))) {
+		fputs((char*)buffer, f);
+		fclose(f);
+	}
+#endif
+}
+#endif
+
+uint8 _sys_extendfile(char* filename, unsigned long fpos) {
+	char path[FILENAME_MAX];
+	uint8 result = TRUE;
+	long i;
+	FILE* f;
+
+	if ((f = fopen(_sys_writepath(path, filename, TRUE), "ab"))) {
+		if ((i = ftell(f)) < 0) {
+			result = FALSE;
+		} else {
+			for (; (unsigned long)i < fpos; ++i) {
+				if (fputc(0, f) == EOF) {
+					result = FALSE;
+					break;
+				}
+			}
+		}
+		fclose(f);
+	} else {
+		result = FALSE;
+	}
+	return(result);
+}
+
+uint8 _sys_readseq(uint8* filename, long fpos) {
+	char path[FILENAME_MAX];
+	uint8 result = 0xff;
+	FILE* f;
+	size_t bytesread;
+	uint8 dmabuf[BlkSZ];
+	uint8 i;
+
+	if ((f = fopen(_sys_readpath(path, filename), "rb"))) {
+		if (!fseek(f, fpos, SEEK_SET)) {
+			memset(dmabuf, 0x1a, BlkSZ);
+			bytesread = fread(dmabuf, 1, BlkSZ, f);
+			if (bytesread) {
+				for (i = 0; i < BlkSZ; ++i)
+					_RamWrite(dmaAddr + i, dmabuf[i]);
+			}
+			result = bytesread ? 0x00 : 0x01;
+		} else {
+			result = 0x01;
+		}
+		fclose(f);
+	} else {
+		result = 0x10;
+	}
+	return(result);
+}
+
+// Host address of the DMA buffer, gathered into buf if it straddles two pages
+static uint8* _sys_dmablock(uint8* buf) {
+#ifdef BANKSTORE
+	uint8 i;
+
+	if ((dmaAddr & 0x0fff) > 0x1000 - BlkSZ) {
+		for (i = 0; i < BlkSZ; ++i)
+			buf[i] = _RamRead(dmaAddr + i);
+		return(buf);
+	}
+#endif
+	return(_RamSysAddr(dmaAddr));
+}
+
+uint8 _sys_writeseq(uint8* filename, long fpos) {
+	char path[FILENAME_MAX];
+	uint8 result = 0xff;
+	uint8 dmabuf[BlkSZ];
+	FILE* f = NULL;
+
+	if (_sys_extendfile((char*)filename, fpos))
+		f = fopen(_sys_hostpath(path, filename), "r+b");
+	if (f) {
+		if (!fseek(f, fpos, SEEK_SET)) {
+			if (fwrite(_sys_dmablock(dmabuf), 1, BlkSZ, f) == BlkSZ)
+				result = 0x00;
+		} else {
+			result = 0x01;
+		}
+		fclose(f);
+	} else {
+		result = 0x10;
+	}
+	return(result);
+}
+
+uint8 _sys_readrand(uint8* filename, long fpos) {
+	uint8 result = 0xff;
+	FILE* f;
+	size_t bytesread;
+	uint8 dmabuf[BlkSZ];
+	uint8 i;
+	long extSize;
+	char path[FILENAME_MAX];
+
+	if ((f = fopen(_sys_readpath(path, filename), "rb"))) {
+		fseek(f, 0, SEEK_END);
+		extSize = ftell(f);
+		if (fpos < extSize && !fseek(f, fpos, SEEK_SET)) {
+			memset(dmabuf, 0x1a, BlkSZ);
+			bytesread = fread(dmabuf, 1, BlkSZ, f);
+			for (i = 0; i < BlkSZ; ++i)
+				_RamWrite(dmaAddr + i, dmabuf[i]);
+			result = bytesread ? 0x00 : 0x01;
+		} else {
+			if (fpos >= 65536L * BlkSZ) {
+				result = 0x06;	// seek past 8MB (largest file size in CP/M)
+			} else {
+				// round file size up to next full logical extent
+				extSize = ExtSZ * ((extSize / ExtSZ) + ((extSize % ExtSZ) ? 1 : 0));
+				if (fpos < extSize)
+					result = 0x01;	// reading unwritten data
+				else
+					result = 0x04; // seek to unwritten extent
+			}
+		}
+		fclose(f);
+	} else {
+		result = 0x10;
+	}
+	return(result);
+}
+
+uint8 _sys_writerand(uint8* filename, long fpos) {
+	char path[FILENAME_MAX];
+	uint8 result = 0xff;
+	uint8 dmabuf[BlkSZ];
+	FILE* f = NULL;
+
+	if (_sys_extendfile((char*)filename, fpos))
+		f = fopen(_sys_hostpath(path, filename), "r+b");
+	if (f) {
+		if (!fseek(f, fpos, SEEK_SET)) {
+			if (fwrite(_sys_dmablock(dmabuf), 1, BlkSZ, f) == BlkSZ)
+				result = 0x00;
+		} else {
+			result = 0x06;
+		}
+		fclose(f);
+	} else {
+		result = 0x10;
+	}
+	return(result);
+}
+
+static MACHINE_LOCAL uint8 findNextDirName[17];
+static MACHINE_LOCAL uint16 fileRecords = 0;
+static MACHINE_LOCAL uint16 fileExtents = 0;
+static MACHINE_LOCAL uint16 fileExtentsUsed = 0;
+static MACHINE_LOCAL uint16 firstFreeAllocBlock;
+
+// Next entry of the user area being searched, the overlay folder first, closing each when it ends
+static struct dirent* _findread(uint8* lower) {
+	struct dirent* de;
+
+	if (userdir) {
+		if ((de = readdir(userdir))) {
+			*lower = FALSE;
+			return(de);
+		}
+		closedir(userdir);
+		userdir = NULL;
+	}
+	if (lowerdir) {
+		if ((de = readdir(lowerdir))) {
+			*lower = TRUE;
+			return(de);
+		}
+		closedir(lowerdir);
+		lowerdir = NULL;
+	}
+	return(NULL);
+}
+
+// Opens the user area filename[0]/filename[2] for a search
+static void _findopen(void) {
+	char dir[FILENAME_MAX];
+	uint8 path[4] = { '?', FOLDERCHAR, '?', 0 };
+
+	path[0] = filename[0];
+	path[2] = filename[2];
+	if (userdir)
+		closedir(userdir);
+	if (lowerdir)
+		closedir(lowerdir);
+	userdir = opendir(_sys_hostpath(dir, path));
+	lowerdir = hostLower[0] ? opendir(_sys_lowerpath(dir, path)) : NULL;
+	findShadowed = userdir != NULL;
+}
+
+uint8 _findnext(uint8 isdir) {
+	struct dirent* de;
+	struct stat st;
+	char path[FILENAME_MAX];
+	char name[24];
+	uint32 bytes;
+	uint8 result = 0xff;
+	uint8 lower;
+
+	if (allExtents && fileRecords) {
+		_mockupDirEntry(0);
+		return(0);
+	}
+	while ((de = _findread(&lower))) {
+		if (de->d_name[0] == '.' || strlen(de->d_name) > 12)
+			continue;
+		snprintf(name, sizeof(name), "%c%c%c%c%.12s", filename[0], FOLDERCHAR, filename[2], FOLDERCHAR, de->d_name);
+		if (lower && findShadowed && (!access(_sys_hostpath(path, name), F_OK) || !_sys_lowervisible(name)))
+			continue;						// Shadowed by the overlay or hidden by a whiteout
+		if (stat(lower ? _sys_lowerpath(path, name) : _sys_hostpath(path, name), &st) || !S_ISREG(st.st_mode))
+			continue;
+		strcpy((char*)findNextDirName, de->d_name);
+		_HostnameToFCBname(findNextDirName, fcbname);
+		if (match(fcbname, pattern)) {
+			if (isdir) {
+				// account for host files that aren't multiples of the block size
+				// by rounding their bytes up to the next multiple of blocks
+				bytes = st.st_size;
+				if (bytes & (BlkSZ - 1)) {
+					bytes = (bytes & ~(BlkSZ - 1)) + BlkSZ;
+				}
+				fileRecords = bytes / BlkSZ;
+				fileExtents = fileRecords / BlkEX + ((fileRecords & (BlkEX - 1)) ? 1 : 0);
+				fileExtentsUsed = 0;
+				_mockupDirEntry(0);
+			} else {
+				fileRecords = 0;
+				fileExtents = 0;
+				fileExtentsUsed = 0;
+			}
+			_RamWrite(tmpFCB, filename[0] - '@');
+			_HostnameToFCB(tmpFCB, findNextDirName);
+			result = 0x00;
+			break;
+		}
+	}
+	return(result);
+}
+
+uint8 _findfirst(uint8 isdir) {
+	findNextUser = 16;
+	_findopen();
+	_HostnameToFCBname(filename, pattern);
+	fileRecords = 0;
+	fileExtents = 0;
+	fileExtentsUsed = 0;
+	firstFreeAllocBlock = firstBlockAfterDir;	// Blocks are handed out in sequence over the whole search
+	return(_findnext(isdir));
+}
+
+uint8 _findnextallusers(uint8 isdir) {
+	uint8 result = 0xff;
+
+	for (;;) {
+		if (!userdir && !lowerdir) {
+			if (findNextUser > 15)
+				break;
+			currFindUser = findNextUser++;
+			filename[2] = toupper(tohex(currFindUser));
+			_findopen();
+			continue;
+		}
+		if (!(result = _findnext(isdir)))
+			break;
+	}
+	return(result);
+}
+
+uint8 _findfirstallusers(uint8 isdir) {
+	char dir[FILENAME_MAX];
+	uint8 path[2] = { '?', 0 };
+
+	path[0] = filename[0];
+	if (userdir)
+		closedir(userdir);
+	if (lowerdir)
+		closedir(lowerdir);
+	userdir = lowerdir = NULL;
+	strcpy((char*)pattern, "???????????");
+	if (access(_sys_readpath(dir, path), F_OK))
+		return(0xff);
+	findNextUser = 0;
+	fileRecords = 0;
+	fileExtents = 0;
+	fileExtentsUsed = 0;
+	firstFreeAllocBlock = firstBlockAfterDir;
+	return(_findnextallusers(isdir));
+}
+
+uint8 _Truncate(char* filename, uint8 rc) {
+	char path[FILENAME_MAX];
+
+	return(!truncate(_sys_writepath(path, filename, TRUE), rc * BlkSZ));
+}
+
+void _MakeUserDir(void) {
+	char dir[FILENAME_MAX];
+	uint8 dFolder = cDrive + 'A';
+	uint8 uFolder = toupper(tohex(userCode));
+
+	uint8 path[4] = { dFolder, FOLDERCHAR, uFolder, 0 };
+
+	mkdir(_sys_writepath(dir, path, FALSE), S_IRWXU | S_IRWXG | S_IRWXO);
+}
+
+uint8 _sys_makedisk(uint8 drive) {
+	char dir[FILENAME_MAX];
+	uint8 result = 0;
+	if (drive < 1 || drive > 16) {
+		result = 0xff;
+	} else {
+		uint8 dFolder = drive + '@';
+		uint8 disk[2] = { dFolder, 0 };
+		if (!access(_sys_readpath(dir, disk), F_OK) || mkdir(_sys_hostpath(dir, disk), S_IRWXU | S_IRWXG | S_IRWXO)) {
+			result = 0xfe;
+		} else {
+			uint8 path[4] = { dFolder, FOLDERCHAR, '0', 0 };
+			mkdir(_sys_hostpath(dir, path), S_IRWXU | S_IRWXG | S_IRWXO);
+		}
+	}
+
+	return(result);
+}
+
+/* Hardware abstraction functions */
+/*===============================================================================*/
+void _HardwareOut(const uint32 Port, const uint32 Value) {
+
+}
+
+uint32 _HardwareIn(const uint32 Port) {
+	return 0;
+}
+
+/* Console abstraction functions */
+/*===============================================================================*/
+static struct termios _old_term, _new_term;
+static uint8 _termRaw = FALSE;
+static char _stdoutBuf[16384];				// Output is sent in blocks, flushed before any input
+
+#ifdef SERVICECORE
+static pthread_mutex_t rbMutex = PTHREAD_MUTEX_INITIALIZER;
+#define RB_LOCK()	pthread_mutex_lock(&rbMutex)
+#define RB_UNLOCK()	pthread_mutex_unlock(&rbMutex)
+#define RB_TIME()	micros()
+#include "ringbuf.h"
+
+#define SVC_IDLE_TIME 1						// Longest sleep of the service thread (ms), bounds the input latency when rxQueue was full
+
+static RINGBUF txQueue;						// Console to terminal, consumed by the service thread
+static RINGBUF rxQueue;						// Terminal to console, produced by the service thread
+static int svcBell[2];						// Pipe ringing the service thread
+static volatile uint8 svcIdle = FALSE;		// The service thread is going to sleep
+static volatile uint8 svcEof = FALSE;		// Standard input has ended, after what is in rxQueue
+static pthread_t svcThread;
+
+static void _svc_wake(void) {
+	RB_BARRIER();							// The queued bytes are seen before svcIdle is read
+	if (svcIdle) {
+		svcIdle = FALSE;
+		if (write(svcBell[1], "", 1) < 0)
+			return;							// Already rung
+	}
+}
+
+// Writes the queued output, under the lock as the DMA drain of the Pico does
+static void _svc_drain(void) {
+	uint8* p;
+	uint32 n;
+	ssize_t w;
+
+	RB_LOCK();
+	while ((n = _rb_peek(&txQueue, &p, sizeof(_stdoutBuf)))) {
+		w = write(1, p, n);
+		_rb_skip(&txQueue, w > 0 ? (uint32)w : n);	// Output that can't be written is dropped
+	}
+	RB_UNLOCK();
+}
+
+static void* _svc_main(void* arg) {
+	struct pollfd p[2];
+	uint8 buf[256];
+	uint32 n;
+	ssize_t got;
+
+	for (;;) {
+		_svc_drain();
+		p[0].fd = svcEof || !_rb_free(&rxQueue) ? -1 : 0;
+		p[0].events = POLLIN;
+		p[0].revents = 0;
+		p[1].fd = svcBell[0];
+		p[1].events = POLLIN;
+		p[1].revents = 0;
+		svcIdle = TRUE;
+		RB_BARRIER();
+		poll(p, 2, _rb_count(&txQueue) ? 0 : SVC_IDLE_TIME);
+		svcIdle = FALSE;
+		if (p[1].revents & POLLIN)
+			while (read(svcBell[0], buf, sizeof(buf)) > 0);
+		if (p[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			n = _rb_free(&rxQueue);
+			got = read(0, buf, n < sizeof(buf) ? n : sizeof(buf));
+			if (got > 0)
+				_rb_write(&rxQueue, buf, got);
+			else
+				svcEof = TRUE;
+		}
+	}
+	return(NULL);
+}
+#endif
+
+void _console_init(void) {
+#ifdef MULTIMACHINE
+	return;									// The machines only use their -i and -o files
+#endif
+#ifdef SERVICECORE
+	if (!_rb_init(&txQueue, TXQ_SIZE, TXQ_POLICY, TXQ_MAXSIZE, _svc_wake) ||
+		!_rb_init(&rxQueue, RXQ_SIZE, RB_DROP, RXQ_SIZE, NULL) || pipe(svcBell) ||
+		fcntl(svcBell[0], F_SETFL, O_NONBLOCK) || fcntl(svcBell[1], F_SETFL, O_NONBLOCK) ||
+		pthread_create(&svcThread, NULL, _svc_main, NULL)) {
+		fprintf(stderr, "cannot start the console service thread\n");
+		exit(1);
+	}
+#endif
+	setvbuf(stdout, _stdoutBuf, _IOFBF, sizeof(_stdoutBuf));
+	if (isatty(0) && !tcgetattr(0, &_old_term)) {
+		_new_term = _old_term;
+		_new_term.c_lflag &= ~(ICANON | ECHO | ISIG);	// ^C and ^S go to CP/M
+		_new_term.c_iflag &= ~(IXON | ICRNL);
+		_new_term.c_cc[VMIN] = 1;
+		_new_term.c_cc[VTIME] = 0;
+		tcsetattr(0, TCSANOW, &_new_term);
+		_termRaw = TRUE;
+	}
+}
+
+void _console_reset(void) {
+#ifdef MULTIMACHINE
+	return;
+#endif
+#ifdef SERVICECORE
+	_rb_flush(&txQueue);
+#endif
+	fflush(stdout);
+	if (_termRaw)
+		tcsetattr(0, TCSANOW, &_old_term);
+	_termRaw = FALSE;
+}
+
+#ifdef MULTIMACHINE
+static MACHINE_LOCAL jmp_buf hostMachineEnd;	// Where the thread of a machine goes when its input ends
+#endif
+
+// The console input has ended (end of a script or pipe): leaves as EXIT would
+static void _console_eof(void) {
+#ifdef TRACE
+	_traceFlush();
+#endif
+#ifdef REPLAY
+	_replayClose();
+#endif
+	_puts("\r\n");
+	_console_reset();
+#ifdef STREAMIO
+	if (streamOutputFile)
+		fclose(streamOutputFile);
+#endif
+#ifdef MULTIMACHINE
+	longjmp(hostMachineEnd, 1);				// Only this machine ends
+#else
+	exit(0);
+#endif
+}
+
+#ifdef SERVICECORE
+int _kbhit(void) {
+	return(_rb_count(&rxQueue) || svcEof);	// At the end the next _getch leaves
+}
+
+uint8 _getch(void) {
+	int ch;
+
+	if (!_rb_count(&rxQueue))
+		_rb_flush(&txQueue);				// Output is complete before waiting for input
+	while ((ch = _rb_get(&rxQueue)) == -1) {
+		if (svcEof && !_rb_count(&rxQueue))
+			_console_eof();
+		usleep(100);
+	}
+	return(ch == 0x0a && !_termRaw ? 0x0d : ch);
+}
+#else
+int _kbhit(void) {
+	struct pollfd p = { 0, POLLIN, 0 };
+
+	fflush(stdout);
+	return(poll(&p, 1, 0) > 0);
+}
+
+uint8 _getch(void) {
+	uint8 ch;
+
+	fflush(stdout);
+	if (read(0, &ch, 1) != 1)
+		_console_eof();
+	return(ch == 0x0a && !_termRaw ? 0x0d : ch);	// Scripts use LF line ends, CP/M wants CR
+}
+#endif
+
+void _putch(uint8 ch) {
+#ifdef STREAMIO
+	if (streamOutputFile)
+		fputc(ch, streamOutputFile);
+	if (!consoleOutputActive)
+		return;
+#endif
+#ifdef SERVICECORE
+	_rb_put(&txQueue, ch);
+	_svc_wake();
+#else
+	putchar(ch);
+#endif
+}
+
+void _putchBlock(const uint8* buf, uint32 len) {
+#ifdef STREAMIO
+	if (streamOutputFile)
+		fwrite(buf, 1, len, streamOutputFile);
+	if (!consoleOutputActive)
+		return;
+#endif
+#ifdef SERVICECORE
+	_rb_write(&txQueue, buf, len);
+	_svc_wake();
+#else
+	fwrite(buf, 1, len, stdout);
+#endif
+}
+
+void _clrscr(void) {
+#ifdef STREAMIO
+	if (!consoleOutputActive)
+		return;
+#endif
+	if (!isatty(1))
+		return;
+#ifdef SERVICECORE
+	_rb_write(&txQueue, (const uint8*)"\033[H\033[J", 6);
+	_svc_wake();
+#else
+	fputs("\033[H\033[J", stdout);
+#endif
+}
+
+#ifdef STREAMIO
+#ifdef MULTIMACHINE
+typedef struct {
+	char	base[HOSTBASE];					// hostBase of the machine
+	char	lower[HOSTBASE];				// Its hostLower, the -r read-only base
+	FILE*	in;								// Its -i and -o files
+	FILE*	out;
+	char*	name;							// Batch job: name, drive template, input script and expected files
+	char*	template;
+	char*	input;
+	char*	expected;
+	const char* status;						// How the machine ended: exit (EXIT or BIOS 0) or eof (input exhausted)
+	const char* result;						// Batch job: PASS, FAIL or ERROR
+	char	detail[2 * FILENAME_MAX + 32];	// Why a job failed
+	unsigned long elapsed;					// Microseconds
+	unsigned long long instructions;		// Only counted with RUNSTATS
+} HOSTMACHINE;
+
+static HOSTMACHINE* hostMachine = NULL;
+static int hostMachines = 0;
+static int hostNext = 0;					// Next machine for a worker to take
+static int hostWorkers = 0;					// -j, 0 runs every -d machine at once or a batch on one worker per CPU
+static char* hostBatch = NULL;				// -b manifest
+static char* hostWork = (char*)"batch";		// -w directory of the job trees, logs and results
+static uint8 hostLayered = FALSE;			// -l, batch jobs run on an overlay of their template instead of a copy
+static void (*hostMachineRun)(void);
+static void (*hostMachineClose)(void);
+
+static HOSTMACHINE* _host_newmachine(void) {
+	HOSTMACHINE* m;
+
+	if (!(m = (HOSTMACHINE*)realloc(hostMachine, (hostMachines + 1) * sizeof(HOSTMACHINE)))) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	hostMachine = m;
+	m = &hostMachine[hostMachines++];
+	memset(m, 0, sizeof(HOSTMACHINE));
+	return(m);
+}
+#endif
+
+static void _usage(char* argv[]) {
+#ifdef MULTIMACHINE
+	fprintf(stderr,
+		"RunCPM - runs several CP/M machines at once, one thread each\n"
+		"usage: %s -d dir [-r base_dir] [-i input_file] -o output_file [-d dir ...]\n"
+		"       %s -b manifest [-j workers] [-w workdir] [-l]\n"
+		"  -d dir: starts a machine whose drive folders (A, B ...) are under dir\n"
+		"  -r base_dir: the drive folders under base_dir are seen through those\n"
+		"     under dir, which only get what that machine writes\n"
+		"  -i input_file: console input of that machine, it ends when the file\n"
+		"     is exhausted (or on EXIT)\n"
+		"  -o output_file: console output of that machine\n"
+		"  -b manifest: runs the batch jobs listed in manifest, one per line as\n"
+		"     name template_dir input_file [expected_dir]\n"
+		"     (input_file can be - for none, # starts a comment). Each job runs\n"
+		"     on a copy of template_dir made in workdir/name, its console goes to\n"
+		"     workdir/name.txt and it passes when every file under expected_dir is\n"
+		"     found the same in its copy. The results go to workdir/RESULTS.CSV\n"
+		"  -j workers: number of jobs run at once (default one per CPU)\n"
+		"  -w workdir: directory for the job copies and results (default batch)\n"
+		"  -l: each job runs on an overlay of template_dir instead of a copy,\n"
+		"     workdir/name only gets what it writes\n",
+		argv[0], argv[0]);
+#else
+	fprintf(stderr,
+		"RunCPM - an emulator to run CP/M programs on modern hosts\n"
+		"usage: %s [-d dir] [-r base_dir] [-i input_file] [-o output_file] [-s]\n"
+		"  -d dir: the drive folders (A, B ...) are under dir instead of the\n"
+		"     current directory\n"
+		"  -r base_dir: the drive folders under base_dir are a read-only base\n"
+		"     seen through those under dir, which only get what is written\n"
+		"  -i input_file: console input is read from the file first, then\n"
+		"     from the keyboard (or standard input, RunCPM exits when it ends)\n"
+		"  -o output_file: console output is also written to the file\n"
+		"  -s: console output is not shown, only written to the -o file\n",
+		argv[0]);
+#endif
+	exit(1);
+}
+
+// Sets base to dir, ending in FOLDERCHAR, if it is a directory
+static uint8 _host_base(char* base, const char* dir) {
+	struct stat st;
+	size_t len = strlen(dir);
+
+	if (stat(dir, &st) || !S_ISDIR(st.st_mode) || len + 2 > HOSTBASE)
+		return(FALSE);
+	strcpy(base, dir);
+	if (base[len - 1] != FOLDERCHAR) {
+		base[len] = FOLDERCHAR;
+		base[len + 1] = 0;
+	}
+	return(TRUE);
+}
+
+#ifdef MULTIMACHINE
+// Reads the batch manifest, one job per line
+static void _host_manifest(char* argv[]) {
+	char line[4 * FILENAME_MAX];
+	char* field[5];
+	HOSTMACHINE* m;
+	FILE* f;
+	int n, lineno = 0;
+
+	if (!(f = fopen(hostBatch, "r"))) {
+		fprintf(stderr, "%s: cannot open manifest %s\n", argv[0], hostBatch);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		++lineno;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = 0;
+		for (n = 0; n < 5 && (field[n] = strtok(n ? NULL : line, " \t\r\n")); ++n);
+		if (!n)
+			continue;
+		if (n < 3 || n > 4 || strchr(field[0], FOLDERCHAR)) {
+			fprintf(stderr, "%s: %s line %d: expected name template_dir input_file [expected_dir]\n", argv[0], hostBatch, lineno);
+			exit(1);
+		}
+		m = _host_newmachine();
+		m->name = strdup(field[0]);
+		m->template = strdup(field[1]);
+		m->input = strcmp(field[2], "-") ? strdup(field[2]) : NULL;
+		m->expected = n > 3 ? strdup(field[3]) : NULL;
+	}
+	fclose(f);
+	if (!hostMachines) {
+		fprintf(stderr, "%s: no jobs in %s\n", argv[0], hostBatch);
+		exit(1);
+	}
+}
+#endif
+
+void _host_init(int argc, char* argv[]) {
+	FILE* f;
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		if (argv[i][0] != '-' || !argv[i][1] || argv[i][2])
+			_usage(argv);
+		switch (argv[i][1]) {
+			case 'd': {
+#ifdef MULTIMACHINE
+				if (++i == argc || !_host_base(_host_newmachine()->base, argv[i])) {
+#else
+				if (++i == argc || !_host_base(hostBase, argv[i])) {
+#endif
+					fprintf(stderr, "%s: cannot use %s as the base directory\n", argv[0], i < argc ? argv[i] : "");
+					exit(1);
+				}
+				break;
+			}
+			case 'r': {
+#ifdef MULTIMACHINE
+				if (!hostMachines)
+					_usage(argv);
+				if (++i == argc || !_host_base(hostMachine[hostMachines - 1].lower, argv[i])) {
+#else
+				if (++i == argc || !_host_base(hostLower, argv[i])) {
+#endif
+					fprintf(stderr, "%s: cannot use %s as the read-only base directory\n", argv[0], i < argc ? argv[i] : "");
+					exit(1);
+				}
+				break;
+			}
+			case 'i': {
+				if (++i == argc || !(f = fopen(argv[i], "rb"))) {
+					fprintf(stderr, "%s: cannot open input file %s\n", argv[0], i < argc ? argv[i] : "");
+					exit(1);
+				}
+#ifdef MULTIMACHINE
+				if (!hostMachines)
+					_usage(argv);
+				hostMachine[hostMachines - 1].in = f;
+#else
+				streamInputFile = f;
+				streamInputActive = TRUE;
+#endif
+				break;
+			}
+			case 'o': {
+				if (++i == argc || !(f = fopen(argv[i], "wb"))) {
+					fprintf(stderr, "%s: cannot open output file %s\n", argv[0], i < argc ? argv[i] : "");
+					exit(1);
+				}
+#ifdef MULTIMACHINE
+				if (!hostMachines)
+					_usage(argv);
+				hostMachine[hostMachines - 1].out = f;
+#else
+				streamOutputFile = f;
+#endif
+				break;
+			}
+#ifdef MULTIMACHINE
+			case 'b': {
+				if (++i == argc)
+					_usage(argv);
+				hostBatch = argv[i];
+				break;
+			}
+			case 'j': {
+				if (++i == argc || (hostWorkers = atoi(argv[i])) < 1)
+					_usage(argv);
+				break;
+			}
+			case 'w': {
+				if (++i == argc)
+					_usage(argv);
+				hostWork = argv[i];
+				break;
+			}
+			case 'l': {
+				hostLayered = TRUE;
+				break;
+			}
+#else
+			case 's': {
+				consoleOutputActive = FALSE;
+				break;
+			}
+#endif
+			default: {
+				_usage(argv);
+			}
+		}
+	}
+#ifdef MULTIMACHINE
+	if (hostBatch) {
+		if (hostMachines)
+			_usage(argv);					// Either -d machines or a batch
+		_host_manifest(argv);
+		if (mkdir(hostWork, S_IRWXU | S_IRWXG | S_IRWXO) && access(hostWork, W_OK)) {
+			fprintf(stderr, "%s: cannot use %s as the work directory\n", argv[0], hostWork);
+			exit(1);
+		}
+		if (!hostWorkers)
+			hostWorkers = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+		return;
+	}
+	if (!hostMachines)
+		_usage(argv);
+	for (i = 0; i < hostMachines; ++i)
+		if (!hostMachine[i].out)
+			_usage(argv);
+	if (!hostWorkers)
+		hostWorkers = hostMachines;
+#else
+	if (!consoleOutputActive && !streamOutputFile)
+		_usage(argv);
+#endif
+}
+
+#ifdef MULTIMACHINE
+// Copies a file, sharing its blocks when the file system can (copy on write)
+static uint8 _host_copyfile(const char* from, const char* to, mode_t mode) {
+	char buf[16384];
+	ssize_t n;
+	uint8 result = TRUE;
+	int src, dst;
+
+	if ((src = open(from, O_RDONLY)) < 0)
+		return(FALSE);
+	if ((dst = open(to, O_WRONLY | O_CREAT | O_EXCL, mode)) < 0) {
+		close(src);
+		return(FALSE);
+	}
+#ifdef FICLONE
+	if (ioctl(dst, FICLONE, src))
+#endif
+	{
+		while ((n = read(src, buf, sizeof(buf))) > 0) {
+			if (write(dst, buf, n) != n) {
+				result = FALSE;
+				break;
+			}
+		}
+		if (n < 0)
+			result = FALSE;
+	}
+	close(src);
+	if (close(dst))
+		result = FALSE;
+	return(result);
+}
+
+// Copies the tree under from into to, which must not exist
+static uint8 _host_copytree(const char* from, const char* to) {
+	char src[FILENAME_MAX], dst[FILENAME_MAX];
+	struct dirent* de;
+	struct stat st;
+	uint8 result = TRUE;
+	DIR* d;
+
+	if (!(d = opendir(from)) || mkdir(to, S_IRWXU | S_IRWXG | S_IRWXO)) {
+		if (d)
+			closedir(d);
+		return(FALSE);
+	}
+	while (result && (de = readdir(d))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		snprintf(src, sizeof(src), "%s%c%s", from, FOLDERCHAR, de->d_name);
+		snprintf(dst, sizeof(dst), "%s%c%s", to, FOLDERCHAR, de->d_name);
+		if (stat(src, &st))
+			result = FALSE;
+		else if (S_ISDIR(st.st_mode))
+			result = _host_copytree(src, dst);
+		else if (S_ISREG(st.st_mode))
+			result = _host_copyfile(src, dst, st.st_mode & 0777);
+	}
+	closedir(d);
+	return(result);
+}
+
+// Checks that every file under expected is the same under got, seen over lower if not NULL, names the first that isn't in detail
+static uint8 _host_comparetree(const char* expected, const char* got, const char* lower, char* detail, size_t size) {
+	char exp[FILENAME_MAX], res[FILENAME_MAX], low[FILENAME_MAX];
+	char a[4096], b[4096];
+	struct dirent* de;
+	struct stat st;
+	uint8 result = TRUE;
+	size_t na, nb;
+	FILE *fa, *fb;
+	DIR* d;
+
+	if (!(d = opendir(expected))) {
+		snprintf(detail, size, "cannot read %s", expected);
+		return(FALSE);
+	}
+	while (result && (de = readdir(d))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		snprintf(exp, sizeof(exp), "%s%c%s", expected, FOLDERCHAR, de->d_name);
+		snprintf(res, sizeof(res), "%s%c%s", got, FOLDERCHAR, de->d_name);
+		if (lower)
+			snprintf(low, sizeof(low), "%s%c%s", lower, FOLDERCHAR, de->d_name);
+		if (stat(exp, &st))
+			continue;
+		if (S_ISDIR(st.st_mode)) {
+			result = _host_comparetree(exp, res, lower ? low : NULL, detail, size);
+			continue;
+		}
+		fa = fopen(exp, "rb");
+		fb = fopen(res, "rb");
+		if (!fb && lower) {					// Not written by the job: the template file unless it was deleted
+			snprintf(res, sizeof(res), "%s%c.wh.%s", got, FOLDERCHAR, de->d_name);
+			if (access(res, F_OK))
+				fb = fopen(low, "rb");
+			snprintf(res, sizeof(res), "%s%c%s", got, FOLDERCHAR, de->d_name);
+		}
+		result = fa && fb;
+		while (result) {
+			na = fread(a, 1, sizeof(a), fa);
+			nb = fread(b, 1, sizeof(b), fb);
+			if (na != nb || memcmp(a, b, na))
+				result = FALSE;
+			else if (!na)
+				break;
+		}
+		if (fa)
+			fclose(fa);
+		if (fb)
+			fclose(fb);
+		if (!result)
+			snprintf(detail, size, "%s %s", fb ? "differs:" : "missing:", res);
+	}
+	closedir(d);
+	return(result);
+}
+
+static void* _host_machine(void* arg) {
+	HOSTMACHINE* m = (HOSTMACHINE*)arg;
+
+	strcpy(hostBase, m->base);
+	strcpy(hostLower, m->lower);
+	streamInputFile = m->in;
+	streamInputActive = m->in != NULL;
+	streamOutputFile = m->out;
+	consoleOutputActive = FALSE;
+	if (!setjmp(hostMachineEnd)) {
+		hostMachineRun();
+		m->status = "exit";
+	} else {
+		m->status = "eof";
+	}
+	hostMachineClose();
+	if (userdir)
+		closedir(userdir);
+	if (lowerdir)
+		closedir(lowerdir);
+#ifdef RUNSTATS
+	m->instructions = runStats.instructions;
+#endif
+	return(NULL);
+}
+
+// Makes the drive tree and opens the console files of a batch job
+static uint8 _host_jobsetup(HOSTMACHINE* m) {
+	char path[FILENAME_MAX];
+
+	snprintf(path, sizeof(path), "%s%c%s", hostWork, FOLDERCHAR, m->name);
+	if (!access(path, F_OK)) {
+		snprintf(m->detail, sizeof(m->detail), "%s already exists", path);
+		return(FALSE);
+	}
+	if (hostLayered) {
+		if (!_host_base(m->lower, m->template) || mkdir(path, S_IRWXU | S_IRWXG | S_IRWXO) || !_host_base(m->base, path)) {
+			snprintf(m->detail, sizeof(m->detail), "cannot overlay %s with %s", m->template, path);
+			return(FALSE);
+		}
+	} else if (!_host_copytree(m->template, path) || !_host_base(m->base, path)) {
+		snprintf(m->detail, sizeof(m->detail), "cannot copy %s to %s", m->template, path);
+		return(FALSE);
+	}
+	if (m->input && !(m->in = fopen(m->input, "rb"))) {
+		snprintf(m->detail, sizeof(m->detail), "cannot open %s", m->input);
+		return(FALSE);
+	}
+	snprintf(path, sizeof(path), "%s%c%s.txt", hostWork, FOLDERCHAR, m->name);
+	if (!(m->out = fopen(path, "wb"))) {
+		snprintf(m->detail, sizeof(m->detail), "cannot write %s", path);
+		return(FALSE);
+	}
+	return(TRUE);
+}
+
+// Takes machines until there are none left, each on a fresh thread so it starts from a clean MACHINE_LOCAL state
+static void* _host_worker(void* arg) {
+	char path[FILENAME_MAX];
+	HOSTMACHINE* m;
+	pthread_t t;
+	unsigned long start;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&hostNext, 1)) < hostMachines) {
+		m = &hostMachine[i];
+		m->result = "ERROR";
+		if (hostBatch && !_host_jobsetup(m)) {
+			if (m->in)
+				fclose(m->in);
+			if (m->out)
+				fclose(m->out);
+		} else {
+			start = micros();
+			if (pthread_create(&t, NULL, _host_machine, m)) {
+				snprintf(m->detail, sizeof(m->detail), "cannot start its thread");
+			} else {
+				pthread_join(t, NULL);
+				m->elapsed = micros() - start;
+				if (m->in)
+					fclose(m->in);
+				snprintf(path, sizeof(path), "%s%c%s", hostWork, FOLDERCHAR, m->name ? m->name : "");
+				m->result = !m->expected || _host_comparetree(m->expected, path, hostLayered ? m->template : NULL, m->detail, sizeof(m->detail)) ? "PASS" : "FAIL";
+			}
+		}
+		if (hostBatch)
+			printf("%-5s %s %lu ms%s%s\n", m->result, m->name, m->elapsed / 1000, m->detail[0] ? " - " : "", m->detail);
+	}
+	return(NULL);
+}
+
+// Runs the machines given by _host_init on hostWorkers threads, returns the number of jobs that didn't pass
+int _host_run(void (*run)(void), void (*end)(void)) {
+	char path[FILENAME_MAX];
+	pthread_t* worker;
+	int i, failed = 0;
+	FILE* f;
+
+	hostMachineRun = run;
+	hostMachineClose = end;
+	if (hostWorkers > hostMachines)
+		hostWorkers = hostMachines;
+	if (!(worker = (pthread_t*)calloc(hostWorkers, sizeof(pthread_t))))
+		exit(1);
+	for (i = 0; i < hostWorkers; ++i) {
+		if (pthread_create(&worker[i], NULL, _host_worker, NULL)) {
+			fprintf(stderr, "cannot start worker %d\n", i + 1);
+			exit(1);
+		}
+	}
+	for (i = 0; i < hostWorkers; ++i)
+		pthread_join(worker[i], NULL);
+	free(worker);
+	if (!hostBatch)
+		return(0);
+
+	snprintf(path, sizeof(path), "%s%cRESULTS.CSV", hostWork, FOLDERCHAR);
+#ifdef RUNSTATS
+	if ((f = fopen(path, "w")))
+		fprintf(f, "job,result,status,elapsed_us,instructions,detail\n");
+#else
+	if ((f = fopen(path, "w")))
+		fprintf(f, "job,result,status,elapsed_us,detail\n");		// The instructions are only counted with RUNSTATS
+#endif
+	for (i = 0; i < hostMachines; ++i) {
+		if (strcmp(hostMachine[i].result, "PASS"))
+			++failed;
+		if (!f)
+			continue;
+		fprintf(f, "%s,%s,%s,%lu,", hostMachine[i].name, hostMachine[i].result,
+			hostMachine[i].status ? hostMachine[i].status : "", hostMachine[i].elapsed);
+#ifdef RUNSTATS
+		fprintf(f, "%llu,", hostMachine[i].instructions);
+#endif
+		fprintf(f, "\"%s\"\n", hostMachine[i].detail);
+	}
+	if (f)
+		fclose(f);
+	printf("%d jobs, %d passed, %d failed\n", hostMachines, hostMachines - failed, failed);
+	return(failed);
+}
+
+// A machine has no keyboard: it ends when its -i file is exhausted
+void _abort_if_kbd_eof(void) {
+	_console_eof();
+}
+#else
+// Input comes from the keyboard (or standard input) once the -i file is exhausted
+void _abort_if_kbd_eof(void) {
+}
+#endif
+#endif
+
+#endif
@@ -7,4 +7,5 @@
 bool (*_kbhit_hook)(void);
 uint8_t (*_getch_hook)(void);
 void (*_putch_hook)(uint8_t ch);
+void (*_putblk_hook)(const uint8_t *buf, size_t len);
 
@@ -5,9 +5,11 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 extern bool (*_kbhit_hook)(void);
 extern uint8_t (*_getch_hook)(void);
 extern void (*_putch_hook)(uint8_t ch);
+extern void (*_putblk_hook)(const uint8_t *buf, size_t len);
 
@@ -15,18 +15,28 @@
 #define defDMA	0x0080					// Default DMA address
 #define defLoad	0x0100					// Default load address
 
+#define CopyNames 64					// Source names resolved at once by COPY
+
 #define Internals                       // Define to have internal commands
+#define SubmitInternal                  // Define to run .SUB files from memory instead of SUBMIT.COM/$$$.SUB
+#define SubSize	4096					// Size of the in-memory batch queue
+#define CmdCache 16                     // Number of command lookups remembered by _ccp_open
 
 // CCP global variables
-uint8 pgSize = 22;              // for TYPE
-uint8 curDrive = 0;             // 0 -> 15 = A -> P	.. Current drive for the CCP (same as RAM[DSKByte])
-uint8 parDrive = 0;             // 0 -> 15 = A -> P .. Drive for the first file parameter
-uint8 curUser = 0;              // 0 -> 15			.. Current user area to access
-bool sFlag = FALSE;             // Submit Flag
-uint8 sRecs = 0;                // Number of records on the Submit file
-uint8 prompt[8] = "\r\n  >";
-uint16 pbuf, perr;
-uint8 blen = 0;                 // Actual size of the typed command line (size of the buffer)
+MACHINE_LOCAL uint8 pgSize = 22;              // for TYPE
+MACHINE_LOCAL uint8 curDrive = 0;             // 0 -> 15 = A -> P	.. Current drive for the CCP (same as RAM[DSKByte])
+MACHINE_LOCAL uint8 parDrive = 0;             // 0 -> 15 = A -> P .. Drive for the first file parameter
+MACHINE_LOCAL uint8 curUser = 0;              // 0 -> 15			.. Current user area to access
+MACHINE_LOCAL bool sFlag = FALSE;             // Submit Flag
+MACHINE_LOCAL uint8 sRecs = 0;                // Number of records on the Submit file
+MACHINE_LOCAL uint8 prompt[8] = "\r\n  >";
+MACHINE_LOCAL uint16 pbuf, perr;
+MACHINE_LOCAL uint8 blen = 0;                 // Actual size of the typed command line (size of the buffer)
+#ifdef SubmitInternal
+static MACHINE_LOCAL uint8 subQueue[SubSize];     // Expanded batch lines waiting to run, \0 terminated
+static MACHINE_LOCAL uint16 subHead = 0;          // Next line to run
+static MACHINE_LOCAL uint16 subEnd = 0;           // End of the queued lines
+#endif
 
 static const char *Commands[] =
 {
@@ -47,6 +57,32 @@ static const char *Commands[] =
 #endif
     "VOL",
     "?",
+    "COPY",
+#ifdef COMCACHE
+    "CACHE",
+#else
+    " ",                // Never matches, keeps the numbers of the commands after it
+#endif
+#ifdef RUNSTATS
+    "TIME",
+#else
+    " ",
+#endif
+#ifdef CCPDATE
+    "DATE",
+#else
+    " ",
+#endif
+#ifdef RUNSTATS
+    "BENCH",
+#else
+    " ",
+#endif
+#ifdef SNAPSHOT
+    "SNAP",
+#else
+    " ",
+#endif
     NULL
 };
 
@@ -216,6 +252,67 @@ uint16 _ccp_fcbtonum() {
     return (n);
 } // _ccp_fcbtonum
 
+#ifdef CmdCache
+// Command lookups are remembered until a file is created, renamed or deleted (dirChanges)
+typedef struct {
+    uint8 key[12];              // Command FCB drive and name as looked up
+    uint8 drive, user;          // Drive and user it was looked up from
+    uint8 found;
+    uint8 fdrive, fuser;        // FCB drive and user it was found on
+    uint16 changes;             // dirChanges when it was looked up
+} CMDENTRY;
+
+static MACHINE_LOCAL CMDENTRY cmdCache[CmdCache];
+static MACHINE_LOCAL uint8 cmdNext = 0;
+
+static CMDENTRY* _ccp_cmdFind(uint8* key) {
+    uint8 i;
+    
+    for (i = 0; i < CmdCache; ++i) {
+        if (cmdCache[i].changes == dirChanges && cmdCache[i].key[1] && cmdCache[i].drive == cDrive &&
+            cmdCache[i].user == userCode && !memcmp(cmdCache[i].key, key, 12))
+            return(&cmdCache[i]);
+    }
+    return(NULL);
+}
+
+void _ccp_cmdFlush(void) {
+    uint8 i;
+    
+    for (i = 0; i < CmdCache; ++i)
+        cmdCache[i].key[1] = 0;
+}
+#endif
+
+// Loads the program open on fcb at defLoad, from the COM cache when possible
+// Returns the address past the image (BDOSjmppage if it didn't fit)
+uint16 _ccp_load(uint16 fcb) {
+    uint16 loadAddr = defLoad;
+#ifdef COMCACHE
+    uint8 path[17];
+    uint32 len;
+    
+    _FCBtoHostname(fcb, path);
+    if ((len = _comcacheLoad(path, defLoad)))
+        return(defLoad + len);
+#endif
+    _ccp_bdos(F_DMAOFF, loadAddr);					// Sets the DMA address for the loading
+    while (!_ccp_bdos(F_READ, fcb)) {				// Loads the program into memory
+        loadAddr += 128;
+        if (loadAddr == BDOSjmppage) {				// Breaks if it reaches the end of TPA
+            _puts("\r\nNo Memory");
+            break;
+        }
+        _ccp_bdos(F_DMAOFF, loadAddr);				// Points the DMA offset to the next loadAddr
+    }
+    _ccp_bdos(F_DMAOFF, defDMA);					// Points the DMA offset back to the default
+#ifdef COMCACHE
+    if (loadAddr < BDOSjmppage)
+        _comcacheAdd(path, defLoad, loadAddr - defLoad);
+#endif
+    return(loadAddr);
+} // _ccp_load
+
 #ifdef Internals
 // DIR command
 void _ccp_dir(void) {
@@ -409,20 +506,346 @@ uint8 _ccp_vol(void) {
     return (error);
 } // _ccp_vol
 
+// COPY command
+uint8 _ccp_copy(void) {
+    static MACHINE_LOCAL uint8 names[CopyNames][11];
+    uint8 from[17], to[17];
+    uint8 sDrive = _RamRead(ParFCB) ? _RamRead(ParFCB) : curDrive + 1;
+    uint8 dDrive = _RamRead(SecFCB) ? _RamRead(SecFCB) : curDrive + 1;
+    uint8 blank = (_RamRead(SecFCB + 1) == ' ');    // No destination name, keep the source one
+    uint8 unique = TRUE;
+    uint8 result, ch, i;
+    uint16 found, count, done = 0;
+    
+    if (_RamRead(ParFCB + 1) == ' ')
+        return(TRUE);
+    for (i = 1; i < 12; ++i)
+        if (_RamRead(SecFCB + i) == '?')
+            unique = FALSE;
+    
+    _puts("\r\n");
+    if (_SelectDisk(dDrive))
+        return(FALSE);
+    if (roVector & (1 << (dDrive - 1))) {
+        _puts("Err: R/O");
+        return(FALSE);
+    }
+    cDrive = dDrive - 1;
+    _MakeUserDir();                                 // The destination user area may not exist yet
+    cDrive = curDrive;
+    
+    do {
+        // Resolves a batch of source names before touching any file
+        count = found = 0;
+        result = _SearchFirst(ParFCB, FALSE);
+        while (!result && count < CopyNames) {
+            if (found++ >= done) {
+                for (i = 0; i < 11; ++i)
+                    names[count][i] = _RamRead(tmpFCB + 1 + i) & 0x7f;
+                ++count;
+            }
+            result = _SearchNext(ParFCB, FALSE);
+        }
+        if (!done) {
+            if (!count) {
+                _puts("No file");
+                break;
+            }
+            if (count > 1 && unique && !blank) {
+                _puts("Err: destination");
+                break;
+            }
+        }
+        
+        for (found = 0; found < count; ++found) {
+            _RamWrite(CmdFCB, sDrive);
+            for (i = 0; i < 11; ++i)
+                _RamWrite(CmdFCB + 1 + i, names[found][i]);
+            _FCBtoHostname(CmdFCB, from);
+            if (found || done)
+                _puts("\r\n");
+            _ccp_printfcb(CmdFCB, TRUE);
+            
+            _RamWrite(CmdFCB, dDrive);
+            for (i = 0; i < 11; ++i) {
+                ch = _RamRead(SecFCB + 1 + i);
+                _RamWrite(CmdFCB + 1 + i, (blank || ch == '?') ? names[found][i] : ch);
+            }
+            _FCBtoHostname(CmdFCB, to);
+            _puts(" -> ");
+            _ccp_printfcb(CmdFCB, TRUE);
+            
+            if (_ccp_strcmp((char *)from, (char *)to)) {
+                _puts(" Err: same file");
+                continue;
+            }
+            if (_sys_exists(to)) {
+                _puts(" exists, overwrite (Y/N)? ");
+                ch = toupper(_ccp_bdos(C_READ, 0x0000));
+                if (ch == 3) {                      // ^C stops the whole copy
+                    count = 0;
+                    break;
+                }
+                if (ch != 'Y')
+                    continue;
+            }
+            _FileChanged(to);
+            ++dirChanges;
+            if (!_sys_copyfile(from, to)) {
+                _puts(" Err: copy");
+                count = 0;
+                break;
+            }
+        }
+        done += count;
+    } while (count == CopyNames);
+    return(FALSE);
+} // _ccp_copy
+
+#ifdef COMCACHE
+// CACHE command
+uint8 _ccp_cache(void) {
+    uint8 word[9], path[17];
+    uint8 i = 0;
+    
+    while (i < 8 && _RamRead(ParFCB + 1 + i) != ' ') {
+        word[i] = _RamRead(ParFCB + 1 + i);
+        ++i;
+    }
+    word[i] = 0;
+    
+    if (!i) {
+        _puts("\r\n");
+        _comcacheList();
+    } else if (_ccp_strcmp((char *)word, (char *)"FLUSH")) {
+        _comcacheFlush();
+#ifdef CmdCache
+        _ccp_cmdFlush();
+#endif
+    } else if (_ccp_strcmp((char *)word, (char *)"PIN") || _ccp_strcmp((char *)word, (char *)"UNPIN")) {
+        if (_RamRead(SecFCB + 1) == ' ')
+            return(TRUE);
+        _ccp_initFCB(CmdFCB, 36);                   // Works on a copy, SecFCB overlaps the DMA buffer
+        for (i = 0; i < 12; ++i)
+            _RamWrite(CmdFCB + i, _RamRead(SecFCB + i));
+        if (_RamRead(CmdFCB + 9) == ' ') {
+            _RamWrite(CmdFCB + 9, 'C');
+            _RamWrite(CmdFCB + 10, 'O');
+            _RamWrite(CmdFCB + 11, 'M');
+        }
+        _FCBtoHostname(CmdFCB, path);
+        if (word[0] == 'U') {
+            _comcachePin(path, FALSE);
+        } else if (!_comcachePin(path, TRUE)) {    // Not cached yet, loads it first
+            if (_ccp_bdos(F_OPEN, CmdFCB)) {
+                _puts("\r\nNo file");
+            } else {
+                _ccp_load(CmdFCB);
+                if (!_comcachePin(path, TRUE))
+                    _puts("\r\nErr: no room");
+            }
+        }
+    } else {
+        return(TRUE);
+    }
+    return(FALSE);
+} // _ccp_cache
+#endif
+
 // ?/Help command
 uint8 _ccp_hlp(void) {
     _puts("\r\nCCP Commands:\r\n");
     _puts("\t? - Shows this list of commands\r\n");
+#ifdef RUNSTATS
+    _puts("\tBENCH <command> - Runs a command and adds its rates\r\n");
+    _puts("\t    to " BenchName "\r\n");
+#endif
+#ifdef COMCACHE
+    _puts("\tCACHE [FLUSH|PIN <cmd>|UNPIN <cmd>] - Lists or manages\r\n");
+    _puts("\t    the cache of recently run programs\r\n");
+#endif
     _puts("\tCLS - Clears the screen\r\n");
+    _puts("\tCOPY <src> [<dst>] - Copies files, wildcards allowed\r\n");
+#ifdef CCPDATE
+    _puts("\tDATE [yyyy-mm-dd hh:mm[:ss]] - Shows or sets the date\r\n");
+    _puts("\t    and time\r\n");
+#endif
     _puts("\tDEL - Alias to ERA\r\n");
     _puts("\tEXIT - Terminates RunCPM\r\n");
     _puts("\tPAGE [<n>] - Sets the page size for TYPE\r\n");
     _puts("\t    or disables paging if no parameter passed\r\n");
+#ifdef SNAPSHOT
+    _puts("\tSNAP - Saves the session, resumed at the next boot\r\n");
+#endif
+#ifdef RUNSTATS
+    _puts("\tTIME <command> - Runs a command and shows what it cost\r\n");
+#endif
     _puts("\tVOL [drive] - Shows the volume information\r\n");
     _puts("\t    which comes from each volume's INFO.TXT");
     return(FALSE);
 }
 
+// Returns true while a batch is running
+uint8 _ccp_inBatch(void) {
+#ifdef SubmitInternal
+    if (subHead < subEnd)
+        return(TRUE);
+#endif
+    return(sFlag);
+} // _ccp_inBatch
+
+#ifdef SubmitInternal
+// Expands the .SUB file open on CmdFCB in front of the batch queue, replacing $1..$9 by the parameters
+// on the command tail (and $$ by $), so nested batches run before the rest of the current one
+uint8 _ccp_subload(void) {
+    uint8 tail[128];
+    uint8 argPos[10], argLen[10];
+    uint8 line[cmdLen + 1];
+    uint8 llen = 0, nargs = 0, dollar = FALSE, eof = FALSE;
+    uint8 ch, i, j;
+    uint16 rest = subEnd - subHead;
+    uint16 limit = SubSize - rest;
+    uint16 len = 0;
+    uint16 a;
+    
+    for (i = 0; i < _RamRead(defDMA); ++i)          // Splits the command tail into parameters
+        tail[i] = _RamRead(defDMA + 1 + i);
+    for (j = 0; j < i && nargs < 9; ) {
+        while (j < i && tail[j] == ' ')
+            ++j;
+        if (j == i)
+            break;
+        argPos[++nargs] = j;
+        while (j < i && tail[j] != ' ')
+            ++j;
+        argLen[nargs] = j - argPos[nargs];
+    }
+    
+    memmove(subQueue + limit, subQueue + subHead, rest);   // Moves what is left to the end of the queue
+    subHead = limit;
+    subEnd = SubSize;
+    
+    _ccp_bdos(F_DMAOFF, defLoad);
+    while (!eof) {
+        eof = (uint8)_ccp_bdos(F_READ, CmdFCB);
+        for (a = defLoad; a < defLoad + 128; ++a) {
+            ch = eof ? 0x1a : _RamRead(a);
+            if (ch == 0x1a) {
+                eof = TRUE;
+                ch = '\n';                          // Ends the last line
+            }
+            if (dollar) {
+                dollar = FALSE;
+                if (ch >= '1' && ch <= '9') {
+                    j = ch - '0';
+                    for (i = 0; j <= nargs && i < argLen[j] && llen < cmdLen; ++i)
+                        line[llen++] = tail[argPos[j] + i];
+                    continue;
+                }
+                if (ch != '$' && llen < cmdLen)
+                    line[llen++] = '$';
+            } else if (ch == '$') {
+                dollar = TRUE;
+                continue;
+            }
+            if (ch == '\r' || ch == '\n') {              // Either ends a line, empty lines are dropped
+                if (llen) {
+                    if (len + llen + 1 > limit) {
+                        _ccp_bdos(F_DMAOFF, defDMA);
+                        _puts("\r\nErr: batch too long");
+                        return(FALSE);
+                    }
+                    memcpy(subQueue + len, line, llen);
+                    len += llen;
+                    subQueue[len++] = 0;
+                    llen = 0;
+                }
+            } else if (llen < cmdLen) {
+                line[llen++] = ch;
+            }
+            if (eof)
+                break;
+        }
+    }
+    _ccp_bdos(F_DMAOFF, defDMA);
+    
+    memmove(subQueue + len, subQueue + limit, rest);        // Joins the rest of the queue back
+    subHead = 0;
+    subEnd = len + rest;
+    return(FALSE);
+} // _ccp_subload
+#endif
+
+// Opens the command on CmdFCB: on the FCB drive, then if no drive was given on A: user 0 and on
+// the current drive user 0. Leaves CmdFCB and the user area where it was found, setting *user
+// to the user area to go back to, or restores both if it wasn't found.
+uint8 _ccp_open(uint8* user) {
+    uint8 drive = _RamRead(CmdFCB);
+    uint8 found;
+#ifdef CmdCache
+    uint8 key[12];
+    uint8 fromDrive = cDrive, fromUser = userCode;
+    CMDENTRY* c;
+    uint8 i;
+    
+    for (i = 0; i < 12; ++i)
+        key[i] = _RamRead(CmdFCB + i);
+    if ((c = _ccp_cmdFind(key))) {
+        if (!c->found)
+            return(FALSE);                              // Known not to be there, no disk access at all
+        _RamWrite(CmdFCB, c->fdrive);
+        if (c->fuser != userCode) {
+            *user = curUser;
+            _ccp_bdos(F_USERNUM, c->fuser);
+        }
+        if (!_ccp_bdos(F_OPEN, CmdFCB))
+            return(TRUE);
+        c->key[1] = 0;                                  // Removed behind the BDOS back, look again
+        _RamWrite(CmdFCB, drive);
+        if (*user) {
+            _ccp_bdos(F_USERNUM, curUser);
+            *user = 0;
+        }
+    }
+#endif
+    found = !_ccp_bdos(F_OPEN, CmdFCB);                 // Look for the program on the FCB drive, current or specified
+    if (!found) {                                       // If not found
+        if (!drive) {                                   // and the search was on the default drive
+            _RamWrite(CmdFCB, 0x01);                    // Then look on drive A: user 0
+            if (curUser) {
+                *user = curUser;                        // Save the current user
+                _ccp_bdos(F_USERNUM, 0x0000);           // then set it to 0
+            }
+            found = !_ccp_bdos(F_OPEN, CmdFCB);
+            if (!found) {                               // If still not found then
+                if (curUser) {                          // If current user not = 0
+                    _RamWrite(CmdFCB, 0x00);            // look on current drive user 0
+                    found = !_ccp_bdos(F_OPEN, CmdFCB); // and try again
+                }
+            }
+        }
+    }
+    if (!found) {
+        _RamWrite(CmdFCB, drive);                       // restore previous drive
+        if (*user) {
+            _ccp_bdos(F_USERNUM, curUser);              // restore to previous user
+            *user = 0;
+        }
+    }
+#ifdef CmdCache
+    c = &cmdCache[cmdNext];
+    cmdNext = (cmdNext + 1) % CmdCache;
+    memcpy(c->key, key, 12);
+    c->drive = fromDrive;
+    c->user = fromUser;
+    c->found = found;
+    c->fdrive = _RamRead(CmdFCB);
+    c->fuser = userCode;
+    c->changes = dirChanges;
+#endif
+    return(found);
+} // _ccp_open
+
 // External (.COM) command
 uint8 _ccp_ext(void) {
     bool error = TRUE, found = FALSE;
@@ -442,27 +865,7 @@ uint8 _ccp_ext(void) {
         }
 
         drive = _RamRead(CmdFCB);                           // Get the drive from the command FCB
-        found = !_ccp_bdos(F_OPEN, CmdFCB);                 // Look for the program on the FCB drive, current or specified
-        if (!found) {                                       // If not found
-            if (!drive) {                                   // and the search was on the default drive
-                _RamWrite(CmdFCB, 0x01);                    // Then look on drive A: user 0
-                if (curUser) {
-                    user = curUser;                         // Save the current user
-                    _ccp_bdos(F_USERNUM, 0x0000);           // then set it to 0
-                }
-                found = !_ccp_bdos(F_OPEN, CmdFCB);
-                if (!found) {                               // If still not found then
-                    if (curUser) {                          // If current user not = 0
-                        _RamWrite(CmdFCB, 0x00);            // look on current drive user 0
-                        found = !_ccp_bdos(F_OPEN, CmdFCB); // and try again
-                    }
-                }
-            }
-        }
-        if (!found) {
-            _RamWrite(CmdFCB, drive);                       // restore previous drive
-            _ccp_bdos(F_USERNUM, curUser);                  // restore to previous user
-        }
+        found = _ccp_open(&user);
     }
 
     //if .COM not found then look for a .SUB file
@@ -472,29 +875,13 @@ uint8 _ccp_ext(void) {
         _RamWrite(CmdFCB + 11, 'B');
         
         drive = _RamRead(CmdFCB);                           // Get the drive from the command FCB
-        found = !_ccp_bdos(F_OPEN, CmdFCB);                 // Look for the program on the FCB drive, current or specified
-        if (!found) {                                       // If not found
-            if (!drive) {                                   // and the search was on the default drive
-                _RamWrite(CmdFCB, 0x01);                    // Then look on drive A: user 0
-                if (curUser) {
-                    user = curUser;                         // Save the current user
-                    _ccp_bdos(F_USERNUM, 0x0000);           // then set it to 0
-                }
-                found = !_ccp_bdos(F_OPEN, CmdFCB);
-                if (!found) {                               // If still not found then
-                    if (curUser) {                          // If current user not = 0
-                        _RamWrite(CmdFCB, 0x00);            // look on current drive user 0
-                        found = !_ccp_bdos(F_OPEN, CmdFCB); // and try again
-                    }
-                }
-            }
-        }
-        if (!found) {
-            _RamWrite(CmdFCB, drive);                       // restore previous drive
-            _ccp_bdos(F_USERNUM, curUser);                  // restore to previous user
-        }
+        found = _ccp_open(&user);
 
         if (found) {
+#ifdef SubmitInternal
+            error = _ccp_subload();                         // Queues the batch lines, nothing to load
+            found = FALSE;
+#else
             //_puts(".SUB file found!\n");
             int i;
 
@@ -515,23 +902,7 @@ uint8 _ccp_ext(void) {
                 _RamWrite(CmdFCB + i + 1, str[i]);
             
             //now try to find SUBMIT.COM file
-            found = !_ccp_bdos(F_OPEN, CmdFCB);                 // Look for the program on the FCB drive, current or specified
-            if (!found) {                                       // If not found
-                if (!drive) {                                   // and the search was on the default drive
-                    _RamWrite(CmdFCB, 0x01);                    // Then look on drive A: user 0
-                    if (curUser) {
-                        user = curUser;                         // Save the current user
-                        _ccp_bdos(F_USERNUM, 0x0000);           // then set it to 0
-                    }
-                    found = !_ccp_bdos(F_OPEN, CmdFCB);
-                    if (!found) {                               // If still not found then
-                        if (curUser) {                          // If current user not = 0
-                            _RamWrite(CmdFCB, 0x00);            // look on current drive user 0
-                            found = !_ccp_bdos(F_OPEN, CmdFCB); // and try again
-                        }
-                    }
-                }
-            }
+            found = _ccp_open(&user);
             if (found) {
                 //insert "@" into command buffer
                 //note: this is so the rest will be parsed correctly
@@ -547,21 +918,13 @@ uint8 _ccp_ext(void) {
                     lc = nc;
                 }
             }
+#endif
         }
     }
 
     if (found) {										// Program was found somewhere
         _puts("\r\n");
-        _ccp_bdos(F_DMAOFF, loadAddr);					// Sets the DMA address for the loading
-        while (!_ccp_bdos(F_READ, CmdFCB)) {			// Loads the program into memory
-            loadAddr += 128;
-            if (loadAddr == BDOSjmppage) {				// Breaks if it reaches the end of TPA
-                _puts("\r\nNo Memory");
-                break;
-            }
-            _ccp_bdos(F_DMAOFF, loadAddr);				// Points the DMA offset to the next loadAddr
-        }
-        _ccp_bdos(F_DMAOFF, defDMA);					// Points the DMA offset back to the default
+        _ccp_load(CmdFCB);								// Loads the program into memory
         
         if (user) {										// If a user was selected
             _ccp_bdos(F_USERNUM, curUser);				// Set it back
@@ -595,6 +958,203 @@ uint8 _ccp_ext(void) {
     return(error);
 } // _ccp_ext
 
+#ifdef RUNSTATS
+// Prints host microseconds as seconds
+void _ccp_putsecs(const char* label, uint32 us) {
+    char line[40];
+    
+    sprintf(line, "%s%lu.%06lu s", label, (unsigned long)(us / 1000000UL), (unsigned long)(us % 1000000UL));
+    _puts(line);
+}
+
+// Runs the first parameter as a command, the rest of the line being its tail, and takes
+// the counters around it. Returns 0 if it ran, 1 if no command was given and 2 if it
+// wasn't found (already reported)
+uint8 _ccp_measure(uint8* name, RUNCOUNTERS* before, RUNCOUNTERS* after, uint32* elapsed) {
+    uint8 len = _RamRead(defDMA);
+    uint8 i = 0, j;
+    
+    if (_RamRead(ParFCB + 1) == ' ')
+        return(1);
+    
+    // The first parameter becomes the command and the rest of the line its tail
+    _ccp_initFCB(CmdFCB, 36);
+    for (j = 0; j < 12; ++j)
+        _RamWrite(CmdFCB + j, _RamRead(ParFCB + j));
+    for (i = 0; i < 8 && _RamRead(CmdFCB + 1 + i) != ' '; ++i)
+        name[i] = _RamRead(CmdFCB + 1 + i);
+    name[i] = 0;
+    
+    i = 0;
+    while (i < len && _RamRead(defDMA + 1 + i) == ' ')
+        ++i;
+    while (i < len && _RamRead(defDMA + 1 + i) != ' ')
+        ++i;
+    for (j = 0; i + j < len; ++j)
+        _RamWrite(defDMA + 1 + j, _RamRead(defDMA + 1 + i + j));
+    _RamWrite(defDMA, j);
+    while (j < 127)
+        _RamWrite(defDMA + 1 + j++, 0);
+    
+    pbuf = defDMA + 1;                              // Parses the new tail onto the parameter FCBs
+    blen = _RamRead(defDMA);
+    _ccp_initFCB(ParFCB, 18);
+    _ccp_initFCB(SecFCB, 18);
+    while (_RamRead(pbuf) == ' ' && blen) {
+        ++pbuf;
+        --blen;
+    }
+    _ccp_nameToFCB(ParFCB);
+    while (_RamRead(pbuf) == ' ' && blen) {
+        ++pbuf;
+        --blen;
+    }
+    _ccp_nameToFCB(SecFCB);
+    blen = 0;
+    
+    *before = runStats;
+    *elapsed = micros();
+    if (_ccp_ext()) {
+        _puts("\r\n");
+        _puts((char *)name);
+        _puts("?\r\n");
+        return(2);
+    }
+    *elapsed = micros() - *elapsed;
+    *after = runStats;                              // Before the report adds console time of its own
+    return(0);
+} // _ccp_measure
+
+// TIME command
+uint8 _ccp_time(void) {
+    RUNCOUNTERS before, after;
+#ifdef BANKSTORE
+    uint32 pageIns = ramPageIns;
+    uint32 pageOuts = ramPageOuts;
+#endif
+    uint32 elapsed;
+    uint8 name[9];
+    uint8 r;
+    char line[80];
+    
+    if ((r = _ccp_measure(name, &before, &after, &elapsed)))
+        return(r == 1);
+    
+    _ccp_putsecs("\r\nElapsed       ", elapsed);
+    sprintf(line, "\r\nInstructions  %llu", after.instructions - before.instructions);
+    _puts(line);
+    if (elapsed) {
+        sprintf(line, " (%llu per second)", (after.instructions - before.instructions) * 1000000ULL / elapsed);
+        _puts(line);
+    }
+    sprintf(line, "\r\nBDOS calls    %lu console, %lu disk, %lu other",
+        (unsigned long)(after.conCalls - before.conCalls),
+        (unsigned long)(after.diskCalls - before.diskCalls),
+        (unsigned long)(after.otherCalls - before.otherCalls));
+    _puts(line);
+    _ccp_putsecs("\r\nDisk I/O      ", after.diskTime - before.diskTime);
+    sprintf(line, ", %lu bytes read, %lu written",
+        (unsigned long)(after.bytesRead - before.bytesRead),
+        (unsigned long)(after.bytesWritten - before.bytesWritten));
+    _puts(line);
+    _ccp_putsecs("\r\nConsole out   ", after.conOutTime - before.conOutTime);
+    sprintf(line, ", %lu bytes", (unsigned long)(after.conBytes - before.conBytes));
+    _puts(line);
+#ifdef BANKSTORE
+    sprintf(line, "\r\nBank paging   %lu pages in, %lu out", (unsigned long)(ramPageIns - pageIns),
+        (unsigned long)(ramPageOuts - pageOuts));
+    _puts(line);
+#endif
+    _puts("\r\n");
+    return(FALSE);
+} // _ccp_time
+
+// BENCH command, TIME for scripts: appends a line of rates to the BenchName CSV file
+uint8 _ccp_bench(void) {
+    static const char header[] = "build,command,elapsed_us,instructions,instructions_per_s,"
+        "bdos_calls,bdos_calls_per_s,disk_bytes,disk_bytes_per_s,console_bytes,console_bytes_per_s\r\n";
+    RUNCOUNTERS before, after;
+    unsigned long long bdos, disk;
+    uint32 elapsed;
+    uint8 name[9];
+    uint8 len = _RamRead(defDMA);
+    uint8 i, j, r, ch;
+    char cmd[cmdLen + 1];
+    char line[cmdLen + 240];
+    
+    for (i = 0, j = 0; i < len; ++i) {               // The command line is the label of the run
+        ch = _RamRead(defDMA + 1 + i);
+        if (j || ch != ' ')
+            cmd[j++] = ch == ',' ? ';' : ch;
+    }
+    while (j && cmd[j - 1] == ' ')
+        --j;
+    cmd[j] = 0;
+    
+    if ((r = _ccp_measure(name, &before, &after, &elapsed)))
+        return(r == 1);
+    if (!elapsed)
+        elapsed = 1;
+    
+    bdos = (after.conCalls - before.conCalls) + (after.diskCalls - before.diskCalls) +
+        (after.otherCalls - before.otherCalls);
+    disk = (after.bytesRead - before.bytesRead) + (after.bytesWritten - before.bytesWritten);
+    sprintf(line, "%s,%s,%lu,%llu,%llu,%llu,%llu,%llu,%llu,%lu,%llu\r\n", BENCHTAG, cmd, (unsigned long)elapsed,
+        after.instructions - before.instructions,
+        (after.instructions - before.instructions) * 1000000ULL / elapsed,
+        bdos, bdos * 1000000ULL / elapsed,
+        disk, disk * 1000000ULL / elapsed,
+        (unsigned long)(after.conBytes - before.conBytes),
+        (after.conBytes - before.conBytes) * 1000000ULL / elapsed);
+    
+    if (!_sys_exists((uint8*)BenchName))
+        _sys_appendfile((uint8*)BenchName, (const uint8*)header, sizeof(header) - 1);
+    if (!_sys_appendfile((uint8*)BenchName, (const uint8*)line, strlen(line))) {
+        _puts("\r\nCannot write " BenchName "\r\n");
+        return(FALSE);
+    }
+    sprintf(line, "\r\n%s: %llu instructions per second\r\n", name,
+        (after.instructions - before.instructions) * 1000000ULL / elapsed);
+    _puts(line);
+    return(FALSE);
+} // _ccp_bench
+#endif
+
+#ifdef SNAPSHOT
+// SNAP command
+uint8 _ccp_snap(void) {
+    if (_snapSave())
+        _puts("\r\nSaved to " SnapName ", resumed at the next boot\r\n");
+    else
+        _puts("\r\nCannot write " SnapName "\r\n");
+    return(FALSE);
+} // _ccp_snap
+#endif
+
+#ifdef CCPDATE
+// DATE command
+uint8 _ccp_date(void) {
+    char line[cmdLen + 1];
+    uint8 dat[5];
+    uint8 len = _RamRead(defDMA);
+    uint8 month, day, i;
+    uint16 year;
+    
+    for (i = 0; i < len; ++i)
+        line[i] = _RamRead(defDMA + 1 + i);
+    line[i] = 0;
+    for (i = 0; line[i] == ' '; ++i);
+    if (line[i] && !_clockParse(line))
+        return(TRUE);
+    
+    _clockGet(dat);
+    _clockFromDays(dat[0] | (dat[1] << 8), &year, &month, &day);
+    sprintf(line, "\r\n%04u-%02u-%02u %02x:%02x:%02x", year, month, day, dat[2], dat[3], dat[4]);
+    _puts(line);
+    return(FALSE);
+} // _ccp_date
+#endif
+
 // Prints a command error
 void _ccp_cmdError() {
     uint8 ch;
@@ -608,11 +1168,22 @@ void _ccp_cmdError() {
     _puts("?\r\n");
 } // _ccp_cmdError
 
-// Reads input, either from the $$$.SUB or console
+// Reads input, either from the batch queue, the $$$.SUB or console
 void _ccp_readInput(void) {
     uint8 i;
     uint8 chars;
     
+#ifdef SubmitInternal
+    if (subHead < subEnd) {                     // Next line from the in-memory batch
+        chars = (uint8)strlen((char *)subQueue + subHead);
+        _RamWrite(inBuf + 1, chars);
+        for (i = 0; i <= chars; ++i)
+            _RamWrite(inBuf + 2 + i, subQueue[subHead + i]);
+        subHead += chars + 1;
+        _puts((char *)subQueue + subHead - chars - 1);
+        return;
+    }
+#endif
     if (sFlag) {                                // Are we running a submit?
         if (!sRecs) {                           // Are we already counting?
             _ccp_bdos(F_OPEN, BatchFCB);        // Open the batch file
@@ -642,7 +1213,15 @@ void _ccp_readInput(void) {
 // Main CCP code
 void _ccp(void) {
     uint8 i;
+    bool autoexec = firstBoot;
     
+#ifdef SNAPSHOT
+    if (snapResumed) {                              // A resumed session carries on from its own drive
+        curDrive = _RamRead(DSKByte) & 0x0f;
+        autoexec = FALSE;
+        snapResumed = FALSE;
+    }
+#endif
     sFlag = (bool)_ccp_bdos(DRV_ALLRESET, 0x0000);
     _ccp_bdos(DRV_SET, curDrive);
     
@@ -652,7 +1231,7 @@ void _ccp(void) {
 
 	// Loads an autoexec file if it exists and this is the first boot
 	// The file contents are loaded at ccpAddr+8 up to 126 bytes then the size loaded is stored at ccpAddr+7
-	if (firstBoot && !sFlag) {
+	if (autoexec && !sFlag) {
         if (_sys_exists((uint8*)AUTOEXEC)) {
             uint16 cmd = inBuf + 2;
             uint8 bytesread = (uint8)_RamLoad((uint8*)AUTOEXEC, cmd, 125);
@@ -679,7 +1258,7 @@ void _ccp(void) {
         
         parDrive = curDrive;                            // Initially the parameter drive is the same as the current drive
 
-        sprintf((char *) prompt, "\r\n%c%u%c", 'A' + curDrive, curUser, sFlag ? '$' : '>');
+        sprintf((char *) prompt, "\r\n%c%u%c", 'A' + curDrive, curUser, _ccp_inBatch() ? '$' : '>');
         if(!blen){
             _puts((char *)prompt);
 
@@ -849,6 +1428,46 @@ void _ccp(void) {
                     break;
                 }
 
+                case 12: {          // COPY
+                    i = _ccp_copy();
+                    break;
+                }
+
+#ifdef COMCACHE
+                case 13: {          // CACHE
+                    i = _ccp_cache();
+                    break;
+                }
+#endif
+
+#ifdef RUNSTATS
+                case 14: {          // TIME
+                    i = _ccp_time();
+                    break;
+                }
+#endif
+
+#ifdef CCPDATE
+                case 15: {          // DATE
+                    i = _ccp_date();
+                    break;
+                }
+#endif
+
+#ifdef RUNSTATS
+                case 16: {          // BENCH
+                    i = _ccp_bench();
+                    break;
+                }
+#endif
+
+#ifdef SNAPSHOT
+                case 17: {          // SNAP
+                    i = _ccp_snap();
+                    break;
+                }
+#endif
+
                 // External commands
                 case 255: {         // It is an external command
                     i = _ccp_ext();
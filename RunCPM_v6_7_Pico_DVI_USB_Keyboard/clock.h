@@ -0,0 +1,139 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+/*
+	Date and time (BDOS T_GET/T_SET and the SCB date/time fields)
+
+	The clock is kept in CP/M format: a day number (day 1 is 1 January 1978) plus the
+	seconds since midnight, with the hours, minutes and seconds also held in packed BCD.
+	It advances from millis(). A read only compares the tick against the next second, and
+	the BCD fields are rebuilt at most once per second, so no calendar arithmetic is done
+	on the way to T_GET. The clock is seeded on first use from the host (the TimeName file
+	on boards without an RTC, the host clock on POSIX). It can then be set from CP/M with
+	T_SET or S_SCB, or from the console with the CCP DATE command (CCPDATE).
+*/
+
+#define SCB_DATE	0x58				// CP/M 3 SCB offsets of the date and time fields
+#define SCB_HOUR	0x5A
+#define SCB_MIN		0x5B
+#define SCB_SEC		0x5C
+
+static MACHINE_LOCAL uint16	clockDays = 1;			// CP/M date, day 1 = 1 January 1978
+static MACHINE_LOCAL uint32	clockSecs = 0;			// Seconds since midnight
+static MACHINE_LOCAL uint32	clockTick = 0;			// millis() when clockSecs was last advanced
+static MACHINE_LOCAL uint8	clockBCD[3];			// hh, mm, ss in packed BCD
+static MACHINE_LOCAL uint8	clockSeeded = FALSE;
+
+static uint8 _clockToBCD(uint8 v) {
+	return(((v / 10) << 4) | (v % 10));
+}
+
+static uint8 _clockFromBCD(uint8 v) {
+	return((v >> 4) * 10 + (v & 0x0f));
+}
+
+static uint8 _clockLeap(uint16 year) {
+	return((!(year % 4) && (year % 100)) || !(year % 400));
+}
+
+// CP/M day number of a calendar date
+uint16 _clockToDays(uint16 year, uint8 month, uint8 day) {
+	static const uint16 before[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+	uint16 days = before[month - 1] + day;
+	uint16 y;
+
+	for (y = 1978; y < year; ++y)
+		days += _clockLeap(y) ? 366 : 365;
+	if (month > 2 && _clockLeap(year))
+		++days;
+	return(days);
+}
+
+// Calendar date of a CP/M day number
+void _clockFromDays(uint16 days, uint16* year, uint8* month, uint8* day) {
+	static const uint8 length[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	uint16 n;
+
+	*year = 1978;
+	while (days > (n = _clockLeap(*year) ? 366 : 365)) {
+		days -= n;
+		++*year;
+	}
+	*month = 1;
+	while (days > (n = length[*month - 1] + (*month == 2 && _clockLeap(*year)))) {
+		days -= n;
+		++*month;
+	}
+	*day = days;
+}
+
+void _clockSet(uint16 days, uint32 secs) {
+	clockDays = days;
+	clockSecs = secs % 86400UL;
+	clockTick = REPLAYED(RP_MILLIS, millis());
+	clockBCD[0] = _clockToBCD(clockSecs / 3600);
+	clockBCD[1] = _clockToBCD(clockSecs / 60 % 60);
+	clockBCD[2] = _clockToBCD(clockSecs % 60);
+	clockSeeded = TRUE;
+}
+
+// Sets the clock from "YYYY-MM-DD HH:MM[:SS]" (any single separators), returns FALSE if it doesn't parse
+uint8 _clockParse(const char* s) {
+	unsigned int y, mo, d, h, mi, sec = 0;
+
+	if (sscanf(s, " %u%*1[-/.]%u%*1[-/.]%u %u:%u:%u", &y, &mo, &d, &h, &mi, &sec) < 5)
+		return(FALSE);
+	if (y < 1978 || y > 2099 || mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 59)
+		return(FALSE);
+	_clockSet(_clockToDays(y, mo, d), h * 3600UL + mi * 60 + sec);
+	return(TRUE);
+}
+
+// Brings the clock up to date, seeding it from the host the first time
+void _clockUpdate(void) {
+	uint32 elapsed;
+	char seed[32];
+#ifdef REPLAY
+	uint32 recorded;
+#endif
+
+	if (!clockSeeded) {
+		if (!_sys_gettime((uint8*)seed, sizeof(seed)) || !_clockParse(seed))
+			_clockSet(clockDays, clockSecs);
+#ifdef REPLAY
+		recorded = REPLAYED(RP_CLOCK, (uint32)clockDays << 17 | clockSecs);	// A replay starts from the recorded date and time
+		_clockSet(recorded >> 17, recorded & 0x1ffff);
+#endif
+		return;
+	}
+	if ((elapsed = REPLAYED(RP_MILLIS, millis()) - clockTick) < 1000)
+		return;
+	elapsed /= 1000;
+	clockSecs += elapsed;
+	clockTick += elapsed * 1000;
+	while (clockSecs >= 86400UL) {
+		clockSecs -= 86400UL;
+		++clockDays;
+	}
+	clockBCD[0] = _clockToBCD(clockSecs / 3600);
+	clockBCD[1] = _clockToBCD(clockSecs / 60 % 60);
+	clockBCD[2] = _clockToBCD(clockSecs % 60);
+}
+
+// Fills a date and time block in the SCB/DAT layout: day number (word), hh, mm, ss (BCD)
+void _clockGet(uint8* dat) {
+	_clockUpdate();
+	dat[0] = clockDays & 0xff;
+	dat[1] = clockDays >> 8;
+	dat[2] = clockBCD[0];
+	dat[3] = clockBCD[1];
+	dat[4] = clockBCD[2];
+}
+
+// Sets the clock from a block in the same layout
+void _clockPut(const uint8* dat) {
+	_clockSet(dat[0] | (dat[1] << 8),
+		_clockFromBCD(dat[2]) * 3600UL + _clockFromBCD(dat[3]) * 60 + _clockFromBCD(dat[4]));
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef COMCACHE_H
+#define COMCACHE_H
+
+/*
+	Resident .COM image cache (used by the internal CCP)
+
+	The images of the last programs run are kept in host RAM, so running them again is a
+	single copy into the TPA instead of a read from the card. Entries are keyed by the host
+	path and checked against the file size and modification stamp before use, and are
+	dropped as soon as the file is written, renamed or deleted through the BDOS.
+	Pinned entries are never evicted to make room for others.
+*/
+
+#ifndef COMCACHE_ATTR
+#define COMCACHE_ATTR					// Boards may place the pool elsewhere (e.g. PSRAM)
+#endif
+
+#define CC_ENTRIES 8
+
+typedef struct {
+	uint8	path[17];					// Host path, empty if the entry is free
+	uint8	pinned;
+	uint32	size;						// Host file size and stamp when it was cached
+	uint32	stamp;
+	uint32	offset;						// Image position and length in the pool
+	uint32	len;
+	uint32	hits;
+	uint32	used;						// Last use, for LRU eviction
+} CCENTRY;
+
+static MACHINE_LOCAL uint8	ccPool[COMCACHE] COMCACHE_ATTR;
+static MACHINE_LOCAL CCENTRY	ccEntry[CC_ENTRIES];
+static MACHINE_LOCAL uint32	ccUsed = 0;				// Bytes in use, images are packed from the start of the pool
+static MACHINE_LOCAL uint32	ccClock = 0;
+
+static CCENTRY* _comcacheFind(uint8* path) {
+	uint8 i;
+
+	for (i = 0; i < CC_ENTRIES; ++i)
+		if (ccEntry[i].path[0] && !strcmp((char*)ccEntry[i].path, (char*)path))
+			return(&ccEntry[i]);
+	return(NULL);
+}
+
+// Frees an entry and packs the pool
+static void _comcacheFree(CCENTRY* e) {
+	uint32 end = e->offset + e->len;
+	uint8 i;
+
+	memmove(ccPool + e->offset, ccPool + end, ccUsed - end);
+	for (i = 0; i < CC_ENTRIES; ++i)
+		if (ccEntry[i].path[0] && ccEntry[i].offset > e->offset)
+			ccEntry[i].offset -= e->len;
+	ccUsed -= e->len;
+	e->path[0] = 0;
+}
+
+// Forgets a file, called whenever it is changed through the BDOS
+void _comcacheDrop(uint8* path) {
+	CCENTRY* e;
+
+	if (ccUsed && (e = _comcacheFind(path)))
+		_comcacheFree(e);
+}
+
+void _comcacheFlush(void) {
+	uint8 i;
+
+	for (i = 0; i < CC_ENTRIES; ++i)
+		ccEntry[i].path[0] = 0;
+	ccUsed = 0;
+}
+
+// Copies a cached image to address, returns its length or 0 if it isn't cached (or is stale)
+uint32 _comcacheLoad(uint8* path, uint16 address) {
+	CCENTRY* e = _comcacheFind(path);
+	uint32 size, stamp, i;
+
+	if (!e)
+		return(0);
+	if (!_sys_filestamp(path, &size, &stamp) || size != e->size || stamp != e->stamp) {
+		_comcacheFree(e);
+		return(0);
+	}
+	if (_RamSpan(address) >= e->len) {
+		memcpy(_RamSysAddr(address), ccPool + e->offset, e->len);
+	} else {
+		for (i = 0; i < e->len; ++i)
+			_RamWrite(address + i, ccPool[e->offset + i]);
+	}
+	++e->hits;
+	e->used = ++ccClock;
+	return(e->len);
+}
+
+// Caches the image just loaded at address, evicting the least recently used entries if needed
+void _comcacheAdd(uint8* path, uint16 address, uint32 len) {
+	CCENTRY *e, *lru;
+	uint32 size, stamp, i;
+
+	if (!len || len > COMCACHE || !_sys_filestamp(path, &size, &stamp))
+		return;
+	if ((e = _comcacheFind(path)))
+		_comcacheFree(e);
+	while (TRUE) {
+		e = lru = NULL;
+		for (i = 0; i < CC_ENTRIES; ++i) {
+			if (!ccEntry[i].path[0]) {
+				if (!e)
+					e = &ccEntry[i];
+			} else if (!ccEntry[i].pinned && (!lru || ccEntry[i].used < lru->used)) {
+				lru = &ccEntry[i];
+			}
+		}
+		if (e && ccUsed + len <= COMCACHE)
+			break;
+		if (!lru)
+			return;						// Everything left is pinned
+		_comcacheFree(lru);
+	}
+	strcpy((char*)e->path, (char*)path);
+	e->pinned = FALSE;
+	e->size = size;
+	e->stamp = stamp;
+	e->offset = ccUsed;
+	e->len = len;
+	e->hits = 0;
+	e->used = ++ccClock;
+	if (_RamSpan(address) >= len) {
+		memcpy(ccPool + ccUsed, _RamSysAddr(address), len);
+	} else {
+		for (i = 0; i < len; ++i)
+			ccPool[ccUsed + i] = _RamRead(address + i);
+	}
+	ccUsed += len;
+}
+
+// Sets or clears the pinned flag, returns FALSE if the file isn't cached
+uint8 _comcachePin(uint8* path, uint8 pin) {
+	CCENTRY* e = _comcacheFind(path);
+
+	if (!e)
+		return(FALSE);
+	e->pinned = pin;
+	return(TRUE);
+}
+
+void _comcacheList(void) {
+	char line[80];
+	uint8 i, n = 0;
+
+	for (i = 0; i < CC_ENTRIES; ++i) {
+		if (ccEntry[i].path[0]) {
+			sprintf(line, "%-16.16s %6lu bytes %6lu hits%s\r\n", (char*)ccEntry[i].path, (unsigned long)ccEntry[i].len,
+				(unsigned long)ccEntry[i].hits, ccEntry[i].pinned ? "  pinned" : "");
+			_puts(line);
+			++n;
+		}
+	}
+	sprintf(line, "%u of %u entries, %lu of %lu bytes used", n, CC_ENTRIES, (unsigned long)ccUsed, (unsigned long)COMCACHE);
+	_puts(line);
+}
+
+#endif
@@ -8,10 +8,11 @@
 extern int _kbhit(void);
 uint8_t _getch(void);
 void _putch(uint8 ch);
+void _putchBlock(const uint8* buf, uint32 len);
 
 /* see main.c for definition */
 
-uint8 mask8bit = 0x7f;		// TO be used for masking 8 bit characters (XMODEM related)
+MACHINE_LOCAL uint8 mask8bit = 0x7f;		// TO be used for masking 8 bit characters (XMODEM related)
 							// If set to 0x7f, RunCPM masks the 8th bit of characters sent
 							// to the console. This is the standard CP/M behavior.
 							// If set to 0xff, RunCPM passes 8 bit characters. This is
@@ -32,7 +33,14 @@ uint8 _getchNB(void)		// Gets a character, non-blocking, no echo
 
 void _putcon(uint8 ch)		// Puts a character
 {
+#ifdef RUNSTATS
+	uint32 start = micros();
 	_putch(ch & mask8bit);
+	runStats.conOutTime += micros() - start;
+	++runStats.conBytes;
+#else
+	_putch(ch & mask8bit);
+#endif
 }
 
 void _puts(const char* str)	// Puts a \0 terminated string
@@ -41,6 +49,92 @@ void _puts(const char* str)	// Puts a \0 terminated string
 		_putcon(*(str++));
 }
 
+#define CONBLK 64				// Size of the chunks masked before being sent to the console
+
+void _putconBlock(const uint8* buf, uint32 len)	// Puts a block of characters
+{
+	uint32 tmp[CONBLK / 4];
+	uint32 mask = mask8bit * 0x01010101UL;
+	uint32 n, i;
+#ifdef RUNSTATS
+	uint32 start = micros();
+
+	runStats.conBytes += len;
+#endif
+
+	if (mask8bit == 0xff) {
+		_putchBlock(buf, len);
+	} else {
+		while (len) {
+			n = len < CONBLK ? len : CONBLK;
+			memcpy(tmp, buf, n);
+			for (i = 0; i < (n + 3) / 4; ++i)	// Masks four characters at a time
+				tmp[i] &= mask;
+			_putchBlock((uint8*)tmp, n);
+			buf += n;
+			len -= n;
+		}
+	}
+#ifdef RUNSTATS
+	runStats.conOutTime += micros() - start;
+#endif
+}
+
+uint32 _RamSpan(uint16 address)	// Number of bytes from address that are contiguous in host memory
+{
+#ifdef BANKSTORE
+	return(0x1000 - (address & 0x0fff));	// Every page is a separate frame
+#else
+#ifndef RAM_FAST
+	if (address < COMMONBASE && curBank != 1)
+		return(COMMONBASE - address);
+#endif
+	return(0x10000UL - address);
+#endif
+}
+
+uint32 _dollarlen(const uint8* p, uint32 max)	// Finds the '$' terminator, a word at a time
+{
+	uint32 n = 0, w;
+
+	while (n + 4 <= max) {
+		memcpy(&w, p + n, 4);
+		w ^= 0x24242424UL;
+		if ((w - 0x01010101UL) & ~w & 0x80808080UL)	// One of the four bytes is a '$'
+			break;
+		n += 4;
+	}
+	while (n < max && p[n] != '$')
+		++n;
+	return(n);
+}
+
+void _putconRam(uint16 address, uint16 len)	// Puts a block of characters from the emulated RAM
+{
+	uint32 n;
+
+	while (len) {
+		n = _RamSpan(address);
+		if (n > len)
+			n = len;
+		_putconBlock(_RamSysAddr(address), n);
+		address += n;
+		len -= n;
+	}
+}
+
+void _putconStr(uint16 address)	// Puts a '$' terminated string from the emulated RAM
+{
+	uint32 n, max;
+
+	do {
+		max = _RamSpan(address);
+		n = _dollarlen(_RamSysAddr(address), max);
+		_putconBlock(_RamSysAddr(address), n);
+		address += n;
+	} while (n == max);
+}
+
 void _puthex8(uint8 c)		// Puts a HH hex string
 {
 	_putcon(tohex(c >> 4));
@@ -67,7 +161,7 @@ void _putdec(uint16_t w) {
 
 
 #ifdef STREAMIO
-int _nextStreamInChar;
+MACHINE_LOCAL int _nextStreamInChar;
 
 void _getNextStreamInChar(void)
 {
@@ -106,6 +200,27 @@ void _streamioReset(void)
 
 
 
+#if (defined(SNAPSHOT) && SNAPKEY) || defined(TRACE)
+uint8 _getkey(void)		// Gets a key, writing the trace while waiting and saving a snapshot for each SNAPKEY typed
+{
+	uint8 ch;
+
+#ifdef TRACE
+	if (!_kbhit())
+		_traceDrain(TRUE);
+#endif
+#if defined(SNAPSHOT) && SNAPKEY
+	while ((ch = _getch()) == SNAPKEY)
+		_snapSave();
+#else
+	ch = _getch();
+#endif
+	return(ch);
+}
+#else
+#define _getkey _getch
+#endif
+
 uint8 _chready(void)		// Checks if there's a character ready for input
 {
 #ifdef STREAMIO
@@ -113,7 +228,12 @@ uint8 _chready(void)		// Checks if there's a character ready for input
 	// TODO: Consider adding/keeping _abort_if_kbd_eof() here.
 	_abort_if_kbd_eof();
 #endif
-	return(_kbhit() ? 0xff : 0x00);
+	if (_kbhit())
+		return(0xff);
+#ifdef TRACE
+	_traceDrain(FALSE);		// A program polling the console is idle too
+#endif
+	return(0x00);
 }
 
 uint8 _getcon(void)	   // Gets a character, blocking, no echo
@@ -123,7 +243,7 @@ uint8 _getcon(void)	   // Gets a character, blocking, no echo
 	// TODO: Consider adding/keeping _abort_if_kbd_eof() here.
 	_abort_if_kbd_eof();
 #endif
-	return _getch();
+	return _getkey();
 }
 
 /*
@@ -131,7 +251,7 @@ uint8 _getcon(void)	   // Gets a character, blocking, no echo
   so I moved the "_getche()" function from the "abstraction_arduino.h" file to the "console.h" file.
 */
 uint8 _getche(void) {
-	uint8 ch = _getch();
+	uint8 ch = _getkey();
 	_putch(ch);
 	return(ch);
 }
@@ -154,7 +274,16 @@ uint8 _getconNB(void)	  // Gets a character, non-blocking, no echo
 	// TODO: Consider adding/keeping _abort_if_kbd_eof() here.
 	_abort_if_kbd_eof();
 #endif
+#if defined(SNAPSHOT) && SNAPKEY
+	uint8 ch = _kbhit() ? _getch() : 0x00;
+
+	if (ch != SNAPKEY)
+		return(ch);
+	_snapSave();
+	return(0x00);
+#else
 	return(_kbhit() ? _getch() : 0x00);
+#endif
 }
 
 #endif
@@ -119,6 +119,11 @@ enum eBDOSFunc {
 	F_AWRITE = 224,
 	F_SETMASK = 230,
 	F_BDOSCALL = 231,
+	F_CONSTATS = 233,
+	F_CONINCNT = 234,
+	F_BDOSSTATS = 235,
+	F_TRACE = 236,
+	F_UPTIMEUS = 247,
 	F_UPTIME = 248,
 	F_MAKEDISK = 249,
 	F_HOSTOS = 250,
@@ -137,16 +142,16 @@ enum eBDOSFunc {
 
 /* set up full PUN and LST filenames to be on drive A: user 0 */
 #ifdef USE_PUN
-char pun_file[17] = {'A', FOLDERCHAR, '0', FOLDERCHAR, 'P', 'U', 'N', '.', 'T', 'X', 'T', 0};
+MACHINE_LOCAL char pun_file[17] = {'A', FOLDERCHAR, '0', FOLDERCHAR, 'P', 'U', 'N', '.', 'T', 'X', 'T', 0};
 #endif // ifdef USE_PUN
 
 #ifdef USE_LST
-char lst_file[17] = {'A', FOLDERCHAR, '0', FOLDERCHAR, 'L', 'S', 'T', '.', 'T', 'X', 'T', 0};
+MACHINE_LOCAL char lst_file[17] = {'A', FOLDERCHAR, '0', FOLDERCHAR, 'L', 'S', 'T', '.', 'T', 'X', 'T', 0};
 #endif // ifdef USE_LST
 
 #ifdef PROFILE
-unsigned long time_start = 0;
-unsigned long time_now = 0;
+MACHINE_LOCAL unsigned long time_start = 0;
+MACHINE_LOCAL unsigned long time_now = 0;
 #endif // ifdef PROFILE
 
 void _PatchBIOS(void) {
@@ -169,6 +174,8 @@ void _PatchBIOS(void) {
 void _PatchCPM(void) {
 	uint16 i;
 
+	_BdosInit();
+
 	// **********  Patch CP/M page zero into the memory  **********
 
 	/* BIOS entry point */
@@ -249,8 +256,13 @@ void _PatchCPM(void) {
 	_RamWrite(	i++,	HIGH_REGISTER(DPBaddr));
 	_RamWrite(	i++,	0);                     // Addr of the Directory Checksum Vector
 	_RamWrite(	i++,	0);
+#ifdef ALVaddr
+	_RamWrite(	i++,	LOW_REGISTER(ALVaddr)); // Addr of the Allocation Vector
+	_RamWrite(	i++,	HIGH_REGISTER(ALVaddr));
+#else
 	_RamWrite(	i++,	0);                     // Addr of the Allocation Vector
 	_RamWrite(	i++,	0);
+#endif
 
 	//
 
@@ -276,7 +288,7 @@ void _PatchCPM(void) {
 } // _PatchCPM
 
 #ifdef DEBUGLOG
-uint8 LogBuffer[128];
+MACHINE_LOCAL uint8 LogBuffer[128];
 
 void _logRegs(void) {
 	uint8 J, I;
@@ -537,6 +549,9 @@ void _Bios(void) {
 #ifdef DEBUGLOG
 	_logBiosIn(ch);
 #endif
+#ifdef TRACE
+	_traceRecord(TR_BIOSIN, ch, _RamRead16(SP), FALSE);
+#endif
 
 	switch (ch) {
 		case B_BOOT: {
@@ -643,8 +658,10 @@ void _Bios(void) {
 		case B_MOVE: {		// 25 - Move a block of memory
 			if (!isXmove)
 				srcBank = dstBank = curBank;
-			while (BC--)
-				RAM[HL++ * dstBank] = RAM[DE++ * srcBank];
+			_RamMove(dstBank, HL, srcBank, DE, BC);
+			HL = (HL + BC) & 0xffff;
+			DE = (DE + BC) & 0xffff;
+			BC = 0;
 			isXmove = FALSE;
 			break;
 		}
@@ -652,11 +669,16 @@ void _Bios(void) {
 			break;
 		}
 		case B_SELMEM: {	// 27 - Select memory bank
+#ifdef RAM_FAST
 			curBank = HIGH_REGISTER(AF);
+#else
+			_RamSelect(HIGH_REGISTER(AF));
+#endif
 			break;
 		}
 		case B_SETBNK: {	// 28 - Set the bank to be used for the next read/write sector operation
 			ioBank = HIGH_REGISTER(AF);
+			break;
 		}
 		case B_XMOVE: {		// 29 - Preload banks for MOVE
 			srcBank = LOW_REGISTER(BC);
@@ -682,1128 +704,1356 @@ void _Bios(void) {
 			break;
 		}
 	} // switch
+#ifdef TRACE
+	_traceRecord(TR_BIOSOUT, ch, _RamRead16(SP), FALSE);
+#endif
 #ifdef DEBUGLOG
 	_logBiosOut(ch);
 #endif
 } // _Bios
 
-void _Bdos(void) {
-	uint8 ch = LOW_REGISTER(BC);
-
-#ifdef DEBUGLOG
-	_logBdosIn(ch);
+/*
+	BDOS dispatch
+	Each BDOS function is a handler in _BdosTable, indexed by the function number in C.
+	The flags tell what kind of work the function does, for the statistics and the log.
+*/
+#define BD_CON		0x01	// Character I/O (console, list, punch, reader)
+#define BD_DISK		0x02	// Works on the host file system
+#define BD_SELECT	0x04	// Selects the drive in the FCB (or in E) before working
+#define BD_NOLOG	0x08	// Not written to the DEBUGLOG trace
+
+typedef struct {
+	void	(*fn)(void);
+	uint8	flags;
+} BDOSENTRY;
+
+static MACHINE_LOCAL BDOSENTRY _BdosTable[256];
+
+#ifdef BDOSSTATS
+static MACHINE_LOCAL uint32 _BdosCount[256];		// Number of calls to each function
+static MACHINE_LOCAL uint32 _BdosTime[256];		// Host microseconds spent in each function
 #endif
 
-	HL = 0x0000;                            // HL is reset by the BDOS
-	SET_LOW_REGISTER(BC, LOW_REGISTER(DE)); // C ends up equal to E
-
-	switch (ch) {
 #ifndef ABDOS
-		/*
-		   C = 0 : System reset
-		   Doesn't return. Reloads CP/M
-		 */
-		case P_TERMCPM: {
-			Status = 2; // Same as call to "BOOT"
-			break;
-		}
-
-		/*
-		   C = 1 : Console input
-		   Gets a char from the console
-		   Returns: A=Char
-		 */
-		case C_READ: {
-			HL = _getconE();
+/*
+   C = 0 : System reset
+   Doesn't return. Reloads CP/M
+ */
+static void _Bdos_P_TERMCPM(void) {
+	Status = 2; // Same as call to "BOOT"
+}
+
+/*
+   C = 1 : Console input
+   Gets a char from the console
+   Returns: A=Char
+ */
+static void _Bdos_C_READ(void) {
+	HL = _getconE();
 #ifdef DEBUG
-			if (HL == DEBUGKEY)
-				Debug = 1;
+	if (HL == DEBUGKEY)
+		Debug = 1;
 #endif // ifdef DEBUG
-			break;
-		}
-
-		/*
-		   C = 2 : Console output
-		   E = Char
-		   Sends the char in E to the console
-		 */
-		case C_WRITE: {
-			_putcon(LOW_REGISTER(DE));
-			break;
-		}
-
-		/*
-		   C = 3 : Auxiliary (Reader) input
-		   Returns: A=Char
-		 */
-		case A_READ: {
-			HL = 0x1a;
-			break;
-		}
-
-		/*
-		   C = 4 : Auxiliary (Punch) output
-		 */
-		case A_WRITE: {
+}
+
+/*
+   C = 2 : Console output
+   E = Char
+   Sends the char in E to the console
+ */
+static void _Bdos_C_WRITE(void) {
+	_putcon(LOW_REGISTER(DE));
+}
+
+/*
+   C = 3 : Auxiliary (Reader) input
+   Returns: A=Char
+ */
+static void _Bdos_A_READ(void) {
+	HL = 0x1a;
+}
+
+/*
+   C = 4 : Auxiliary (Punch) output
+ */
+static void _Bdos_A_WRITE(void) {
 #ifdef USE_PUN
-			if (!pun_open) {
-				pun_dev = _sys_fopen_w((uint8 *)pun_file);
-				pun_open = TRUE;
-			}
-			if (pun_dev) {
-				_sys_fputc(LOW_REGISTER(DE), pun_dev);
-			}
+	if (!pun_open) {
+		pun_dev = _sys_fopen_w((uint8 *)pun_file);
+		pun_open = TRUE;
+	}
+	if (pun_dev) {
+		_sys_fputc(LOW_REGISTER(DE), pun_dev);
+	}
 #endif // ifdef USE_PUN
-			break;
-		}
+}
 
-		/*
-		   C = 5 : Printer output
-		 */
-		case L_WRITE: {
+/*
+   C = 5 : Printer output
+ */
+static void _Bdos_L_WRITE(void) {
 #ifdef USE_LST
-			if (!lst_open) {
-				lst_dev = _sys_fopen_w((uint8 *)lst_file);
-				lst_open = TRUE;
-			}
-			if (lst_dev)
-				_sys_fputc(LOW_REGISTER(DE), lst_dev);
+	if (!lst_open) {
+		lst_dev = _sys_fopen_w((uint8 *)lst_file);
+		lst_open = TRUE;
+	}
+	if (lst_dev)
+		_sys_fputc(LOW_REGISTER(DE), lst_dev);
 #endif // ifdef USE_LST
-			break;
-		}
-
-		/*
-		   C = 6 : Direct console IO
-		   E = 0xFF : Checks for char available and returns it, or 0x00 if none (read)
-		   ToDo E = 0xFE : Return console input status. Zero if no character is waiting, nonzero otherwise. (CPM3)
-		   ToDo E = 0xFD : Wait until a character is ready, return it without echoing. (CPM3)		   
-		   E = char : Outputs char (write)
-		   Returns: A=Char or 0x00 (on read)
-		 */
-		case C_RAWIO: {
-			if (LOW_REGISTER(DE) == 0xff) {
-				HL = _getconNB();
+}
+
+/*
+   C = 6 : Direct console IO
+   E = 0xFF : Checks for char available and returns it, or 0x00 if none (read)
+   ToDo E = 0xFE : Return console input status. Zero if no character is waiting, nonzero otherwise. (CPM3)
+   ToDo E = 0xFD : Wait until a character is ready, return it without echoing. (CPM3)		   
+   E = char : Outputs char (write)
+   Returns: A=Char or 0x00 (on read)
+ */
+static void _Bdos_C_RAWIO(void) {
+	if (LOW_REGISTER(DE) == 0xff) {
+		HL = _getconNB();
 #ifdef DEBUG
-				if (HL == DEBUGKEY)
-					Debug = 1;
+		if (HL == DEBUGKEY)
+			Debug = 1;
 #endif // ifdef DEBUG
-			} else {
-				_putcon(LOW_REGISTER(DE));
-			}
-			break;
-		}
-
-		/*
-		   C = 7 : Get IOBYTE (CPM2)
-		   Gets the system IOBYTE
-		   Returns: A = IOBYTE (CPM2)
-		   ToDo REPLACE with
-		   C = 7 : Auxiliary Input status (CPM3)
-		   0FFh is returned if the Auxiliary Input device has a character ready; otherwise 0 is returned.
-		   Returns: A=0 or 0FFh (CPM3)
-		 */
-		case A_STATIN: {
-			HL = _RamRead(0x0003);
-			break;
-		}
-
-		/*
-		   C = 8 : Set IOBYTE (CPM2)
-		   E = IOBYTE
-		   Sets the system IOBYTE to E
-		   ToDo REPLACE with
-		   C = 8 : Auxiliary Output status (CPM3)
-		   0FFh is returned if the Auxiliary Output device is ready for characters; otherwise 0 is returned.
-		   Returns: A=0 or 0FFh (CPM3)
-		 */
-		case A_STATOUT: {
-			_RamWrite(0x0003, LOW_REGISTER(DE));
-			break;
-		}
-
-		/*
-		   C = 9 : Output string
-		   DE = Address of string
-		   Sends the $ terminated string pointed by (DE) to the screen
-		 */
-		case C_WRITESTR: {
-			while ((ch = _RamRead(DE++)) != '$')
-				_putcon(ch);
-			break;
-		}
+	} else {
+		_putcon(LOW_REGISTER(DE));
+	}
+}
+
+/*
+   C = 7 : Get IOBYTE (CPM2)
+   Gets the system IOBYTE
+   Returns: A = IOBYTE (CPM2)
+   ToDo REPLACE with
+   C = 7 : Auxiliary Input status (CPM3)
+   0FFh is returned if the Auxiliary Input device has a character ready; otherwise 0 is returned.
+   Returns: A=0 or 0FFh (CPM3)
+ */
+static void _Bdos_A_STATIN(void) {
+	HL = _RamRead(0x0003);
+}
+
+/*
+   C = 8 : Set IOBYTE (CPM2)
+   E = IOBYTE
+   Sets the system IOBYTE to E
+   ToDo REPLACE with
+   C = 8 : Auxiliary Output status (CPM3)
+   0FFh is returned if the Auxiliary Output device is ready for characters; otherwise 0 is returned.
+   Returns: A=0 or 0FFh (CPM3)
+ */
+static void _Bdos_A_STATOUT(void) {
+	_RamWrite(0x0003, LOW_REGISTER(DE));
+}
+
+/*
+   C = 9 : Output string
+   DE = Address of string
+   Sends the $ terminated string pointed by (DE) to the screen
+ */
+static void _Bdos_C_WRITESTR(void) {
+	_putconStr(DE);
+}
+
+/*
+   C = 10 (0Ah) : Buffered input
+   DE = Address of buffer
+   ToDo DE = 0 Use DMA address (CPM3) AND
+   DE=address:			DE=0:
+	buffer: DEFB    size        buffer: DEFB    size
+	        DEFB    ?                   DEFB    len
+	        	bytes           	    bytes
+   Reads (DE) bytes from the console
+   Returns: A = Number of chars read
+   DE) = First char
+ */
+static void _Bdos_C_READSTR(void) {
+	uint8 ch;
+	uint16 i;
+	uint8 j, chr;
+    uint16 chrsMaxIdx = WORD16(DE);                 //index to max number of characters
+    uint16 chrsCntIdx = (chrsMaxIdx + 1) & 0xFFFF;  //index to number of characters read
+    uint16 chrsIdx = (chrsCntIdx + 1) & 0xFFFF;     //index to characters
+    //printf("\n\r chrsMaxIdx: %0X, chrsCntIdx: %0X", chrsMaxIdx, chrsCntIdx);
 
-		/*
-		   C = 10 (0Ah) : Buffered input
-		   DE = Address of buffer
-		   ToDo DE = 0 Use DMA address (CPM3) AND
-		   DE=address:			DE=0:
-			buffer: DEFB    size        buffer: DEFB    size
-			        DEFB    ?                   DEFB    len
-			        	bytes           	    bytes
-		   Reads (DE) bytes from the console
-		   Returns: A = Number of chars read
-		   DE) = First char
-		 */
-		case C_READSTR: {
-			uint16 i;
-			uint8 j, chr;
-            uint16 chrsMaxIdx = WORD16(DE);                 //index to max number of characters
-            uint16 chrsCntIdx = (chrsMaxIdx + 1) & 0xFFFF;  //index to number of characters read
-            uint16 chrsIdx = (chrsCntIdx + 1) & 0xFFFF;     //index to characters
-            //printf("\n\r chrsMaxIdx: %0X, chrsCntIdx: %0X", chrsMaxIdx, chrsCntIdx);
-
-            static uint8 *last = 0;
-            if (!last)
-                last = (uint8*)calloc(1,256);    //allocate one (for now!)
+    static MACHINE_LOCAL uint8 *last = 0;
+    if (!last)
+        last = (uint8*)calloc(1,256);    //allocate one (for now!)
 
 #ifdef PROFILE
-			if (time_start != 0) {
-				time_now = millis();
-				printf(" (%ld)\n", time_now - time_start);
-				time_start = 0;
-			}
+	if (time_start != 0) {
+		time_now = millis();
+		printf(" (%ld)\n", time_now - time_start);
+		time_start = 0;
+	}
 #endif // ifdef PROFILE
-            uint8 chrsMax = _RamRead(chrsMaxIdx);   // Gets the max number of characters that can be read
-            uint8 chrsCnt = 0;                      // this is the number of characters read
-            uint8 curCol = 0;                       //this is the cursor column (relative to where it started)
+    uint8 chrsMax = _RamRead(chrsMaxIdx);   // Gets the max number of characters that can be read
+    uint8 chrsCnt = 0;                      // this is the number of characters read
+    uint8 curCol = 0;                       //this is the cursor column (relative to where it started)
 
-            while (chrsMax) {
-                // pre-backspace, retype & post backspace counts
-                uint8 preBS = 0, reType = 0, postBS = 0;
+    while (chrsMax) {
+        // pre-backspace, retype & post backspace counts
+        uint8 preBS = 0, reType = 0, postBS = 0;
 
-                chr = _getcon(); //input a character
+        chr = _getcon(); //input a character
 
-                if (chr == 1) {                             // ^A - Move cursor one character to the left
-                    if (curCol > 0) {
-                        preBS++;            //backspace one
-                    } else {
-                        _putcon('\007');    //ring the bell
-                    }
-                }
+        if (chr == 1) {                             // ^A - Move cursor one character to the left
+            if (curCol > 0) {
+                preBS++;            //backspace one
+            } else {
+                _putcon('\007');    //ring the bell
+            }
+        }
 
-                if (chr == 2) {                             // ^B - Toggle between beginning & end of line
-                    if (curCol) {
-                        preBS = curCol;             //move to beginning
-                    } else {
-                        reType = chrsCnt - curCol;  //move to EOL
-                    }
-                }
+        if (chr == 2) {                             // ^B - Toggle between beginning & end of line
+            if (curCol) {
+                preBS = curCol;             //move to beginning
+            } else {
+                reType = chrsCnt - curCol;  //move to EOL
+            }
+        }
 
-                if ((chr == 3) && (chrsCnt == 0)) {         // ^C - Abort string input
-                    _puts("^C");
-                    Status = 2;
-                    break;
-                }
+        if ((chr == 3) && (chrsCnt == 0)) {         // ^C - Abort string input
+            _puts("^C");
+            Status = 2;
+            break;
+        }
 
 #ifdef DEBUG
-                if (chr == DEBUGKEY) {                      // Enter debugger
-                    Debug = 1;
-					break;
-                }
+        if (chr == DEBUGKEY) {                      // Enter debugger
+            Debug = 1;
+			break;
+        }
 #endif // ifdef DEBUG
 
-                if (chr == 5) {                             // ^E - goto beginning of next line
-                    _putcon('\n');
-                    preBS = curCol;
-                    reType = postBS = chrsCnt;
-                }
-
-                if (chr == 6) {                             // ^F - Move the cursor one character forward
-                    if (curCol < chrsCnt) {
-                        reType++;
-                    } else {
-                        _putcon('\007');  //ring the bell
-                    }
-                }
-
-                if (chr == 7) {                             // ^G - Delete character at cursor
-                    if (curCol < chrsCnt) {
-                        //delete this character from buffer
-                        for (i = curCol, j = i + 1; j < chrsCnt; i++, j++) {
-                            ch = _RamRead(((chrsIdx + j) & 0xFFFF));
-                            _RamWrite((chrsIdx + i) & 0xFFFF, ch);
-                        }
-                        reType = postBS = chrsCnt - curCol;
-                        chrsCnt--;
-                    } else {
-                        _putcon('\007');  //ring the bell
-                    }
+        if (chr == 5) {                             // ^E - goto beginning of next line
+            _putcon('\n');
+            preBS = curCol;
+            reType = postBS = chrsCnt;
+        }
+
+        if (chr == 6) {                             // ^F - Move the cursor one character forward
+            if (curCol < chrsCnt) {
+                reType++;
+            } else {
+                _putcon('\007');  //ring the bell
+            }
+        }
+
+        if (chr == 7) {                             // ^G - Delete character at cursor
+            if (curCol < chrsCnt) {
+                //delete this character from buffer
+                for (i = curCol, j = i + 1; j < chrsCnt; i++, j++) {
+                    ch = _RamRead(((chrsIdx + j) & 0xFFFF));
+                    _RamWrite((chrsIdx + i) & 0xFFFF, ch);
                 }
-
-                if (((chr == 0x08) || (chr == 0x7F))) {     // ^H and DEL - Delete one character to left of cursor
-                    if (curCol > 0) {   //not at BOL
-                        if (curCol < chrsCnt) { //not at EOL
-                            //delete previous character from buffer
-                            for (i = curCol, j = i - 1; i < chrsCnt; i++, j++) {
-                                ch = _RamRead(((chrsIdx + i) & 0xFFFF));
-                                _RamWrite((chrsIdx + j) & 0xFFFF, ch);
-                            }
-                            preBS++;    //pre-backspace one
-                            //note: does one extra to erase EOL
-                            reType = postBS = chrsCnt - curCol + 1;
-                        } else {
-                            preBS = reType = postBS = 1;
-                        }
-                        chrsCnt--;
-                    } else {
-                        _putcon('\007');  //ring the bell
+                reType = postBS = chrsCnt - curCol;
+                chrsCnt--;
+            } else {
+                _putcon('\007');  //ring the bell
+            }
+        }
+
+        if (((chr == 0x08) || (chr == 0x7F))) {     // ^H and DEL - Delete one character to left of cursor
+            if (curCol > 0) {   //not at BOL
+                if (curCol < chrsCnt) { //not at EOL
+                    //delete previous character from buffer
+                    for (i = curCol, j = i - 1; i < chrsCnt; i++, j++) {
+                        ch = _RamRead(((chrsIdx + i) & 0xFFFF));
+                        _RamWrite((chrsIdx + j) & 0xFFFF, ch);
                     }
+                    preBS++;    //pre-backspace one
+                    //note: does one extra to erase EOL
+                    reType = postBS = chrsCnt - curCol + 1;
+                } else {
+                    preBS = reType = postBS = 1;
                 }
+                chrsCnt--;
+            } else {
+                _putcon('\007');  //ring the bell
+            }
+        }
 
-                if ((chr == 0x0A) || (chr == 0x0D)) {   // ^J and ^M - Ends editing
+        if ((chr == 0x0A) || (chr == 0x0D)) {   // ^J and ^M - Ends editing
 #ifdef PROFILE
-                    time_start = millis();
+            time_start = millis();
 #endif
-                    break;
-                }
-
-                if (chr == 0x0B) {                      // ^K - Delete to EOL from cursor
-                    if (curCol < chrsCnt) {
-                        reType = postBS = chrsCnt - curCol;
-                        chrsCnt = curCol;   //truncate buffer to here
-                    } else {
-                        _putcon('\007');  //ring the bell
-                    }
-                }
-
-                if (chr == 18) {                        // ^R - Retype the command line
-                    _puts("#\b\n");
-                    preBS = curCol;             //backspace to BOL
-                    reType = chrsCnt;           //retype everything
-                    postBS = chrsCnt - curCol;  //backspace to cursor column
-                }
-
-                if (chr == 21) {                        // ^U - delete all characters
-                    _puts("#\b\n");
-                    preBS = curCol; //backspace to BOL
-                    chrsCnt = 0;
-                }
-
-                if (chr == 23) {                        // ^W - recall last command
-                    if (!curCol) {      //if at beginning of command line
-                        uint8 lastCnt = last[0];
-                        if (lastCnt) {  //and there's a last command
-                            //restore last command
-                            for (j = 0; j <= lastCnt; j++) {
-                                _RamWrite((chrsCntIdx + j) & 0xFFFF, last[j]);
-                            }
-                            //retype to greater of chrsCnt & lastCnt
-                            reType = (chrsCnt > lastCnt) ? chrsCnt : lastCnt;
-                            chrsCnt = lastCnt;  //this is the restored length
-                            //backspace to end of restored command
-                            postBS = reType - chrsCnt;
-                        } else {
-                            _putcon('\007');  //ring the bell
-                        }
-                    } else if (curCol < chrsCnt) {  //if not at EOL
-                        reType = chrsCnt - curCol;  //move to EOL
-                    }
-                }
-
-                if (chr == 24) {                        // ^X - delete all character left of the cursor
-                    if (curCol > 0) {
-                        //move rest of line to beginning of line
-                        for (i = 0, j = curCol; j < chrsCnt;i++, j++) {
-                            ch = _RamRead(((chrsIdx + j) & 0xFFFF));
-                            _RamWrite((chrsIdx +i) & 0xFFFF, ch);
-                        }
-                        preBS = curCol;
-                        reType = chrsCnt;
-                        postBS = chrsCnt;
-                        chrsCnt -= curCol;
-                    } else {
-                        _putcon('\007');  //ring the bell
-                    }
-                }
-
-                if ((chr >= 0x20) && (chr <= 0x7E)) { //valid character
-                    if (curCol < chrsCnt) {
-                        //move rest of buffer one character right
-                        for (i = chrsCnt, j = i - 1; i > curCol; i--, j--) {
-                            ch = _RamRead(((chrsIdx + j) & 0xFFFF));
-                            _RamWrite((chrsIdx + i) & 0xFFFF, ch);
-                        }
-                    }
-                    //put the new character in the buffer
-                    _RamWrite((chrsIdx + curCol) & 0xffff, chr);
-
-                    chrsCnt++;
-                    reType = chrsCnt - curCol;
-                    postBS = reType - 1;
-                }
-
-                //pre-backspace
-                for (i = 0; i < preBS; i++) {
-                    _putcon('\b');
-                    curCol--;
-                }
-
-                //retype
-                for (i = 0; i < reType; i++) {
-                    if (curCol < chrsCnt) {
-                        ch = _RamRead(((chrsIdx + curCol) & 0xFFFF));
-                    } else {
-                        ch = ' ';
+            break;
+        }
+
+        if (chr == 0x0B) {                      // ^K - Delete to EOL from cursor
+            if (curCol < chrsCnt) {
+                reType = postBS = chrsCnt - curCol;
+                chrsCnt = curCol;   //truncate buffer to here
+            } else {
+                _putcon('\007');  //ring the bell
+            }
+        }
+
+        if (chr == 18) {                        // ^R - Retype the command line
+            _puts("#\b\n");
+            preBS = curCol;             //backspace to BOL
+            reType = chrsCnt;           //retype everything
+            postBS = chrsCnt - curCol;  //backspace to cursor column
+        }
+
+        if (chr == 21) {                        // ^U - delete all characters
+            _puts("#\b\n");
+            preBS = curCol; //backspace to BOL
+            chrsCnt = 0;
+        }
+
+        if (chr == 23) {                        // ^W - recall last command
+            if (!curCol) {      //if at beginning of command line
+                uint8 lastCnt = last[0];
+                if (lastCnt) {  //and there's a last command
+                    //restore last command
+                    for (j = 0; j <= lastCnt; j++) {
+                        _RamWrite((chrsCntIdx + j) & 0xFFFF, last[j]);
                     }
-                    _putcon(ch);
-                    curCol++;
+                    //retype to greater of chrsCnt & lastCnt
+                    reType = (chrsCnt > lastCnt) ? chrsCnt : lastCnt;
+                    chrsCnt = lastCnt;  //this is the restored length
+                    //backspace to end of restored command
+                    postBS = reType - chrsCnt;
+                } else {
+                    _putcon('\007');  //ring the bell
                 }
-
-                //post-backspace
-                for (i = 0; i < postBS; i++) {
-                    _putcon('\b');
-                    curCol--;
+            } else if (curCol < chrsCnt) {  //if not at EOL
+                reType = chrsCnt - curCol;  //move to EOL
+            }
+        }
+
+        if (chr == 24) {                        // ^X - delete all character left of the cursor
+            if (curCol > 0) {
+                //move rest of line to beginning of line
+                for (i = 0, j = curCol; j < chrsCnt;i++, j++) {
+                    ch = _RamRead(((chrsIdx + j) & 0xFFFF));
+                    _RamWrite((chrsIdx +i) & 0xFFFF, ch);
                 }
-
-                if (chrsCnt == chrsMax)   // Reached the maximum count
-                    break;
-            }   // while (chrsMax)
-
-            // Save the number of characters read
-            _RamWrite(chrsCntIdx, chrsCnt);
-
-            //if there are characters...
-            if (chrsCnt) {
-                //... then save this as last command
-                for (j = 0; j <= chrsCnt; j++) {
-                    last[j] = _RamRead((chrsCntIdx + j) & 0xFFFF);
+                preBS = curCol;
+                reType = chrsCnt;
+                postBS = chrsCnt;
+                chrsCnt -= curCol;
+            } else {
+                _putcon('\007');  //ring the bell
+            }
+        }
+
+        if ((chr >= 0x20) && (chr <= 0x7E)) { //valid character
+            if (curCol < chrsCnt) {
+                //move rest of buffer one character right
+                for (i = chrsCnt, j = i - 1; i > curCol; i--, j--) {
+                    ch = _RamRead(((chrsIdx + j) & 0xFFFF));
+                    _RamWrite((chrsIdx + i) & 0xFFFF, ch);
                 }
             }
-            _putcon('\r');          // Gives a visual feedback that read ended
-			break;
-		}
-
-		/*
-		   C = 11 (0Bh) : Get console status
-		   Returns: A=0x00 or 0xFF
-		 */
-		case C_STAT: {
-			HL = _chready();
-			break;
-		}
+            //put the new character in the buffer
+            _RamWrite((chrsIdx + curCol) & 0xffff, chr);
+
+            chrsCnt++;
+            reType = chrsCnt - curCol;
+            postBS = reType - 1;
+        }
+
+        //pre-backspace
+        for (i = 0; i < preBS; i++) {
+            _putcon('\b');
+            curCol--;
+        }
+
+        //retype
+        for (i = 0; i < reType; i++) {
+            if (curCol < chrsCnt) {
+                ch = _RamRead(((chrsIdx + curCol) & 0xFFFF));
+            } else {
+                ch = ' ';
+            }
+            _putcon(ch);
+            curCol++;
+        }
+
+        //post-backspace
+        for (i = 0; i < postBS; i++) {
+            _putcon('\b');
+            curCol--;
+        }
+
+        if (chrsCnt == chrsMax)   // Reached the maximum count
+            break;
+    }   // while (chrsMax)
+
+    // Save the number of characters read
+    _RamWrite(chrsCntIdx, chrsCnt);
+
+    //if there are characters...
+    if (chrsCnt) {
+        //... then save this as last command
+        for (j = 0; j <= chrsCnt; j++) {
+            last[j] = _RamRead((chrsCntIdx + j) & 0xFFFF);
+        }
+    }
+    _putcon('\r');          // Gives a visual feedback that read ended
+}
+
+/*
+   C = 11 (0Bh) : Get console status
+   Returns: A=0x00 or 0xFF
+ */
+static void _Bdos_C_STAT(void) {
+	HL = _chready();
+}
 #endif // ABDOS
 
-		/*
-		   C = 12 (0Ch) : Get version number
-		   Returns: B=H=system type, A=L=version number
-		 */
-		case S_BDOSVER: {
-			HL = 0x22;
-			break;
-		}
-
-		/*
-		   C = 13 (0Dh) : Reset disk system
-		 */
-		case DRV_ALLRESET: {
-			roVector = 0;       // Make all drives R/W
-			loginVector = 0;
-			dmaAddr = 0x0080;
-			cDrive = 0;         // userCode remains unchanged
-			HL = _CheckSUB();   // Checks if there's a $$$.SUB on the boot disk
-			break;
-		}
-
-		/*
-		   C = 14 (0Eh) : Select Disk
-		   Returns: A=0x00 or 0xFF
-		 */
-		case DRV_SET: {
-			oDrive = cDrive;
-			cDrive = LOW_REGISTER(DE);
-			HL = _SelectDisk(LOW_REGISTER(DE) + 1); // +1 here is to allow SelectDisk to be used directly by disk.h as well
-			if (!HL) {
-				oDrive = cDrive;
-			} else {
-				if ((_RamRead(DSKByte) & 0x0f) == cDrive) {
-					cDrive = oDrive = 0;
-					_RamWrite(DSKByte, _RamRead(DSKByte) & 0xf0);
-				} else {
-					cDrive = oDrive;
-				}
-			}
-			break;
-		}
-
-		/*
-		   C = 15 (0Fh) : Open file
-		   Returns: A=0x00 or 0xFF
-		 */
-		case F_OPEN: {
-			HL = _OpenFile(DE);
-			break;
-		}
-
-		/*
-		   C = 16 (10h) : Close file
-		 */
-		case F_CLOSE: {
-			HL = _CloseFile(DE);
-			break;
-		}
-
-		/*
-		   C = 17 (11h) : Search for first
-		 */
-		case F_SFIRST: {
-			HL = _SearchFirst(DE, TRUE);    // TRUE = Creates a fake dir entry when finding the file
-			break;
-		}
-
-		/*
-		   C = 18 (12h) : Search for next
-		 */
-		case F_SNEXT: {
-			HL = _SearchNext(DE, TRUE); // TRUE = Creates a fake dir entry when finding the file
-			break;
-		}
-
-		/*
-		   C = 19 (13h) : Delete file
-		 */
-		case F_DELETE: {
-			HL = _DeleteFile(DE);
-			break;
-		}
-
-		/*
-		   C = 20 (14h) : Read sequential
-		   DE = address of FCB
-		   ToDo under CP/M 3 this can be a multiple of 128 bytes
-		   Returns: A = return code
-		 */
-		case F_READ: {
-			HL = _ReadSeq(DE);
-			break;
-		}
-
-		/*
-		   C = 21 (15h) : Write sequential
-		   DE = address of FCB
-		   ToDo under CP/M 3 this can be a multiple of 128 bytes
-		   Returns: A=return code
-		   */
-		case F_WRITE: {
-			HL = _WriteSeq(DE);
-			break;
-		}
-
-		/*
-		   C = 22 (16h) : Make file
-		 */
-		case F_MAKE: {
-			HL = _MakeFile(DE);
-			break;
-		}
-
-		/*
-		   C = 23 (17h) : Rename file
-		 */
-		case F_RENAME: {
-			HL = _RenameFile(DE);
-			break;
-		}
-
-		/*
-		   C = 24 (18h) : Return log-in vector (active drive map)
-		 */
-		case DRV_LOGINVEC: {
-			HL = loginVector;   // (todo) improve this
-			break;
-		}
-
-		/*
-		   C = 25 (19h) : Return current disk
-		 */
-		case DRV_GET: {
-			HL = cDrive;
-			break;
-		}
-
-		/*
-		   C = 26 (1Ah) : Set DMA address
-		 */
-		case F_DMAOFF: {
-			dmaAddr = DE;
-			break;
-		}
-
-		/*
-		   C = 27 (1Bh) : Get ADDR(Alloc)
-		 */
-		case DRV_ALLOCVEC: {
-			HL = SCBaddr;
-			break;
-		}
-
-		/*
-		   C = 28 (1Ch) : Write protect current disk
-		 */
-		case DRV_SETRO: {
-			roVector = roVector | (1 << cDrive);
-			break;
-		}
-
-		/*
-		   C = 29 (1Dh) : Get R/O vector
-		 */
-		case DRV_ROVEC: {
-			HL = roVector;
-			break;
-		}
-
-		/*
-		   C = 30 (1Eh) : Set file attributes (does nothing)
-		 */
-		case F_ATTRIB: {
-			HL = 0;
-			break;
-		}
-
-		/*
-		   C = 31 (1Fh) : Get ADDR(Disk Parms)
-		 */
-		case DRV_PDB: {
-			HL = DPBaddr;
-			break;
-		}
-
-		/*
-		   C = 32 (20h) : Get/Set user code
-		 */
-		case F_USERNUM: {
-			if (LOW_REGISTER(DE) == 0xFF) {
-				HL = userCode;
-			} else {
-				_SetUser(DE);
-			}
-			break;
-		}
-
-		/*
-		   C = 33 (21h) : Read random
-		   ToDo under CPM3, if A returns 0xFF, H returns hardware error 
-		 */
-		case F_READRAND: {
-			HL = _ReadRand(DE);
-			break;
-		}
-
-		/*
-		   C = 34 (22h) : Write random
-		   ToDo under CPM3, if A returns 0xFF, H returns hardware error 
-		   */
-		case F_WRITERAND: {
-			HL = _WriteRand(DE);
-			break;
-		}
-
-		/*
-		   C = 35 (23h) : Compute file size
-		 */
-		case F_SIZE: {
-			HL = _GetFileSize(DE);
-			break;
-		}
-
-		/*
-		   C = 36 (24h) : Set random record
-		 */
-		case F_RANDREC: {
-			HL = _SetRandom(DE);
-			break;
-		}
-
-		/*
-		   C = 37 (25h) : Reset drive
-		 */
-		case DRV_RESET: {
-			roVector = roVector & ~DE;
-			break;
-		}
-
-		/* ********* Function 38: Not supported by CP/M 2.2 *********
-		  ********* Function 39: Not supported by CP/M 2.2 *********
-		  ********* (todo) Function 40: Write random with zero fill *********
-		 */
-		
-		/*
-		  ToDo C = 38 (26h) : Access drives (CPM3)
-		    This is an MP/M function that is not supported under CP/M 3. If called, the file
-		     system returns a zero In register A indicating that the access request is successful.
-		 */		
-		case DRV_ACCESS_MPM: {
-			HL = 0x0000;
-			break;
-		}			
-
-		/*
-		  ToDo C = 39 (27h) : Free drives (CPM3)
-		    This is an MP/M function that is not supported under CP/M 3. If called, the file
-		     system returns a zero In register A indicating that the access request is successful.
-		 */		
-		case DRV_FREE_MPM: {
-			HL = 0x0000;
-			break;
-		}			
-
-		/*
-		   C = 40 (28h) : Write random with zero fill (we have no disk blocks, so just write random)
-		   DE = address of FCB
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case F_WRITEZF: {
-			HL = _WriteRand(DE);
-			break;
-		}
-
-		/* 
-		   ToDo: C = 41 (29h) : Test and Write Record (CPM3)
-		   DE = address of FCB
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case F_TESTWRITE: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 42 (2Ah) : Lock Record (CPM3)
-		   DE = address of FCB
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case F_LOCKFILE: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 43 (2Bh) : Unlock Record (CPM3)
-		   DE = address of FCB
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case F_UNLOCKFILE: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 44 (2Ch) : Set number of records to read/write at once (CPM3)
-		   E = Number of Sectors
-		   Returns: A = return code (Returns A=0 if E was valid, 0FFh otherwise)
-		 */
-		case F_MULTISEC: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 45 (2Dh) : Set BDOS Error Mode (CPM3)
-		   E = BDOS Error Mode
-		   E < 254 Compatibility mode; program is terminated and an error message printed.
-		   E = 254 Error code is returned in H, error message is printed.
-		   E = 255 Error code is returned in H, no error message is printed.
-		   Returns: None
-		 */
-		case F_ERRMODE: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 46 (2Eh) : Get Free Disk Space (CPM3)
-		   E = Drive
-		   Returns: A = return code
-		   	    H = Physical Error
-			    Binary result in the first 3 bytes of current DMA buffer
-		 */
-		case DRV_SPACE: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 47 (2Fh) : Chain to program (CPM3)
-		   E = Chain flag
-		   Returns: None
-		 */
-		case P_CHAIN: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 48 (30h) : Flush Buffers (CPM3)
-		   E = Purge flag
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case DRV_FLUSH: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 49 (31h) : Get/Set System Control (CPM3)
-		   DE = SCB PB Address
-		   Returns: A = Returned Byte
-		   	    HL = Returned Word
-		 */
-		case S_SCB: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 50 (32h) : Direct BIOS Calls (CPM3)
-		   DE = BIOS PB Address
-		   Returns:  BIOS Return
-		 */
-		case S_BIOS: {
-			break;
-		}
-
-		/* 
-		   ToDo: C = 59 (3Bh) : Load Overlay (CPM3)
-		   DE = address of FCB
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case P_LOAD: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 60 (3Ch) : Call Resident System Extension (RSX) (CPM3)
-		   DE =  RSX PB Address
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case S_RSX: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 98 (62h) : Free Blocks (CPM3)
-		   Returns: A = return code
-		   	    H = Physical Error
-		 */
-		case F_CLEANUP: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 99 (63h) : Truncate File (CPM3)
-		   DE = address of FCB
-		   Returns: A = Directory code
-		   	    H = Extended or Physical Error
-		 */
-		case F_TRUNCATE: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 100 (64h) : Set Directory Label (CPM3)
-		   DE = address of FCB
-		   Returns: A = Directory code
-		   	    H = Extended or Physical Error
-		 */
-		case DRV_SETLABEL: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 101 (65h) : Return Directory Label Data (CPM3)
-		   E = Drive
-		   Returns: A = Directory Label Data Byte or 0xFF
-		   	    H = Physical Error
-		 */
-		case DRV_GETLABEL: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 102 (66h) : Read File Date Stamps and Password Mode (CPM3)
-		   DE = address of FCB
-		   Returns: A = Directory code
-		   	    H = Physical Error
-		 */
-		case F_TIMEDATE: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 103 (67h) : Write File XFCB (CPM3)
-		   DE = address of FCB
-		   Returns: A = Directory code
-		   	    H = Physical Error
-		 */
-		case F_WRITEXFCB: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 104 (68h) : Set Date and Time (CPM3)
-		   DE = Date and Time (DAT) Address
-		   Returns: None
-		 */
-		case T_SET: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 105 (69h) : Get Date and Time (CPM3)
-		   DE = Date and Time (DAT) Address
-		   Returns: Date and Time (DAT) set
-		   	    A = Seconds (in packed BCD format)
-		 */
-		case T_GET: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 106 (6Ah) : Set Default Password (CPM3)
-		   DE = Password Address
-		   Returns: None
-		 */
-		case F_PASSWD: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 107 (6Bh) : Return Serial Number (CPM3)
-		   DE = Serial Number Field
-		   Returns: Serial number field set
-		 */
-		case S_SERIAL: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 108 (6Ch) : Get/Set Program Return Code (CPM3)
-		   DE =  0xFFFF (Get) or Program Return Code (Set)
-		   Returns: HL = Program Return Code or (none)
-		 */
-		case P_CODE: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 109 (6Dh) : Get/Set Console Mode (CPM3)
-		   DE =  0xFFFF (Get) or Console Mode (Set)
-		   Returns: HL = Console Mode or (none)
-		 */
-		case C_MODE: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 110 (6Eh) : Get/Set Output Delimiter (CPM3)
-		   DE =  0xFFFF (Get) or E = Delimiter (Set)
-		   Returns: A = Output Delimiter or (none)
-		 */
-		case C_DELIMIT: {
-			break;
-		}
-
-
-		/* 
-		   ToDo: C = 111 (6Fh) : Print Block (CPM3)
-		   DE =  address of CCB
-		   Returns: None
-		 */
-		case C_WRITEBLK: {
-			break;
+/*
+   C = 12 (0Ch) : Get version number
+   Returns: B=H=system type, A=L=version number
+ */
+static void _Bdos_S_BDOSVER(void) {
+	HL = 0x22;
+}
+
+/*
+   C = 13 (0Dh) : Reset disk system
+ */
+static void _Bdos_DRV_ALLRESET(void) {
+	roVector = 0;       // Make all drives R/W
+	loginVector = 0;
+	dmaAddr = 0x0080;
+	cDrive = 0;         // userCode remains unchanged
+	HL = _CheckSUB();   // Checks if there's a $$$.SUB on the boot disk
+}
+
+/*
+   C = 14 (0Eh) : Select Disk
+   Returns: A=0x00 or 0xFF
+ */
+static void _Bdos_DRV_SET(void) {
+	oDrive = cDrive;
+	cDrive = LOW_REGISTER(DE);
+	HL = _SelectDisk(LOW_REGISTER(DE) + 1); // +1 here is to allow SelectDisk to be used directly by disk.h as well
+	if (!HL) {
+		oDrive = cDrive;
+	} else {
+		if ((_RamRead(DSKByte) & 0x0f) == cDrive) {
+			cDrive = oDrive = 0;
+			_RamWrite(DSKByte, _RamRead(DSKByte) & 0xf0);
+		} else {
+			cDrive = oDrive;
 		}
-
-
-		/* 
-		   ToDo: C = 112 (70h) : List Block (CPM3)
-		   DE =  address of CCB
-		   Returns: None
-		 */
-		case L_WRITEBLK: {
-			break;
+	}
+}
+
+/*
+   C = 15 (0Fh) : Open file
+   Returns: A=0x00 or 0xFF
+ */
+static void _Bdos_F_OPEN(void) {
+	HL = _OpenFile(DE);
+}
+
+/*
+   C = 16 (10h) : Close file
+ */
+static void _Bdos_F_CLOSE(void) {
+	HL = _CloseFile(DE);
+}
+
+/*
+   C = 17 (11h) : Search for first
+ */
+static void _Bdos_F_SFIRST(void) {
+	HL = _SearchFirst(DE, TRUE);    // TRUE = Creates a fake dir entry when finding the file
+}
+
+/*
+   C = 18 (12h) : Search for next
+ */
+static void _Bdos_F_SNEXT(void) {
+	HL = _SearchNext(DE, TRUE); // TRUE = Creates a fake dir entry when finding the file
+}
+
+/*
+   C = 19 (13h) : Delete file
+ */
+static void _Bdos_F_DELETE(void) {
+	HL = _DeleteFile(DE);
+}
+
+/*
+   C = 20 (14h) : Read sequential
+   DE = address of FCB
+   ToDo under CP/M 3 this can be a multiple of 128 bytes
+   Returns: A = return code
+ */
+static void _Bdos_F_READ(void) {
+	HL = _ReadSeq(DE);
+}
+
+/*
+   C = 21 (15h) : Write sequential
+   DE = address of FCB
+   ToDo under CP/M 3 this can be a multiple of 128 bytes
+   Returns: A=return code
+   */
+static void _Bdos_F_WRITE(void) {
+	HL = _WriteSeq(DE);
+}
+
+/*
+   C = 22 (16h) : Make file
+ */
+static void _Bdos_F_MAKE(void) {
+	HL = _MakeFile(DE);
+}
+
+/*
+   C = 23 (17h) : Rename file
+ */
+static void _Bdos_F_RENAME(void) {
+	HL = _RenameFile(DE);
+}
+
+/*
+   C = 24 (18h) : Return log-in vector (active drive map)
+ */
+static void _Bdos_DRV_LOGINVEC(void) {
+	HL = loginVector;   // (todo) improve this
+}
+
+/*
+   C = 25 (19h) : Return current disk
+ */
+static void _Bdos_DRV_GET(void) {
+	HL = cDrive;
+}
+
+/*
+   C = 26 (1Ah) : Set DMA address
+ */
+static void _Bdos_F_DMAOFF(void) {
+	dmaAddr = DE;
+}
+
+/*
+   C = 27 (1Bh) : Get ADDR(Alloc)
+ */
+static void _Bdos_DRV_ALLOCVEC(void) {
+#ifdef ALVaddr
+	_AllocVector(cDrive);
+	HL = ALVaddr;
+#else
+	HL = SCBaddr;
+#endif
+}
+
+/*
+   C = 28 (1Ch) : Write protect current disk
+ */
+static void _Bdos_DRV_SETRO(void) {
+	roVector = roVector | (1 << cDrive);
+}
+
+/*
+   C = 29 (1Dh) : Get R/O vector
+ */
+static void _Bdos_DRV_ROVEC(void) {
+	HL = roVector;
+}
+
+/*
+   C = 30 (1Eh) : Set file attributes (does nothing)
+ */
+static void _Bdos_F_ATTRIB(void) {
+	HL = 0;
+}
+
+/*
+   C = 31 (1Fh) : Get ADDR(Disk Parms)
+ */
+static void _Bdos_DRV_PDB(void) {
+	HL = DPBaddr;
+}
+
+/*
+   C = 32 (20h) : Get/Set user code
+ */
+static void _Bdos_F_USERNUM(void) {
+	if (LOW_REGISTER(DE) == 0xFF) {
+		HL = userCode;
+	} else {
+		_SetUser(DE);
+	}
+}
+
+/*
+   C = 33 (21h) : Read random
+   ToDo under CPM3, if A returns 0xFF, H returns hardware error 
+ */
+static void _Bdos_F_READRAND(void) {
+	HL = _ReadRand(DE);
+}
+
+/*
+   C = 34 (22h) : Write random
+   ToDo under CPM3, if A returns 0xFF, H returns hardware error 
+   */
+static void _Bdos_F_WRITERAND(void) {
+	HL = _WriteRand(DE);
+}
+
+/*
+   C = 35 (23h) : Compute file size
+ */
+static void _Bdos_F_SIZE(void) {
+	HL = _GetFileSize(DE);
+}
+
+/*
+   C = 36 (24h) : Set random record
+ */
+static void _Bdos_F_RANDREC(void) {
+	HL = _SetRandom(DE);
+}
+
+/*
+   C = 37 (25h) : Reset drive
+ */
+static void _Bdos_DRV_RESET(void) {
+	roVector = roVector & ~DE;
+}
+
+/* ********* Function 38: Not supported by CP/M 2.2 *********
+  ********* Function 39: Not supported by CP/M 2.2 *********
+  ********* (todo) Function 40: Write random with zero fill *********
+ */
+
+/*
+  ToDo C = 38 (26h) : Access drives (CPM3)
+    This is an MP/M function that is not supported under CP/M 3. If called, the file
+     system returns a zero In register A indicating that the access request is successful.
+ */		
+static void _Bdos_DRV_ACCESS_MPM(void) {
+	HL = 0x0000;
+}
+
+/*
+  ToDo C = 39 (27h) : Free drives (CPM3)
+    This is an MP/M function that is not supported under CP/M 3. If called, the file
+     system returns a zero In register A indicating that the access request is successful.
+ */		
+static void _Bdos_DRV_FREE_MPM(void) {
+	HL = 0x0000;
+}
+
+/*
+   C = 40 (28h) : Write random with zero fill (we have no disk blocks, so just write random)
+   DE = address of FCB
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_F_WRITEZF(void) {
+	HL = _WriteRand(DE);
+}
+
+/* 
+   ToDo: C = 41 (29h) : Test and Write Record (CPM3)
+   DE = address of FCB
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_F_TESTWRITE(void) {
+}
+
+/* 
+   ToDo: C = 42 (2Ah) : Lock Record (CPM3)
+   DE = address of FCB
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_F_LOCKFILE(void) {
+}
+
+/* 
+   ToDo: C = 43 (2Bh) : Unlock Record (CPM3)
+   DE = address of FCB
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_F_UNLOCKFILE(void) {
+}
+
+/* 
+   ToDo: C = 44 (2Ch) : Set number of records to read/write at once (CPM3)
+   E = Number of Sectors
+   Returns: A = return code (Returns A=0 if E was valid, 0FFh otherwise)
+ */
+static void _Bdos_F_MULTISEC(void) {
+}
+
+/* 
+   ToDo: C = 45 (2Dh) : Set BDOS Error Mode (CPM3)
+   E = BDOS Error Mode
+   E < 254 Compatibility mode; program is terminated and an error message printed.
+   E = 254 Error code is returned in H, error message is printed.
+   E = 255 Error code is returned in H, no error message is printed.
+   Returns: None
+ */
+static void _Bdos_F_ERRMODE(void) {
+}
+
+/* 
+   C = 46 (2Eh) : Get Free Disk Space (CPM3)
+   E = Drive
+   Returns: A = return code
+   	    H = Physical Error
+	    Binary result in the first 3 bytes of current DMA buffer
+ */
+static void _Bdos_DRV_SPACE(void) {
+	uint8 disk[2] = { 'A', 0 };
+	uint32 records;
+
+	disk[0] += LOW_REGISTER(DE) & 0x0f;
+	if (_sys_select(&disk[0])) {
+		records = (uint32)_DriveFree(LOW_REGISTER(DE) & 0x0f) << blockShift;
+		_RamWrite(dmaAddr, records & 0xff);
+		_RamWrite(dmaAddr + 1, (records >> 8) & 0xff);
+		_RamWrite(dmaAddr + 2, (records >> 16) & 0xff);
+		HL = 0x0000;
+	} else {
+		HL = 0x04ff;	// Select error
+	}
+}
+
+/* 
+   ToDo: C = 47 (2Fh) : Chain to program (CPM3)
+   E = Chain flag
+   Returns: None
+ */
+static void _Bdos_P_CHAIN(void) {
+}
+
+/* 
+   ToDo: C = 48 (30h) : Flush Buffers (CPM3)
+   E = Purge flag
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_DRV_FLUSH(void) {
+}
+
+/* 
+   C = 49 (31h) : Get/Set System Control (CPM3)
+   DE = SCB PB Address
+   Returns: A = Returned Byte
+   	    HL = Returned Word
+   Only the date and time fields (0x58-0x5C) are kept, they are read from the clock when asked for
+ */
+static void _Bdos_S_SCB(void) {
+	uint8 offset = _RamRead(DE);
+	uint8 set = _RamRead(DE + 1);
+	uint8 scb[6];
+
+	HL = 0;
+	if (offset >= SCB_DATE && offset <= SCB_SEC) {
+		_clockGet(scb);
+		scb[5] = 0;
+		offset -= SCB_DATE;
+		if (set == 0xFF) {				// Set byte
+			scb[offset] = _RamRead(DE + 2);
+			_clockPut(scb);
+		} else if (set == 0xFE) {		// Set word
+			scb[offset] = _RamRead(DE + 2);
+			if (offset < 4)
+				scb[offset + 1] = _RamRead(DE + 3);
+			_clockPut(scb);
+		} else {
+			HL = scb[offset] | (scb[offset + 1] << 8);
 		}
+	}
+}
+
+/* 
+   ToDo: C = 50 (32h) : Direct BIOS Calls (CPM3)
+   DE = BIOS PB Address
+   Returns:  BIOS Return
+ */
+static void _Bdos_S_BIOS(void) {
+}
+
+/* 
+   ToDo: C = 59 (3Bh) : Load Overlay (CPM3)
+   DE = address of FCB
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_P_LOAD(void) {
+}
+
+/* 
+   ToDo: C = 60 (3Ch) : Call Resident System Extension (RSX) (CPM3)
+   DE =  RSX PB Address
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_S_RSX(void) {
+}
+
+/* 
+   ToDo: C = 98 (62h) : Free Blocks (CPM3)
+   Returns: A = return code
+   	    H = Physical Error
+ */
+static void _Bdos_F_CLEANUP(void) {
+}
+
+/* 
+   ToDo: C = 99 (63h) : Truncate File (CPM3)
+   DE = address of FCB
+   Returns: A = Directory code
+   	    H = Extended or Physical Error
+ */
+static void _Bdos_F_TRUNCATE(void) {
+}
+
+/* 
+   ToDo: C = 100 (64h) : Set Directory Label (CPM3)
+   DE = address of FCB
+   Returns: A = Directory code
+   	    H = Extended or Physical Error
+ */
+static void _Bdos_DRV_SETLABEL(void) {
+}
+
+/* 
+   ToDo: C = 101 (65h) : Return Directory Label Data (CPM3)
+   E = Drive
+   Returns: A = Directory Label Data Byte or 0xFF
+   	    H = Physical Error
+ */
+static void _Bdos_DRV_GETLABEL(void) {
+}
+
+/* 
+   ToDo: C = 102 (66h) : Read File Date Stamps and Password Mode (CPM3)
+   DE = address of FCB
+   Returns: A = Directory code
+   	    H = Physical Error
+ */
+static void _Bdos_F_TIMEDATE(void) {
+}
+
+/* 
+   ToDo: C = 103 (67h) : Write File XFCB (CPM3)
+   DE = address of FCB
+   Returns: A = Directory code
+   	    H = Physical Error
+ */
+static void _Bdos_F_WRITEXFCB(void) {
+}
+
+/* 
+   C = 104 (68h) : Set Date and Time (CPM3)
+   DE = Date and Time (DAT) Address
+   Returns: None
+ */
+static void _Bdos_T_SET(void) {
+	uint8 dat[5];
+	uint8 i;
+
+	for (i = 0; i < 4; ++i)
+		dat[i] = _RamRead(DE + i);
+	dat[4] = 0;						// Seconds are cleared
+	_clockPut(dat);
+}
+
+/* 
+   C = 105 (69h) : Get Date and Time (CPM3)
+   DE = Date and Time (DAT) Address
+   Returns: Date and Time (DAT) set
+   	    A = Seconds (in packed BCD format)
+ */
+static void _Bdos_T_GET(void) {
+	uint8 dat[5];
+	uint8 i;
+
+	_clockGet(dat);
+	for (i = 0; i < 4; ++i)
+		_RamWrite(DE + i, dat[i]);
+	HL = dat[4];
+}
+
+/* 
+   ToDo: C = 106 (6Ah) : Set Default Password (CPM3)
+   DE = Password Address
+   Returns: None
+ */
+static void _Bdos_F_PASSWD(void) {
+}
+
+/* 
+   ToDo: C = 107 (6Bh) : Return Serial Number (CPM3)
+   DE = Serial Number Field
+   Returns: Serial number field set
+ */
+static void _Bdos_S_SERIAL(void) {
+}
+
+/* 
+   ToDo: C = 108 (6Ch) : Get/Set Program Return Code (CPM3)
+   DE =  0xFFFF (Get) or Program Return Code (Set)
+   Returns: HL = Program Return Code or (none)
+ */
+static void _Bdos_P_CODE(void) {
+}
+
+/* 
+   ToDo: C = 109 (6Dh) : Get/Set Console Mode (CPM3)
+   DE =  0xFFFF (Get) or Console Mode (Set)
+   Returns: HL = Console Mode or (none)
+ */
+static void _Bdos_C_MODE(void) {
+}
+
+/* 
+   ToDo: C = 110 (6Eh) : Get/Set Output Delimiter (CPM3)
+   DE =  0xFFFF (Get) or E = Delimiter (Set)
+   Returns: A = Output Delimiter or (none)
+ */
+static void _Bdos_C_DELIMIT(void) {
+}
+
+/* 
+   C = 111 (6Fh) : Print Block (CPM3)
+   DE =  address of CCB
+   Returns: None
+   CCB:	DEFW	address of the characters
+   	DEFW	number of characters
+ */
+static void _Bdos_C_WRITEBLK(void) {
+	_putconRam(_RamRead16(DE), _RamRead16(DE + 2));
+}
+
+/* 
+   C = 112 (70h) : List Block (CPM3)
+   DE =  address of CCB
+   Returns: None
+ */
+static void _Bdos_L_WRITEBLK(void) {
+#ifdef USE_LST
+	uint16 addr = _RamRead16(DE);
+	uint16 len = _RamRead16(DE + 2);
+	uint32 n;
 
+	if (!lst_open) {
+		lst_dev = _sys_fopen_w((uint8 *)lst_file);
+		lst_open = TRUE;
+	}
+	while (lst_dev && len) {
+		n = _RamSpan(addr);
+		if (n > len)
+			n = len;
+		_sys_fwrite(_RamSysAddr(addr), n, lst_dev);
+		addr += n;
+		len -= n;
+	}
+#endif // ifdef USE_LST
+}
 
-		/* 
-		   ToDo: C = 152 (98h) : List Block (CPM3)
-		   DE =  address of PFCB
-		   Returns: HL = Return code
-		   	    Parsed file control block
-		 */
-		case F_PARSE: {
-			break;
-		}
-
+/* 
+   ToDo: C = 152 (98h) : List Block (CPM3)
+   DE =  address of PFCB
+   Returns: HL = Return code
+   	    Parsed file control block
+ */
+static void _Bdos_F_PARSE(void) {
+}
 
 #if defined board_digital_io
 
-		/*
-		   C = 220 (DCh) : PinMode
-		 */
-		case F_PINMODE: {
-			pinMode(HIGH_REGISTER(DE), LOW_REGISTER(DE));
-			break;
-		}
-
-		/*
-		   C = 221 (DDh) : DigitalRead
-		 */
-		case F_DREAD: {
-			HL = digitalRead(HIGH_REGISTER(DE));
-			break;
-		}
-
-		/*
-		   C = 222 (DEh) : DigitalWrite
-		 */
-		case F_DWRITE: {
-			digitalWrite(HIGH_REGISTER(DE), LOW_REGISTER(DE));
-			break;
-		}
-
-		/*
-		   C = 223 (DFh) : AnalogRead
-		 */
-		case F_AREAD: {
-			HL = analogRead(HIGH_REGISTER(DE));
-			break;
-		}
+/*
+   C = 220 (DCh) : PinMode
+ */
+static void _Bdos_F_PINMODE(void) {
+	pinMode(HIGH_REGISTER(DE), LOW_REGISTER(DE));
+}
+
+/*
+   C = 221 (DDh) : DigitalRead
+ */
+static void _Bdos_F_DREAD(void) {
+	HL = digitalRead(HIGH_REGISTER(DE));
+}
+
+/*
+   C = 222 (DEh) : DigitalWrite
+ */
+static void _Bdos_F_DWRITE(void) {
+	digitalWrite(HIGH_REGISTER(DE), LOW_REGISTER(DE));
+}
+
+/*
+   C = 223 (DFh) : AnalogRead
+ */
+static void _Bdos_F_AREAD(void) {
+	HL = analogRead(HIGH_REGISTER(DE));
+}
 #endif // if defined board_digital_io
 #if defined board_analog_io
 
-		/*
-		   C = 224 (E0h) : AnalogWrite
-		 */
-		case F_AWRITE: {
-			analogWrite(HIGH_REGISTER(DE), LOW_REGISTER(DE));
-			break;
-		}
+/*
+   C = 224 (E0h) : AnalogWrite
+ */
+static void _Bdos_F_AWRITE(void) {
+	analogWrite(HIGH_REGISTER(DE), LOW_REGISTER(DE));
+}
 #endif // if defined board_analog_io
 
-		/*
-		   C = 230 (E6h) : Set 8 bit masking
-		 */
-		case F_SETMASK: {
-			mask8bit = LOW_REGISTER(DE);
-			break;
-		}
-
-		/*
-		   C = 231 (E7h) : Host specific BDOS call
-		 */
-		case F_BDOSCALL: {
-			HL = hostbdos(DE);
-			break;
-		}
-
-			/*
-			   C = 232 (E8h) : ESP32 specific BDOS call
-			 */
+/*
+   C = 230 (E6h) : Set 8 bit masking
+ */
+static void _Bdos_F_SETMASK(void) {
+	mask8bit = LOW_REGISTER(DE);
+}
+
+/*
+   C = 231 (E7h) : Host specific BDOS call
+   DE = address of the host services parameter block (see host.h)
+   Returns: A = status
+ */
+static void _Bdos_F_BDOSCALL(void) {
+	HL = hostbdos(DE);
+}
+
+/*
+   C = 232 (E8h) : ESP32 specific BDOS call
+ */
 #if defined board_esp32
-		case 232: {
-			HL = esp32bdos(DE);
-			break;
-		}
+static void _Bdos_232(void) {
+	HL = esp32bdos(DE);
+}
 
 #endif // if defined board_esp32
 #if defined board_stm32
-		case 232: {
-			HL = stm32bdos(DE);
-			break;
-		}
+static void _Bdos_232(void) {
+	HL = stm32bdos(DE);
+}
 
 #endif // if defined board_stm32
+#if defined board_constats
+
+/*
+   C = 233 (E9h) : Console statistics
+   DE = address of a 24 byte block, filled with 6 double words:
+   	bytes drawn, bytes drawn in the last second, display ticks,
+   	ticks over budget, microseconds blocked, bytes dropped
+ */
+static void _Bdos_F_CONSTATS(void) {
+	HL = _constats(DE);
+}
+#endif // if defined board_constats
+
+/*
+   C = 234 (EAh) : Console input count
+   Returns: HL = Number of characters waiting in the console input queue
+   (hosts without an input queue only return 0 or non zero)
+ */
+static void _Bdos_F_CONINCNT(void) {
+	HL = _kbhit();
+}
+
+/*
+   C = 247 (F7h) : Microseconds Uptime
+   Returns: HL = low word, DE = high word of the microseconds since the board started
+   (wraps around after about 71 minutes, meant for timing stretches of code)
+ */
+static void _Bdos_F_UPTIMEUS(void) {
+	uint32 us = REPLAYED(RP_MICROS, micros());
+
+	HL = us & 0xFFFF;
+	DE = (us >> 16) & 0xFFFF;
+}
+
+/*
+   C = 248 (F8h) : Milliseconds Uptime
+   Returns the number of milliseconds (since the board started).
+ */
+static void _Bdos_F_UPTIME(void) {
+	timer = REPLAYED(RP_MILLIS, millis());
+	HL = timer & 0xFFFF;
+	DE = (timer >> 16) & 0xFFFF;
+}
+
+/*
+   C = 249 (F9h) : MakeDisk
+   Makes a disk directory if not existent.
+ */
+static void _Bdos_F_MAKEDISK(void) {
+	HL = _MakeDisk(DE);
+}
+
+/*
+   C = 250 (FAh) : HostOS
+   Returns: A = 0x00 - Windows / 0x01 - Arduino / 0x02 - Posix / 0x03 - Dos / 0x04 - Teensy / 0x05 - ESP32 / 0x06 - STM32
+ */
+static void _Bdos_F_HOSTOS(void) {
+	HL = HostOS;
+}
+
+/*
+   C = 251 (FBh) : Version
+   Returns: A = 0xVv - Version in BCD representation: V.v
+ */
+static void _Bdos_F_VERSION(void) {
+	HL = VersionBCD;
+}
+
+/*
+   C = 252 (FCh) : CCP version
+   Returns: A = 0x00-0x04 = DRI|CCPZ|ZCPR2|ZCPR3|Z80CCP / 0xVv = Internal version in BCD: V.v
+ */
+static void _Bdos_F_CCPVERSION(void) {
+	HL = VersionCCP;
+}
+
+/*
+   C = 253 (FDh) : CCP address
+ */
+static void _Bdos_F_CCPADDR(void) {
+	HL = CCPaddr;
+}
+
+/*
+   C = 235 (EBh) : BDOS call statistics
+   DE = address of a 9 byte block, the first byte is the BDOS function number
+   	it is followed by the number of calls and the host microseconds spent (double words)
+   DE = 0 clears the statistics
+   Returns: A = 0x00 or 0xFF if the function is not implemented
+ */
+static void _Bdos_F_BDOSSTATS(void) {
+#ifdef BDOSSTATS
+	uint8 fn, i;
+
+	if (!DE) {
+		memset(_BdosCount, 0, sizeof(_BdosCount));
+		memset(_BdosTime, 0, sizeof(_BdosTime));
+		return;
+	}
+	fn = _RamRead(DE);
+	for (i = 0; i < 4; ++i) {
+		_RamWrite(DE + 1 + i, (_BdosCount[fn] >> (i * 8)) & 0xff);
+		_RamWrite(DE + 5 + i, (_BdosTime[fn] >> (i * 8)) & 0xff);
+	}
+	HL = _BdosTable[fn].fn ? 0x00 : 0xff;
+#else
+	HL = 0xff;
+#endif // ifdef BDOSSTATS
+}
 
-		/*
-		   C = 248 (F8h) : Milliseconds Uptime
-		   Returns the number of milliseconds (since the board started).
-		 */
-		case F_UPTIME:
-		{
-			timer = millis();
-			HL = timer & 0xFFFF;
-			DE = (timer >> 16) & 0xFFFF;
+/*
+   C = 236 (ECh) : Binary trace control
+   E = 0 : Writes the buffered trace records to the card
+   E = 1 : Stops tracing
+   E = 2 : Starts tracing
+   Returns: HL = Number of records lost so far (or 0xFFFF if there is no trace)
+ */
+static void _Bdos_F_TRACE(void) {
+#ifdef TRACE
+	switch (LOW_REGISTER(DE)) {
+		case 0: {
+			_traceFlush();
 			break;
 		}
-
-		/*
-		   C = 249 (F9h) : MakeDisk
-		   Makes a disk directory if not existent.
-		 */
-		case F_MAKEDISK: {
-			HL = _MakeDisk(DE);
+		case 1: {
+			traceOn = FALSE;
 			break;
 		}
-
-		/*
-		   C = 250 (FAh) : HostOS
-		   Returns: A = 0x00 - Windows / 0x01 - Arduino / 0x02 - Posix / 0x03 - Dos / 0x04 - Teensy / 0x05 - ESP32 / 0x06 - STM32
-		 */
-		case F_HOSTOS: {
-			HL = HostOS;
+		case 2: {
+			traceOn = TRUE;
 			break;
 		}
+	}
+	HL = traceLost;
+#else
+	HL = 0xffff;
+#endif // ifdef TRACE
+}
+
+void _BdosSet(uint8 ch, void (*fn)(void), uint8 flags) {
+	_BdosTable[ch].fn = fn;
+	_BdosTable[ch].flags = flags;
+}
+
+// Fills the BDOS dispatch table (called from _PatchCPM)
+void _BdosInit(void) {
+	memset(_BdosTable, 0, sizeof(_BdosTable));
+#ifndef ABDOS
+	_BdosSet(P_TERMCPM, _Bdos_P_TERMCPM, 0);
+	_BdosSet(C_READ, _Bdos_C_READ, BD_CON);
+	_BdosSet(C_WRITE, _Bdos_C_WRITE, BD_CON);
+	_BdosSet(A_READ, _Bdos_A_READ, BD_CON);
+	_BdosSet(A_WRITE, _Bdos_A_WRITE, BD_CON);
+	_BdosSet(L_WRITE, _Bdos_L_WRITE, BD_CON);
+	_BdosSet(C_RAWIO, _Bdos_C_RAWIO, BD_CON);
+	_BdosSet(A_STATIN, _Bdos_A_STATIN, 0);
+	_BdosSet(A_STATOUT, _Bdos_A_STATOUT, 0);
+	_BdosSet(C_WRITESTR, _Bdos_C_WRITESTR, BD_CON);
+	_BdosSet(C_READSTR, _Bdos_C_READSTR, BD_CON);
+	_BdosSet(C_STAT, _Bdos_C_STAT, BD_CON);
+#endif // ABDOS
+	_BdosSet(S_BDOSVER, _Bdos_S_BDOSVER, 0);
+	_BdosSet(DRV_ALLRESET, _Bdos_DRV_ALLRESET, BD_DISK);
+	_BdosSet(DRV_SET, _Bdos_DRV_SET, BD_DISK | BD_SELECT);
+	_BdosSet(F_OPEN, _Bdos_F_OPEN, BD_DISK | BD_SELECT);
+	_BdosSet(F_CLOSE, _Bdos_F_CLOSE, BD_DISK | BD_SELECT);
+	_BdosSet(F_SFIRST, _Bdos_F_SFIRST, BD_DISK | BD_SELECT);
+	_BdosSet(F_SNEXT, _Bdos_F_SNEXT, BD_DISK | BD_SELECT);
+	_BdosSet(F_DELETE, _Bdos_F_DELETE, BD_DISK | BD_SELECT);
+	_BdosSet(F_READ, _Bdos_F_READ, BD_DISK | BD_SELECT);
+	_BdosSet(F_WRITE, _Bdos_F_WRITE, BD_DISK | BD_SELECT);
+	_BdosSet(F_MAKE, _Bdos_F_MAKE, BD_DISK | BD_SELECT);
+	_BdosSet(F_RENAME, _Bdos_F_RENAME, BD_DISK | BD_SELECT);
+	_BdosSet(DRV_LOGINVEC, _Bdos_DRV_LOGINVEC, 0);
+	_BdosSet(DRV_GET, _Bdos_DRV_GET, 0);
+	_BdosSet(F_DMAOFF, _Bdos_F_DMAOFF, 0);
+	_BdosSet(DRV_ALLOCVEC, _Bdos_DRV_ALLOCVEC, BD_DISK);
+	_BdosSet(DRV_SETRO, _Bdos_DRV_SETRO, 0);
+	_BdosSet(DRV_ROVEC, _Bdos_DRV_ROVEC, 0);
+	_BdosSet(F_ATTRIB, _Bdos_F_ATTRIB, 0);
+	_BdosSet(DRV_PDB, _Bdos_DRV_PDB, 0);
+	_BdosSet(F_USERNUM, _Bdos_F_USERNUM, BD_DISK);
+	_BdosSet(F_READRAND, _Bdos_F_READRAND, BD_DISK | BD_SELECT);
+	_BdosSet(F_WRITERAND, _Bdos_F_WRITERAND, BD_DISK | BD_SELECT);
+	_BdosSet(F_SIZE, _Bdos_F_SIZE, BD_DISK | BD_SELECT);
+	_BdosSet(F_RANDREC, _Bdos_F_RANDREC, 0);
+	_BdosSet(DRV_RESET, _Bdos_DRV_RESET, 0);
+	_BdosSet(DRV_ACCESS_MPM, _Bdos_DRV_ACCESS_MPM, 0);
+	_BdosSet(DRV_FREE_MPM, _Bdos_DRV_FREE_MPM, 0);
+	_BdosSet(F_WRITEZF, _Bdos_F_WRITEZF, BD_DISK | BD_SELECT);
+	_BdosSet(F_TESTWRITE, _Bdos_F_TESTWRITE, 0);
+	_BdosSet(F_LOCKFILE, _Bdos_F_LOCKFILE, 0);
+	_BdosSet(F_UNLOCKFILE, _Bdos_F_UNLOCKFILE, 0);
+	_BdosSet(F_MULTISEC, _Bdos_F_MULTISEC, 0);
+	_BdosSet(F_ERRMODE, _Bdos_F_ERRMODE, 0);
+	_BdosSet(DRV_SPACE, _Bdos_DRV_SPACE, BD_DISK | BD_SELECT);
+	_BdosSet(P_CHAIN, _Bdos_P_CHAIN, 0);
+	_BdosSet(DRV_FLUSH, _Bdos_DRV_FLUSH, 0);
+	_BdosSet(S_SCB, _Bdos_S_SCB, 0);
+	_BdosSet(S_BIOS, _Bdos_S_BIOS, 0);
+	_BdosSet(P_LOAD, _Bdos_P_LOAD, 0);
+	_BdosSet(S_RSX, _Bdos_S_RSX, 0);
+	_BdosSet(F_CLEANUP, _Bdos_F_CLEANUP, 0);
+	_BdosSet(F_TRUNCATE, _Bdos_F_TRUNCATE, 0);
+	_BdosSet(DRV_SETLABEL, _Bdos_DRV_SETLABEL, 0);
+	_BdosSet(DRV_GETLABEL, _Bdos_DRV_GETLABEL, 0);
+	_BdosSet(F_TIMEDATE, _Bdos_F_TIMEDATE, 0);
+	_BdosSet(F_WRITEXFCB, _Bdos_F_WRITEXFCB, 0);
+	_BdosSet(T_SET, _Bdos_T_SET, 0);
+	_BdosSet(T_GET, _Bdos_T_GET, 0);
+	_BdosSet(F_PASSWD, _Bdos_F_PASSWD, 0);
+	_BdosSet(S_SERIAL, _Bdos_S_SERIAL, 0);
+	_BdosSet(P_CODE, _Bdos_P_CODE, 0);
+	_BdosSet(C_MODE, _Bdos_C_MODE, 0);
+	_BdosSet(C_DELIMIT, _Bdos_C_DELIMIT, 0);
+	_BdosSet(C_WRITEBLK, _Bdos_C_WRITEBLK, BD_CON);
+	_BdosSet(L_WRITEBLK, _Bdos_L_WRITEBLK, BD_CON);
+	_BdosSet(F_PARSE, _Bdos_F_PARSE, 0);
+#if defined board_digital_io
+	_BdosSet(F_PINMODE, _Bdos_F_PINMODE, 0);
+	_BdosSet(F_DREAD, _Bdos_F_DREAD, 0);
+	_BdosSet(F_DWRITE, _Bdos_F_DWRITE, 0);
+	_BdosSet(F_AREAD, _Bdos_F_AREAD, 0);
+#endif // if defined board_digital_io
+#if defined board_analog_io
+	_BdosSet(F_AWRITE, _Bdos_F_AWRITE, 0);
+#endif // if defined board_analog_io
+	_BdosSet(F_SETMASK, _Bdos_F_SETMASK, 0);
+	_BdosSet(F_BDOSCALL, _Bdos_F_BDOSCALL, 0);
+#if defined board_esp32
+	_BdosSet(232, _Bdos_232, 0);
+#endif // if defined board_esp32
+#if defined board_stm32
+	_BdosSet(232, _Bdos_232, 0);
+#endif // if defined board_stm32
+#if defined board_constats
+	_BdosSet(F_CONSTATS, _Bdos_F_CONSTATS, 0);
+#endif // if defined board_constats
+	_BdosSet(F_CONINCNT, _Bdos_F_CONINCNT, BD_CON);
+	_BdosSet(F_UPTIMEUS, _Bdos_F_UPTIMEUS, 0);
+	_BdosSet(F_UPTIME, _Bdos_F_UPTIME, 0);
+	_BdosSet(F_MAKEDISK, _Bdos_F_MAKEDISK, BD_DISK);
+	_BdosSet(F_HOSTOS, _Bdos_F_HOSTOS, 0);
+	_BdosSet(F_VERSION, _Bdos_F_VERSION, 0);
+	_BdosSet(F_CCPVERSION, _Bdos_F_CCPVERSION, 0);
+	_BdosSet(F_CCPADDR, _Bdos_F_CCPADDR, 0);
+	_BdosSet(F_BDOSSTATS, _Bdos_F_BDOSSTATS, 0);
+	_BdosSet(F_TRACE, _Bdos_F_TRACE, BD_NOLOG);
+}
 
-		/*
-		   C = 251 (FBh) : Version
-		   Returns: A = 0xVv - Version in BCD representation: V.v
-		 */
-		case F_VERSION: {
-			HL = VersionBCD;
-			break;
-		}
+void _Bdos(void) {
+	uint8 ch = LOW_REGISTER(BC);
+	BDOSENTRY* bd = &_BdosTable[ch];
+#if defined(BDOSSTATS) || defined(RUNSTATS)
+	uint32 start = micros();
+#endif
+#ifdef TRACE
+	uint8 isfcb = (bd->flags & BD_SELECT) && ch != DRV_SET && ch != DRV_SPACE;	// These two select the drive in E
+#endif
 
-		/*
-		   C = 252 (FCh) : CCP version
-		   Returns: A = 0x00-0x04 = DRI|CCPZ|ZCPR2|ZCPR3|Z80CCP / 0xVv = Internal version in BCD: V.v
-		 */
-		case F_CCPVERSION: {
-			HL = VersionCCP;
-			break;
-		}
+#ifdef DEBUGLOG
+	if (!(bd->flags & BD_NOLOG))
+		_logBdosIn(ch);
+#endif
+#ifdef TRACE
+	if (!(bd->flags & BD_NOLOG))
+		_traceRecord(TR_BDOSIN, ch, _RamRead16(SP) - 3, isfcb);
+#endif
 
-		/*
-		   C = 253 (FDh) : CCP address
-		 */
-		case F_CCPADDR: {
-			HL = CCPaddr;
-			break;
-		}
+	HL = 0x0000;                            // HL is reset by the BDOS
+	SET_LOW_REGISTER(BC, LOW_REGISTER(DE)); // C ends up equal to E
 
+	if (bd->fn) {
+		bd->fn();
+	} else {
 		/*
 		   Unimplemented calls get listed
 		 */
-		default: {
 #ifdef DEBUG    // Show unimplemented BDOS calls only when debugging
-			_puts("\r\nUnimplemented BDOS call.\r\n");
-			_puts("C = 0x");
-			_puthex8(ch);
-			_puts("\r\n");
+		_puts("\r\nUnimplemented BDOS call.\r\n");
+		_puts("C = 0x");
+		_puthex8(ch);
+		_puts("\r\n");
 #endif // ifdef DEBUG
-			break;
-		}
-	} // switch
+	}
 
 	// CP/M BDOS does this before returning
 	SET_HIGH_REGISTER(	BC, HIGH_REGISTER(HL));
 	SET_HIGH_REGISTER(	AF, LOW_REGISTER(HL));
 
+#ifdef BDOSSTATS
+	++_BdosCount[ch];
+	_BdosTime[ch] += micros() - start;
+#endif
+#ifdef RUNSTATS
+	if (bd->flags & BD_DISK) {
+		++runStats.diskCalls;
+		runStats.diskTime += micros() - start;
+	} else if (bd->flags & BD_CON) {
+		++runStats.conCalls;
+	} else {
+		++runStats.otherCalls;
+	}
+#endif
+
+#ifdef TRACE
+	if (!(bd->flags & BD_NOLOG))
+		_traceRecord(TR_BDOSOUT, ch, _RamRead16(SP) - 3, isfcb);
+#endif
 #ifdef DEBUGLOG
-	_logBdosOut(ch);
+	if (!(bd->flags & BD_NOLOG))
+		_logBdosOut(ch);
 #endif
 } // _Bdos
 
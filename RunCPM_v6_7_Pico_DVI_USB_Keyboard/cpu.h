@@ -3,25 +3,34 @@
 
 /* see main.c for definition */
 
-int32 PCX; /* external view of PC                          */
-int32 AF;  /* AF register                                  */
-int32 BC;  /* BC register                                  */
-int32 DE;  /* DE register                                  */
-int32 HL;  /* HL register                                  */
-int32 IX;  /* IX register                                  */
-int32 IY;  /* IY register                                  */
-int32 PC;  /* program counter                              */
-int32 SP;  /* SP register                                  */
-int32 AF1; /* alternate AF register                        */
-int32 BC1; /* alternate BC register                        */
-int32 DE1; /* alternate DE register                        */
-int32 HL1; /* alternate HL register                        */
-int32 IFF; /* Interrupt Flip Flop                          */
-int32 IR;  /* Interrupt (upper) / Refresh (lower) register */
-int32 Status = 0; /* Status of the CPU 0=running 1=end request 2=back to CCP */
-int32 Debug = 0;
-int32 Break = -1;
-int32 Step = -1;
+MACHINE_LOCAL int32 PCX; /* external view of PC                          */
+MACHINE_LOCAL int32 AF;  /* AF register                                  */
+MACHINE_LOCAL int32 BC;  /* BC register                                  */
+MACHINE_LOCAL int32 DE;  /* DE register                                  */
+MACHINE_LOCAL int32 HL;  /* HL register                                  */
+MACHINE_LOCAL int32 IX;  /* IX register                                  */
+MACHINE_LOCAL int32 IY;  /* IY register                                  */
+MACHINE_LOCAL int32 PC;  /* program counter                              */
+MACHINE_LOCAL int32 SP;  /* SP register                                  */
+MACHINE_LOCAL int32 AF1; /* alternate AF register                        */
+MACHINE_LOCAL int32 BC1; /* alternate BC register                        */
+MACHINE_LOCAL int32 DE1; /* alternate DE register                        */
+MACHINE_LOCAL int32 HL1; /* alternate HL register                        */
+MACHINE_LOCAL int32 IFF; /* Interrupt Flip Flop                          */
+MACHINE_LOCAL int32 IR;  /* Interrupt (upper) / Refresh (lower) register */
+MACHINE_LOCAL int32 Status = 0; /* Status of the CPU 0=running 1=end request 2=back to CCP */
+#ifdef SNAPSHOT
+MACHINE_LOCAL int32 snapTrap = 0; /* PC of the BDOS/BIOS trap being served, 0 outside */
+MACHINE_LOCAL int32 snapAF, snapBC, snapDE, snapHL; /* Registers on entry to it */
+#define SNAPENTER { snapTrap = PCX; snapAF = AF; snapBC = BC; snapDE = DE; snapHL = HL; }
+#define SNAPLEAVE snapTrap = 0
+#else
+#define SNAPENTER
+#define SNAPLEAVE
+#endif
+MACHINE_LOCAL int32 Debug = 0;
+MACHINE_LOCAL int32 Break = -1;
+MACHINE_LOCAL int32 Step = -1;
 
 #ifdef iDEBUG
 FILE* iLogFile;
@@ -41,7 +50,9 @@ const char* iLogTxt;
 */
 void cpu_out(const uint32 p, const uint32 v) {
 	if (p == 0xFF) {
+		SNAPENTER;
 		_Bios();
+		SNAPLEAVE;
 	} else {
 		_HardwareOut(p, v);
 	}
@@ -50,10 +61,12 @@ void cpu_out(const uint32 p, const uint32 v) {
 uint32 cpu_in(const uint32 p) {
 	uint32 v;
 	if (p == 0xFF) {
+		SNAPENTER;
 		_Bdos();
+		SNAPLEAVE;
 		v = HIGH_REGISTER(AF);
 	} else {
-		v = _HardwareIn(p);
+		v = REPLAYED(RP_PORT, _HardwareIn(p));
 	}
 	return(v);
 }
@@ -1183,7 +1196,7 @@ static const char* CPMCalls[41] =
 	"Get/Set User", "Read Random", "Write Random", "Get File Size", "Set Random Record", "Reset Drive", "N/A", "N/A", "Write Random 0 fill"
 };
 
-int32 Watch = -1;
+MACHINE_LOCAL int32 Watch = -1;
 #endif
 
 /* Memory management    */
@@ -1614,6 +1627,9 @@ static inline void Z80run(void) {
 
 		PCX = PC;
 		INCR(1); /* Add one M1 cycle to refresh counter */
+#ifdef RUNSTATS
+		++runStats.instructions;
+#endif
 
 #ifdef iDEBUG
 		iLogFile = fopen("iDump.log", "a");
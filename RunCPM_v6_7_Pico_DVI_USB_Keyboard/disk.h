@@ -64,10 +64,143 @@ int _SelectDisk(uint8 dr) {
 	return(result);
 }
 
+// Called whenever a file is created, renamed, truncated or deleted through the BDOS
+void _FileChanged(uint8* filename) {
+	uint8 i;
+
+#ifdef COMCACHE
+	_comcacheDrop(filename);
+#endif
+	for (i = 0; i < WRITESIZES; ++i)
+		if (!strcmp((char*)writeSize[i].name, (char*)filename))
+			writeSize[i].name[0] = 0;
+	allocValid &= ~(1 << (filename[0] - 'A'));
+	cardFreeValid = FALSE;
+}
+
+// Called before a record is written at fpos, counts the blocks it adds to the file into the cached usage
+// The size of the last few files written is tracked, so the file is only looked up on its first write
+void _FileWriting(uint8* filename, long fpos) {
+	uint8 drive = filename[0] - 'A';
+	uint32 blockBytes = (uint32)BlkSZ << blockShift;
+	uint32 grown;
+	long size = -1;
+	uint8 i;
+
+#ifdef COMCACHE
+	_comcacheDrop(filename);
+#endif
+	for (i = 0; i < WRITESIZES; ++i) {
+		if (!strcmp((char*)writeSize[i].name, (char*)filename)) {
+			size = writeSize[i].size;
+			break;
+		}
+	}
+	if (size < 0) {
+		if (!(allocValid & (1 << drive)) && !cardFreeValid)
+			return;						// Nothing to keep current
+		i = writeSizeNext++ % WRITESIZES;
+		strcpy((char*)writeSize[i].name, (char*)filename);
+		if ((size = _sys_filesize(filename)) < 0)
+			size = 0;
+	}
+	if (fpos + BlkSZ > size)
+		writeSize[i].size = fpos + BlkSZ;
+	if (!(allocValid & (1 << drive)) && !cardFreeValid)
+		return;
+	grown = (fpos + BlkSZ + blockBytes - 1) / blockBytes;
+	if (grown <= (size + blockBytes - 1) / blockBytes)
+		return;
+	grown -= (size + blockBytes - 1) / blockBytes;
+	if (allocValid & (1 << drive))
+		allocUsed[drive] = allocUsed[drive] + grown < numAllocBlocks ? allocUsed[drive] + grown : numAllocBlocks;
+	grown <<= blockShift - 3;	// In KB
+	cardFree = cardFree > grown ? cardFree - grown : 0;
+}
+
+// Free allocation blocks on a drive: what the fake DPB has left after its files, capped by the card
+uint16 _DriveFree(uint8 drive) {
+	uint32 used, free;
+
+	if (!(allocValid & (1 << drive))) {
+		used = _sys_driveblocks('A' + drive, (uint32)BlkSZ << blockShift);
+		allocUsed[drive] = used < numAllocBlocks ? used : numAllocBlocks;
+		allocValid |= 1 << drive;
+	}
+	if (!cardFreeValid) {
+		cardFree = REPLAYED(RP_FREE, _sys_cardfree());
+		cardFreeValid = TRUE;
+	}
+	used = firstBlockAfterDir + allocUsed[drive];
+	free = used < numAllocBlocks ? numAllocBlocks - used : 0;
+	if (free > cardFree >> (blockShift - 3))	// Blocks are 128 << blockShift bytes, 2^(blockShift-3) KB
+		free = cardFree >> (blockShift - 3);
+	return(free);
+}
+
+#ifdef ALVaddr
+// Fills the allocation vector of a drive, marking the directory and used blocks from the start
+void _AllocVector(uint8 drive) {
+	uint16 used = numAllocBlocks - _DriveFree(drive);
+	uint16 i;
+
+	for (i = 0; i < (numAllocBlocks + 7) / 8; ++i) {
+		if (used >= 8) {
+			_RamWrite(ALVaddr + i, 0xff);
+			used -= 8;
+		} else {
+			_RamWrite(ALVaddr + i, (uint8)(0xff00 >> used));
+			used = 0;
+		}
+	}
+}
+#endif
+
+/*
+	FCBs and directory entries are worked on through host pointers. With banked memory one can
+	run from a page into one that isn't next to it on the host (past the end of a BANKSTORE frame,
+	or into the common memory from another bank); it is then worked on in a copy, of which only
+	the bytes changed are written back, as a 33 byte FCB may be followed by the DMA buffer.
+*/
+typedef struct {
+	uint8	copy[36];
+	uint8	orig[36];
+} RAMBLOCK;
+
+static uint8* _RamBlock(uint16 address, uint8 len, RAMBLOCK* b) {
+#if BANKS > 1
+	uint8 i;
+
+	if (_RamSpan(address) < len) {
+		for (i = 0; i < len; ++i)
+			b->copy[i] = b->orig[i] = _RamRead(address + i);
+		return(b->copy);
+	}
+#endif
+	return(_RamSysAddr(address));
+}
+
+static void _RamBlockDone(uint16 address, uint8 len, uint8* p, RAMBLOCK* b) {
+#if BANKS > 1
+	uint8 i;
+
+	if (p == b->copy) {
+		for (i = 0; i < len; ++i) {
+			if (b->copy[i] != b->orig[i])
+				_RamWrite(address + i, b->copy[i]);
+		}
+	}
+#endif
+}
+
+#define _FCBGet(fcbaddr, b)		((CPM_FCB*)_RamBlock(fcbaddr, sizeof(CPM_FCB), b))
+#define _FCBDone(fcbaddr, F, b)	_RamBlockDone(fcbaddr, sizeof(CPM_FCB), (uint8*)(F), b)
+
 // Converts a FCB entry onto a host OS filename string
 uint8 _FCBtoHostname(uint16 fcbaddr, uint8* filename) {
 	uint8 addDot = TRUE;
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 i = 0;
 	uint8 unique = TRUE;
 	uint8 c;
@@ -128,7 +261,8 @@ uint8 _FCBtoHostname(uint16 fcbaddr, uint8* filename) {
 
 // Converts a host OS filename string onto a FCB entry
 void _HostnameToFCB(uint16 fcbaddr, uint8* filename) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 i = 0;
 
 	++filename;
@@ -159,6 +293,7 @@ void _HostnameToFCB(uint16 fcbaddr, uint8* filename) {
 		F->tp[i] = ' ';
 		++i;
 	}
+	_FCBDone(fcbaddr, F, &fcb);
 }
 
 // Converts a string name (AB.TXT) onto FCB name (AB      TXT)
@@ -196,7 +331,8 @@ void _HostnameToFCBname(uint8* from, uint8* to) {
 
 // Creates a fake directory entry for the current dmaAddr FCB
 void _mockupDirEntry(uint8 mode) {
-	CPM_DIRENTRY* DirEntry = (CPM_DIRENTRY*)_RamSysAddr(dmaAddr);
+	RAMBLOCK entry;
+	CPM_DIRENTRY* DirEntry;
 	uint8 blocks, i;
 
 	for (i = 0; i < sizeof(CPM_DIRENTRY); ++i)
@@ -209,6 +345,7 @@ void _mockupDirEntry(uint8 mode) {
 	}
 	_HostnameToFCB(dmaAddr, (uint8*)shortName);
 
+	DirEntry = (CPM_DIRENTRY*)_RamBlock(dmaAddr, sizeof(CPM_DIRENTRY), &entry);
 	if (allUsers) {
 		DirEntry->dr = currFindUser; // set user code for return
 	} else {
@@ -236,6 +373,8 @@ void _mockupDirEntry(uint8 mode) {
 		fileExtentsUsed += extentsPerDirEntry;
 	}
 	// phoney up an appropriate number of allocation blocks
+	if (firstFreeAllocBlock + blocks > numAllocBlocks)
+		firstFreeAllocBlock = firstBlockAfterDir;
 	if (numAllocBlocks < 256) {
 		for (i = 0; i < blocks; ++i)
 			DirEntry->al[i] = (uint8)firstFreeAllocBlock++;
@@ -246,6 +385,7 @@ void _mockupDirEntry(uint8 mode) {
 			++firstFreeAllocBlock;
 		}
 	}
+	_RamBlockDone(dmaAddr, sizeof(CPM_DIRENTRY), (uint8*)DirEntry, &entry);
 }
 
 // Matches a FCB name to a search pattern
@@ -267,7 +407,8 @@ uint8 match(uint8* fcbname, uint8* pattern) {
 
 // Returns the size of a file
 long _FileSize(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	long r, l = -1;
 
 	if (!_SelectDisk(F->dr)) {
@@ -284,7 +425,8 @@ long _FileSize(uint16 fcbaddr) {
 
 // Opens a file
 uint8 _OpenFile(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 	long len;
 	int32 i;
@@ -304,6 +446,7 @@ uint8 _OpenFile(uint16 fcbaddr) {
 			F->rc = len > MaxRC ? MaxRC : (uint8)len;
 			for (i = 0; i < 16; ++i)	// Clean up AL
 				F->al[i] = 0x00;
+			_FCBDone(fcbaddr, F, &fcb);
 
 			result = 0x00;
 		}
@@ -313,7 +456,8 @@ uint8 _OpenFile(uint16 fcbaddr) {
 
 // Closes a file
 uint8 _CloseFile(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 
 	if (!_SelectDisk(F->dr)) {
@@ -322,8 +466,10 @@ uint8 _CloseFile(uint16 fcbaddr) {
 				_FCBtoHostname(fcbaddr, &filename[0]);
 				if (!filename[4])
 					return(0xff);	// Invalid filename
-				if (fcbaddr == BatchFCB)
+				if (fcbaddr == BatchFCB) {
 					_Truncate((char*)filename, F->rc);	// Truncate $$$.SUB to F->rc CP/M records so SUBMIT.COM can work
+					_FileChanged(&filename[0]);
+				}
 				result = 0x00;
 			} else {
 				_error(errWRITEPROT);
@@ -337,7 +483,8 @@ uint8 _CloseFile(uint16 fcbaddr) {
 
 // Creates a file
 uint8 _MakeFile(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 	uint8 i;
 
@@ -346,6 +493,8 @@ uint8 _MakeFile(uint16 fcbaddr) {
 			_FCBtoHostname(fcbaddr, &filename[0]);
 			if (!filename[4])
 				return(0xff);	// Invalid filename
+			_FileChanged(&filename[0]);
+			++dirChanges;
 			if (_sys_makefile(&filename[0])) {
 				F->ex = 0x00;	// Makefile also initializes the FCB (file becomes "open")
 				F->s1 = 0x00;
@@ -354,6 +503,7 @@ uint8 _MakeFile(uint16 fcbaddr) {
 				for (i = 0; i < 16; ++i)	// Clean up AL
 					F->al[i] = 0x00;
 				F->cr = 0x00;
+				_FCBDone(fcbaddr, F, &fcb);
 				result = 0x00;
 			}
 		} else {
@@ -365,7 +515,8 @@ uint8 _MakeFile(uint16 fcbaddr) {
 
 // Searches for the first directory file
 uint8 _SearchFirst(uint16 fcbaddr, uint8 isdir) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 
 	if (!_SelectDisk(F->dr)) {
@@ -385,7 +536,8 @@ uint8 _SearchFirst(uint16 fcbaddr, uint8 isdir) {
 
 // Searches for the next directory file
 uint8 _SearchNext(uint16 fcbaddr, uint8 isdir) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(tmpFCB);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(tmpFCB, &fcb);
 	uint8 result = 0xff;
 
 	if (!_SelectDisk(F->dr)) {
@@ -400,9 +552,11 @@ uint8 _SearchNext(uint16 fcbaddr, uint8 isdir) {
 
 // Deletes a file
 uint8 _DeleteFile(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 #if defined(USE_PUN) || defined(USE_LST)
-	CPM_FCB* T = (CPM_FCB*)_RamSysAddr(tmpFCB);
+	RAMBLOCK tmp;
+	CPM_FCB* T;
 #endif
 	uint8 result = 0xff;
 	uint8 deleted = 0xff;
@@ -411,6 +565,9 @@ uint8 _DeleteFile(uint16 fcbaddr) {
 		if (!RW) {
 			result = _SearchFirst(fcbaddr, FALSE);	// FALSE = Does not create a fake dir entry when finding the file
 			while (result != 0xff) {
+#if defined(USE_PUN) || defined(USE_LST)
+				T = _FCBGet(tmpFCB, &tmp);		// Filled in by the search
+#endif
 #ifdef USE_PUN
 				if (!strcmp((char*)T->fn, "PUN     TXT") && pun_open) {
 					_sys_fclose(pun_dev);
@@ -424,6 +581,8 @@ uint8 _DeleteFile(uint16 fcbaddr) {
 				}
 #endif
 				_FCBtoHostname(tmpFCB, &filename[0]);
+				_FileChanged(&filename[0]);
+				++dirChanges;
 				if (_sys_deletefile(&filename[0])) {
 					deleted = 0x00;
 				} else {
@@ -441,7 +600,8 @@ uint8 _DeleteFile(uint16 fcbaddr) {
 
 // Renames a file
 uint8 _RenameFile(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 
 	if (!_SelectDisk(F->dr)) {
@@ -453,6 +613,9 @@ uint8 _RenameFile(uint16 fcbaddr) {
 				return(0xff);	// Invalid filename
 			if (!filename[4])
 				return(0xff);	// Invalid filename
+			_FileChanged(&filename[0]);
+			_FileChanged(&newname[0]);
+			++dirChanges;
 			if (_sys_renamefile(&filename[0], &newname[0]))
 				result = 0x00;
 		} else {
@@ -464,7 +627,8 @@ uint8 _RenameFile(uint16 fcbaddr) {
 
 // Sequential read
 uint8 _ReadSeq(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 
 	long fpos = ((F->s2 & MaxS2) * BlkS2 * BlkSZ) +
@@ -475,6 +639,9 @@ uint8 _ReadSeq(uint16 fcbaddr) {
 		_FCBtoHostname(fcbaddr, &filename[0]);
 		result = _sys_readseq(&filename[0], fpos);
 		if (!result) {	// Read succeeded, adjust FCB
+#ifdef RUNSTATS
+			runStats.bytesRead += BlkSZ;
+#endif
 			++F->cr;
 			if (F->cr > MaxCR) {
 				F->cr = 1;
@@ -488,12 +655,14 @@ uint8 _ReadSeq(uint16 fcbaddr) {
 				result = 0xfe;	// (todo) not sure what to do 
 		}
 	}
+	_FCBDone(fcbaddr, F, &fcb);
 	return(result);
 }
 
 // Sequential write
 uint8 _WriteSeq(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 
 	long fpos = ((F->s2 & MaxS2) * BlkS2 * BlkSZ) +
@@ -503,8 +672,12 @@ uint8 _WriteSeq(uint16 fcbaddr) {
 	if (!_SelectDisk(F->dr)) {
 		if (!RW) {
 			_FCBtoHostname(fcbaddr, &filename[0]);
+			_FileWriting(&filename[0], fpos);
 			result = _sys_writeseq(&filename[0], fpos);
 			if (!result) {	// Write succeeded, adjust FCB
+#ifdef RUNSTATS
+				runStats.bytesWritten += BlkSZ;
+#endif
 				F->s2 &= 0x7F;		// reset unmodified flag
 				++F->cr;
 				if (F->cr > MaxCR) {
@@ -523,12 +696,14 @@ uint8 _WriteSeq(uint16 fcbaddr) {
 			_error(errWRITEPROT);
 		}
 	}
+	_FCBDone(fcbaddr, F, &fcb);
 	return(result);
 }
 
 // Random read
 uint8 _ReadRand(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 
 	int32 record = (F->r2 << 16) | (F->r1 << 8) | F->r0;
@@ -537,6 +712,10 @@ uint8 _ReadRand(uint16 fcbaddr) {
 	if (!_SelectDisk(F->dr)) {
 		_FCBtoHostname(fcbaddr, &filename[0]);
 		result = _sys_readrand(&filename[0], fpos);
+#ifdef RUNSTATS
+		if (!result)
+			runStats.bytesRead += BlkSZ;
+#endif
 		if (result == 0 || result == 1 || result == 4) {
 			// adjust FCB unless error #6 (seek past 8MB - max CP/M file & disk size)
 			F->cr = record & 0x7F;
@@ -548,12 +727,14 @@ uint8 _ReadRand(uint16 fcbaddr) {
 			}
 		}
 	}
+	_FCBDone(fcbaddr, F, &fcb);
 	return(result);
 }
 
 // Random write
 uint8 _WriteRand(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 
 	int32 record = (F->r2 << 16) | (F->r1 << 8) | F->r0;
@@ -562,8 +743,12 @@ uint8 _WriteRand(uint16 fcbaddr) {
 	if (!_SelectDisk(F->dr)) {
 		if (!RW) {
 			_FCBtoHostname(fcbaddr, &filename[0]);
+			_FileWriting(&filename[0], fpos);
 			result = _sys_writerand(&filename[0], fpos);
 			if (!result) {	// Write succeeded, adjust FCB
+#ifdef RUNSTATS
+				runStats.bytesWritten += BlkSZ;
+#endif
 				F->cr = record & 0x7F;
 				F->ex = (record >> 7) & 0x1f;
 				F->s2 = (record >> 12) & MaxS2;	// resets unmodified flag
@@ -572,12 +757,14 @@ uint8 _WriteRand(uint16 fcbaddr) {
 			_error(errWRITEPROT);
 		}
 	}
+	_FCBDone(fcbaddr, F, &fcb);
 	return(result);
 }
 
 // Returns the size of a CP/M file
 uint8 _GetFileSize(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0xff;
 	int32 count = _FileSize(DE) >> 7;
 
@@ -587,12 +774,14 @@ uint8 _GetFileSize(uint16 fcbaddr) {
 		F->r2 = (count >> 16) & 0xff;
 		result = 0x00;
 	}
+	_FCBDone(fcbaddr, F, &fcb);
 	return(result);
 }
 
 // Set the next random record
 uint8 _SetRandom(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	uint8 result = 0x00;
 
 	int32 count = F->cr & 0x7f;
@@ -603,6 +792,7 @@ uint8 _SetRandom(uint16 fcbaddr) {
 	F->r1 = (count >> 8) & 0xff;
 	F->r2 = (count >> 16) & 0xff;
 
+	_FCBDone(fcbaddr, F, &fcb);
 	return(result);
 }
 
@@ -619,7 +809,8 @@ void _SetUser(uint8 user) {
 
 // Creates a disk directory folder
 uint8 _MakeDisk(uint16 fcbaddr) {
-	CPM_FCB* F = (CPM_FCB*)_RamSysAddr(fcbaddr);
+	RAMBLOCK fcb;
+	CPM_FCB* F = _FCBGet(fcbaddr, &fcb);
 	return(_sys_makedisk(F->dr));
 }
 
@@ -17,6 +17,17 @@
 #define USE_PUN	// The pun.txt and lst.txt files will appear on drive A: user 0
 #define USE_LST
 
+/* Definition of the machine context: every variable holding the state of the machine is MACHINE_LOCAL */
+//#define MULTIMACHINE		// Runs several machines in one process, one per thread (POSIX only, see the Makefile)
+#ifdef MULTIMACHINE
+#define MACHINE_LOCAL _Thread_local
+#else
+#define MACHINE_LOCAL
+#endif
+#if defined(MULTIMACHINE) && (defined(ARDUINO) || !defined(STREAMIO))
+#error "MULTIMACHINE needs the POSIX build with STREAMIO"
+#endif
+
 /* Definitions for file/console based debugging */
 //#define DEBUG				// Enables the internal debugger (enabled by default on vstudio debug builds)
 //#define DEBUGONHALT		// Enables the internal debugger when the CPU halts
@@ -30,6 +41,17 @@
 //#define LOGBDOS_NOT 06	// If defined will not log this BDOS function number
 //#define LOGBDOS_ONLY 22	// If defined will log only this BDOS function number
 #define LogName "RunCPM.log"
+//#define TRACE				// Writes a binary BIOS/BDOS call trace to RunCPM.trc (see tools/tracedec.c)
+#define TraceName "RunCPM.trc"
+#define TRACE_SIZE 256		// Number of trace records buffered in RAM (32 bytes each, multiple of 16)
+//#define SNAPSHOT			// SNAP or SNAPKEY saves the whole machine, resumed at the next boot (see snap.h)
+#define SnapName "RunCPM.snp"
+#define SNAPKEY 0			// Key saving a snapshot while a program waits for input, 0 = none. 0x1c = ^\ (Ctrl-Backslash)
+#define BDOSSTATS			// Counts the calls and host time of each BDOS function (see BDOS call 235)
+//#define RUNSTATS			// Counts instructions, BDOS calls by kind, disk bytes and console time and bytes (see TIME and BENCH in ccp.h)
+							// It adds work to every instruction, enable it for builds running TIME or BENCH
+//#define REPLAY			// Records the console, time and port inputs of a session to ReplayName, or replays them if it is there (see replay.h)
+#define ReplayName "RunCPM.rpl"
 
 /* RunCPM version for the greeting header */
 #define VERSION	"6.7"
@@ -130,6 +152,24 @@
 //#define PROFILE					// For measuring time taken to run a CP/M command
 									// This should be enabled only for debugging purposes when trying to improve emulation speed
 
+/* Definitions for the console queues (see ringbuf.h) */
+#define TXQ_SIZE 4096				// Size of the RAM queue between the console and the serial port (power of two)
+#define TXQ_POLICY RB_BLOCK			// What happens when the queue is full:
+									// RB_BLOCK waits for room, RB_DROP discards the oldest output,
+									// RB_GROW doubles the queue up to TXQ_MAXSIZE and then waits
+#define TXQ_MAXSIZE 32768			// Largest queue size for RB_GROW
+#define RXQ_SIZE 1024				// Size of the console input queue (Serial1 and USB keyboard)
+#define RXQ_HIGH 768				// Input queue level where RTS is dropped
+#define RXQ_LOW 256					// Input queue level where RTS is raised again
+#define RXQ_RTS_PIN -1				// GPIO used as RTS for Serial1 (-1 = no flow control)
+#define DISPQ_SIZE 4096				// Size of the queue between the console and the display renderer
+#define DISPQ_POLICY RB_BLOCK		// Same choices as TXQ_POLICY, the display is drawn 60 times a second
+#define DISPQ_MAXSIZE 32768			// Largest queue size for RB_GROW
+#define DISPQ_BUDGET 4000			// Longest time (in us) the emulation stops to draw characters at each display tick
+//#define SERVICECORE				// Serves the console (USB keyboard, serial queues) from the second core instead of
+									// timer interrupts, which needs the core PicoDVI uses for the display. On POSIX hosts
+									// the console is served by a second thread instead (make runcpm-svc)
+
 #define NOHIGHUSER					// Prevents the creation of user folders above 'F' (15) by programs
 									// Original CP/M BDOS allows it, but I prefer to keep the folders clean
 
@@ -184,14 +224,20 @@ typedef unsigned int    uint32;
 									// For TPASIZE<60 CCP ORG = (SIZEK * 1024) - 0x0C00
 
 #define BANKS 1						// Number of memory banks available
-static uint8 curBank = 1;			// Number of the current RAM bank in use (1 to x, not 0 to x)
-static uint8 isXmove = FALSE;		// Used by BIOS
-static uint8 srcBank = 1;			// Source bank for memory MOVE
-static uint8 dstBank = 1;			// Destination bank for memory MOVE
-static uint8 ioBank = 1;			// Destination bank for sector IO
+//#define BANKSTORE 40				// Keeps the banks in a backing store (PSRAM), paged through this many 4K SRAM frames (see ram.h)
+static MACHINE_LOCAL uint8 curBank = 1;			// Number of the current RAM bank in use (1 to x, not 0 to x)
+static MACHINE_LOCAL uint8 isXmove = FALSE;		// Used by BIOS
+static MACHINE_LOCAL uint8 srcBank = 1;			// Source bank for memory MOVE
+static MACHINE_LOCAL uint8 dstBank = 1;			// Destination bank for memory MOVE
+static MACHINE_LOCAL uint8 ioBank = 1;			// Destination bank for sector IO
 
 #define PAGESIZE 64 * 1024			// RAM(plus ROM) needs to be 64K to avoid compatibility issues
 #define MEMSIZE PAGESIZE * BANKS	// Total RAM size
+#define COMMONBASE (CCPaddr & 0xF000)	// Start of the common memory, the 4K page holding the CCP
+
+#if defined(BANKSTORE) && BANKS < 2
+#error "BANKSTORE needs BANKS > 1"
+#endif
 
 #if BANKS==1
 #define RAM_FAST					// If this is defined, all RAM function calls become direct access (see below)
@@ -200,7 +246,7 @@ static uint8 ioBank = 1;			// Destination bank for sector IO
 #endif
 
 #ifdef RAM_FAST						// Makes all function calls to memory access into direct RAM access (less calls / less code)
-	static uint8 RAM[MEMSIZE];
+	static MACHINE_LOCAL uint8 RAM[MEMSIZE];
 	#define _RamSysAddr(a)		&RAM[a]
 	#define _RamRead(a)			RAM[a]
 	#define _RamRead16(a)		((RAM[((a) & 0xffff) + 1] << 8) | RAM[(a) & 0xffff])
@@ -216,7 +262,8 @@ static uint8 ioBank = 1;			// Destination bank for sector IO
 
 // BDOS Pages (depends on TPASIZE for external CCPs)
 #if defined CCP_INTERNAL
-	#define BDOSjmppage (BIOSjmppage - 256)
+	#define ALVaddr (BIOSjmppage - 256)	// Allocation vector, one bit per block (up to 2048 blocks)
+	#define BDOSjmppage (ALVaddr - 256)
 	#define BDOSpage (BDOSjmppage + 16)
 #else
 	#define BDOSjmppage (TPASIZE * 1024) - 1024
@@ -235,43 +282,88 @@ static uint8 ioBank = 1;			// Destination bank for sector IO
 #endif
 
 /* Definition of global variables */
-static uint8	filename[17];		// Current filename in host filesystem format
-static uint8	newname[17];		// New filename in host filesystem format
-static uint8	fcbname[13];		// Current filename in CP/M format
-static uint8	pattern[13];		// File matching pattern in CP/M format
-static uint16	dmaAddr = 0x0080;	// Current dmaAddr
-static uint8	oDrive = 0;			// Old selected drive
-static uint8	cDrive = 0;			// Currently selected drive
-static uint8	userCode = 0;		// Current user code
-static uint16	roVector = 0;
-static uint16	loginVector = 0;
-static uint8	allUsers = FALSE;	// true when dr is '?' in BDOS search first
-static uint8	allExtents = FALSE;	// true when ex is '?' in BDOS search first
-static uint8	currFindUser = 0;	// user number of current directory in BDOS search first on all user numbers
-static uint8	blockShift;			// disk allocation block shift
-static uint8	blockMask;			// disk allocation block mask
-static uint8	extentMask;			// disk extent mask
-static uint16	firstBlockAfterDir;	// first allocation block after directory
-static uint16	numAllocBlocks;		// # of allocation blocks on disk
-static uint8	extentsPerDirEntry;	// # of logical (16K) extents in a directory entry
+static MACHINE_LOCAL uint8	filename[17];		// Current filename in host filesystem format
+static MACHINE_LOCAL uint8	newname[17];		// New filename in host filesystem format
+static MACHINE_LOCAL uint8	fcbname[13];		// Current filename in CP/M format
+static MACHINE_LOCAL uint8	pattern[13];		// File matching pattern in CP/M format
+static MACHINE_LOCAL uint16	dmaAddr = 0x0080;	// Current dmaAddr
+static MACHINE_LOCAL uint8	oDrive = 0;			// Old selected drive
+static MACHINE_LOCAL uint8	cDrive = 0;			// Currently selected drive
+static MACHINE_LOCAL uint8	userCode = 0;		// Current user code
+static MACHINE_LOCAL uint16	roVector = 0;
+static MACHINE_LOCAL uint16	loginVector = 0;
+static MACHINE_LOCAL uint16	dirChanges = 0;		// Bumped whenever a file is created, renamed or deleted
+static MACHINE_LOCAL uint16	allocValid = 0;		// Drives whose used block count below is current
+static MACHINE_LOCAL uint16	allocUsed[16];		// Blocks used by the files of each drive (all user areas)
+static MACHINE_LOCAL uint32	cardFree;			// Free space on the card, in KB
+static MACHINE_LOCAL uint8	cardFreeValid = FALSE;
+#define WRITESIZES 4						// Files whose host size is tracked while they are written
+static MACHINE_LOCAL struct {
+	uint8	name[17];						// Host name, empty if the entry is free
+	long	size;
+} writeSize[WRITESIZES];
+static MACHINE_LOCAL uint8	writeSizeNext = 0;	// Entry taken by the next file
+static MACHINE_LOCAL uint8	allUsers = FALSE;	// true when dr is '?' in BDOS search first
+static MACHINE_LOCAL uint8	allExtents = FALSE;	// true when ex is '?' in BDOS search first
+static MACHINE_LOCAL uint8	currFindUser = 0;	// user number of current directory in BDOS search first on all user numbers
+static MACHINE_LOCAL uint8	blockShift;			// disk allocation block shift
+static MACHINE_LOCAL uint8	blockMask;			// disk allocation block mask
+static MACHINE_LOCAL uint8	extentMask;			// disk extent mask
+static MACHINE_LOCAL uint16	firstBlockAfterDir;	// first allocation block after directory
+static MACHINE_LOCAL uint16	numAllocBlocks;		// # of allocation blocks on disk
+static MACHINE_LOCAL uint8	extentsPerDirEntry;	// # of logical (16K) extents in a directory entry
 #define logicalExtentBytes (16*1024UL)
-static uint16	physicalExtentBytes;// # bytes described by 1 directory entry
+static MACHINE_LOCAL uint16	physicalExtentBytes;// # bytes described by 1 directory entry
+
+#ifdef REPLAY
+#ifndef RUNSTATS
+#error "REPLAY logs the inputs by instruction count, it needs RUNSTATS"
+#endif
+#else
+#define REPLAYED(kind, live) (live)	// An input read, replaced by the logged one when a session is replayed (see replay.h)
+#endif
+
+#ifdef RUNSTATS
+typedef struct {
+	unsigned long long instructions;	// Emulated instructions executed
+	uint32	conCalls;					// BDOS calls by kind
+	uint32	diskCalls;
+	uint32	otherCalls;
+	uint32	diskTime;					// Host microseconds spent in disk BDOS calls
+	uint32	conOutTime;					// Host microseconds spent sending console output
+	uint32	bytesRead;					// Bytes moved by BDOS file reads and writes
+	uint32	bytesWritten;
+	uint32	conBytes;					// Characters sent to the console
+} RUNCOUNTERS;
+static MACHINE_LOCAL RUNCOUNTERS runStats;
+#endif
 
 #define tohex(x)	((x) < 10 ? (x) + 48 : (x) + 87)
 
 /* definition of an autoexec functionality */
-static uint8	firstBoot = TRUE;	// True if this is the first boot
+static MACHINE_LOCAL uint8	firstBoot = TRUE;	// True if this is the first boot
 #define AUTOEXEC "AUTOEXEC.TXT"		// Name of the autoexec file
 #define BOOTONLY FALSE				// If TRUE, the autoexec file will only be loaded on the first boot
+#define TimeName "TIME"				// Date and time the clock starts from on boards without an RTC (see clock.h)
+#define BenchName "BENCH.CSV"		// Report the internal CCP BENCH command appends to (see tools/mkbench.c)
+#ifndef BENCHTAG
+#define BENCHTAG VERSION " " __DATE__ " " __TIME__	// Build label of the BENCH reports
+#endif
 
-static uint32 timer;
+#define COPYBUF 4096				// Buffer size used by the internal CCP COPY command
+//#define CCPDATE					// Adds a DATE command to the internal CCP, which then hides a DATE.COM
+#ifndef ARDUINO
+#define COMCACHE 32768				// Host RAM keeping the last .COM images run by the internal CCP (see comcache.h)
+#endif								// Boards only get it from their hardware file, when it can go to PSRAM (COMCACHE_ATTR)
+
+static MACHINE_LOCAL uint32 timer;
 
 #ifdef STREAMIO
 #include <stdio.h>
-static FILE		*streamInputFile = NULL;
-static FILE		*streamOutputFile = NULL;
-static uint8	streamInputActive = FALSE;
-static uint8	consoleOutputActive = TRUE;
+static MACHINE_LOCAL FILE		*streamInputFile = NULL;
+static MACHINE_LOCAL FILE		*streamOutputFile = NULL;
+static MACHINE_LOCAL uint8	streamInputActive = FALSE;
+static MACHINE_LOCAL uint8	consoleOutputActive = TRUE;
 #endif
 
 
@@ -283,10 +375,12 @@ extern "C"
 
 #ifndef RAM_FAST
 	extern uint8* _RamSysAddr(uint16 address);
+	extern uint8 _RamRead(uint16 address);
 	extern void _RamWrite(uint16 address, uint8 value);
 #endif
 
 	extern void _Bdos(void);
+	extern void _BdosInit(void);
 	extern void _Bios(void);
 
 	extern void _HostnameToFCB(uint16 fcbaddr, uint8* filename);
@@ -295,6 +389,16 @@ extern "C"
 	extern uint8 match(uint8* fcbname, uint8* pattern);
 
 	extern void _puts(const char* str);
+#ifdef TRACE
+	extern void _traceDrain(uint8 all);
+	extern void _traceFlush(void);
+#endif
+#ifdef SNAPSHOT
+	extern uint8 _snapSave(void);
+#endif
+#ifdef REPLAY
+	extern void _replayClose(void);
+#endif
 
 #ifdef __cplusplus // If building on Arduino
 }
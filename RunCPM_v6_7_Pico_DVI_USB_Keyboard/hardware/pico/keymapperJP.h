@@ -8,7 +8,7 @@
 #define FLAG_CTRL (8)
 #define FLAG_LUT (16)
 
-const char * const lut[] = {
+constexpr const char *lut[] = {
   "!\"#$%&'()",                                        /* 0 - shifted numeric keys */
   "\r\x1b\b\t -^@[\\];:`,./",                          /* 1 - symbol keys */
   "\n\x1b\x7f\t =~`{|}+*~<>?",                         /* 2 - shifted */
@@ -19,7 +19,9 @@ const char * const lut[] = {
 
 struct keycode_mapper {
   uint8_t first, last, code, flags;
-} keycode_to_ascii[] = {
+};
+
+constexpr keycode_mapper keycode_to_ascii[] = {
   { HID_KEY_A, HID_KEY_Z, 'a', FLAG_ALPHABETIC, },
 
   { HID_KEY_1, HID_KEY_9, 0, FLAG_SHIFT | FLAG_LUT, },
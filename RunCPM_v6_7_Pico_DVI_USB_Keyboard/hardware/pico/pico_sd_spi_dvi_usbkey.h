@@ -7,12 +7,71 @@
 #include <SdFat.h>
 #include <PicoDVI.h>
 #include <Adafruit_TinyUSB.h>
+#include <hardware/dma.h>
+#include <hardware/uart.h>
+#include <hardware/sync.h>
 #include "../../console.h"
 #include "../../arduino_hooks.h"
 
+#ifdef SERVICECORE
+// The queues are served by the other core, so their slow paths take a hardware spin lock
+static spin_lock_t *rbSpinLock;
+#define RB_LOCK()   uint32_t rbIrqState = spin_lock_blocking(rbSpinLock)
+#define RB_UNLOCK() spin_unlock(rbSpinLock, rbIrqState)
+#else
+// The serial queue is drained from the timer interrupt, so its slow paths run with interrupts off
+#define RB_LOCK()   uint32_t rbIrqState = save_and_disable_interrupts()
+#define RB_UNLOCK() restore_interrupts(rbIrqState)
+#endif
+#define RB_TIME()   time_us_32()
+#include "../../ringbuf.h"
+
 #include "keymapperUS.h"
 
-#define USE_DISPLAY (1)
+// Keymap compiled at build time from keycode_to_ascii[], one entry per keycode and
+// modifier state (shift | ctrl | numlock). Caps lock and alt are applied afterwards.
+#define KEYMAP_SHIFT  (1)
+#define KEYMAP_CTRL   (2)
+#define KEYMAP_NUM    (4)
+#define KEYMAP_MAPPED (0x100) // The keycode produces a character
+#define KEYMAP_ALPHA  (0x200) // The character follows caps lock
+
+struct keymap_table {
+  uint16_t code[8][256];
+};
+
+constexpr keymap_table make_keymap_table() {
+  keymap_table t{};
+  for (int state = 0; state < 8; state++) {
+    for (int keycode = 0; keycode < 256; keycode++) {
+      for (const auto &mapper : keycode_to_ascii) {
+        if (!(keycode >= mapper.first && keycode <= mapper.last))
+          continue;
+        if (mapper.flags & FLAG_SHIFT && !(state & KEYMAP_SHIFT))
+          continue;
+        if (mapper.flags & FLAG_NUMLOCK && !(state & KEYMAP_NUM))
+          continue;
+        if (mapper.flags & FLAG_CTRL && !(state & KEYMAP_CTRL))
+          continue;
+        uint8_t code = (mapper.flags & FLAG_LUT) ? lut[mapper.code][keycode - mapper.first]
+                                                 : keycode - mapper.first + mapper.code;
+        if (state & KEYMAP_CTRL) {
+          t.code[state][keycode] = (code & 0x1f) | KEYMAP_MAPPED; // Control codes ignore caps lock
+        } else {
+          t.code[state][keycode] = code | KEYMAP_MAPPED | ((mapper.flags & FLAG_ALPHABETIC) ? KEYMAP_ALPHA : 0);
+        }
+        break;
+      }
+    }
+  }
+  return t;
+}
+
+constexpr keymap_table keymap = make_keymap_table();
+
+#ifndef SERVICECORE
+#define USE_DISPLAY (1) // PicoDVI takes core 1, see SERVICECORE in globals.h
+#endif
 #define USE_KEYBOARD (1)
 
 
@@ -28,6 +87,10 @@
 #define USE_MSC (0)
 #endif
 
+#if defined(SERVICECORE) && USE_DISPLAY
+#error SERVICECORE needs core 1, which PicoDVI takes for the display
+#endif
+
 
 uint8_t getch_serial1(void) {
     while(true) {
@@ -43,49 +106,169 @@ bool kbhit_serial1(void) {
 }
 
 
+// Console input queue
+// Serial1 and the USB keyboard are read by the service timer into a single queue, in
+// arrival order, so bursts (pasted text, XMODEM) are kept while the emulation is busy.
+// When RXQ_RTS_PIN is set, RTS is dropped above RXQ_HIGH and raised again below RXQ_LOW.
+RINGBUF rxQueue;
+static volatile bool rxThrottled = false;
+
+static void rx_rts(bool ready) {
+#if RXQ_RTS_PIN >= 0
+    digitalWrite(RXQ_RTS_PIN, ready ? LOW : HIGH); // RTS is active low
+#endif
+}
+
+#if USE_KEYBOARD
+// Without the queue (it couldn't be allocated) Serial1 is read directly and the keys
+// go through this small buffer and the console hooks
 #define USBH_KEY_BUFFER_SIZE 64
 
-uint8_t usbhkbuf[USBH_KEY_BUFFER_SIZE];
-uint8_t usbhkbufnum = 0;
+static uint8_t usbhkbuf[USBH_KEY_BUFFER_SIZE];
+static volatile uint8_t usbhkbufHead = 0; // Moved by the timer
+static volatile uint8_t usbhkbufTail = 0; // Moved by the emulation
 
-bool usbhkbd_write(uint8_t code) {
-    if (usbhkbufnum > USBH_KEY_BUFFER_SIZE) {
-        return false;
-    } else {
-        usbhkbuf[usbhkbufnum] = code;
-        usbhkbufnum++;
+bool kbhit_usbh(void) {
+    return usbhkbufHead != usbhkbufTail;
+}
+
+uint8_t getch_usbh(void) {
+    while (!kbhit_usbh());
+    uint8_t ch = usbhkbuf[usbhkbufTail % USBH_KEY_BUFFER_SIZE];
+    RB_BARRIER();
+    ++usbhkbufTail;
+    return ch;
+}
+#endif
+
+// Called from the timer, drops the character if the queue is full
+bool console_rx_put(uint8_t ch) {
+#if USE_KEYBOARD
+    if (!rxQueue.buf) {
+        if ((uint8_t)(usbhkbufHead - usbhkbufTail) == USBH_KEY_BUFFER_SIZE) return false;
+        usbhkbuf[usbhkbufHead % USBH_KEY_BUFFER_SIZE] = ch;
+        RB_BARRIER();
+        ++usbhkbufHead;
         return true;
     }
+#endif
+    if (!rxQueue.buf || !_rb_free(&rxQueue)) return false;
+    _rb_put(&rxQueue, ch);
+    if (!rxThrottled && _rb_count(&rxQueue) >= RXQ_HIGH) {
+        rxThrottled = true;
+        rx_rts(false);
+    }
+    return true;
 }
 
-uint8_t usbhkbd_available(void) {
-    if (usbhkbufnum == 0) return 0;
-    else return usbhkbufnum;
+// Called from the timer, what doesn't fit stays in the Serial1 buffer
+void serial1_rx_fill(void) {
+    while (rxQueue.buf && _rb_free(&rxQueue) && Serial1.available()) {
+        console_rx_put(Serial1.read());
+    }
 }
 
-int usbhkbd_read(void) {
-    if (usbhkbufnum == 0) {
-        return (-1);
+int console_rx_get(void) {
+    int c = _rb_get(&rxQueue);
+    if (rxThrottled && _rb_count(&rxQueue) <= RXQ_LOW) {
+        RB_LOCK();
+        if (_rb_count(&rxQueue) <= RXQ_LOW) {
+            rxThrottled = false;
+            rx_rts(true);
+        }
+        RB_UNLOCK();
+    }
+    return c;
+}
+
+void console_rx_begin(void) {
+#if RXQ_RTS_PIN >= 0
+    pinMode(RXQ_RTS_PIN, OUTPUT);
+#endif
+    if (_rb_init(&rxQueue, RXQ_SIZE, RB_DROP, RXQ_SIZE, NULL)) {
+        rx_rts(true);
     } else {
-        usbhkbufnum-- ;
-        uint8_t code = usbhkbuf[usbhkbufnum];
-        return code;
+#if USE_KEYBOARD
+        _getch_hook = getch_usbh;
+        _kbhit_hook = kbhit_usbh;
+#endif
     }
 }
 
-uint8_t getch_usbh(void) {
-    while(true) {
-        int r = usbhkbd_read();
-        if(r != -1) {
-            return r;
+
+// Serial1 transmit queue
+// Console output is queued in RAM and sent to UART0 by DMA, so the emulation only
+// waits for the serial line when the queue is full (see TXQ_POLICY in globals.h).
+// The queue is drained from the service timer and at the explicit flush points.
+#define TXQ_DMA_CHUNK 256 // Largest DMA transfer, bounds the wait of RB_DROP
+
+RINGBUF txQueue;
+static int txDmaChan = -1;
+static bool txReady = false;
+
+#ifdef SERVICECORE
+// Service core
+// With SERVICECORE the console services run in a loop on core 1 instead of the timer
+// interrupts (see loop1). Core 1 sleeps between rounds, for up to SVC_IDLE_TIME or until
+// core 0 rings it through the inter-core FIFO after queueing output.
+static volatile bool svcReady = false; // Set once the queues exist
+static volatile bool svcIdle = false;  // Core 1 is going to sleep
+
+void svc_wake(void) {
+    RB_BARRIER(); // The queued bytes are seen before svcIdle is read
+    if (svcIdle) {
+        svcIdle = false;
+        rp2040.fifo.push_nb(0);
+    }
+}
+#define TXQ_DRAIN svc_wake // Waiting for room only rings core 1, it is the only consumer
+#else
+#define TXQ_DRAIN serial1_tx_drain
+#endif
+
+void serial1_tx_drain(void) {
+    if (!txReady) return;
+    RB_LOCK();
+    if (txDmaChan >= 0) {
+        if (!dma_channel_is_busy(txDmaChan)) {
+            if (txQueue.busy) _rb_skip(&txQueue, txQueue.busy);
+            uint8_t *p;
+            uint32_t n = _rb_peek(&txQueue, &p, TXQ_DMA_CHUNK);
+            if (n) dma_channel_transfer_from_buffer_now(txDmaChan, p, n);
+        }
+    } else {
+        int c;
+        while (Serial1.availableForWrite() && (c = _rb_get(&txQueue)) != -1) {
+            Serial1.write((uint8_t)c);
         }
     }
+    RB_UNLOCK();
 }
 
-bool kbhit_usbh(void) {
-    return usbhkbd_available();
+// Must be called after Serial1.begin()
+void serial1_tx_begin(void) {
+    if (_rb_init(&txQueue, TXQ_SIZE, TXQ_POLICY, TXQ_MAXSIZE, TXQ_DRAIN)) {
+        txDmaChan = dma_claim_unused_channel(false);
+        if (txDmaChan >= 0) {
+            dma_channel_config c = dma_channel_get_default_config(txDmaChan);
+            channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+            channel_config_set_read_increment(&c, true);
+            channel_config_set_write_increment(&c, false);
+            channel_config_set_dreq(&c, DREQ_UART0_TX); // Serial1 is UART0
+            dma_channel_configure(txDmaChan, &c, &uart_get_hw(uart0)->dr, NULL, 0, false);
+        }
+        txReady = true;
+    }
+#ifdef SERVICECORE
+    svcReady = true; // Core 1 starts serving the queues
+#endif
 }
 
+// Console services (USB host, serial queue) are executed by timer interrupt.
+#define KBD_INT_TIME 100 // USB HOST / serial queue processing interval us
+
+static repeating_timer_t rtimer;
+
 
 
 // USB Keyboard
@@ -95,10 +278,6 @@ bool kbhit_usbh(void) {
 #error This sketch requires usb stack configured as host in "Tools -> USB Stack -> Adafruit TinyUSB Host"
 #endif
 
-#define KBD_INT_TIME 100 // USB HOST processing interval us
-
-static repeating_timer_t rtimer;
-
 #define LANGUAGE_ID 0x0409 // Language ID: English
 Adafruit_USBH_Host USBHost; // USB Host object
 
@@ -124,7 +303,7 @@ const uint32_t initial_repeat_time = 500;
 void send_ascii(uint8_t code, uint32_t repeat_time=default_repeat_time) {
   old_ascii = code;
   repeat_timeout = millis() + repeat_time;
-  usbhkbd_write(code);
+  console_rx_put(code);
 }
 
 void usb_host_task(void) {
@@ -142,11 +321,46 @@ void usb_host_task(void) {
   }
 }
 
-bool timer_callback(repeating_timer_t *rtimer) { // USB Host is executed by timer interrupt.
+#endif
+
+// USB Host and the serial queues, served by the timer interrupt or by the service core
+static void console_services(void) {
+#if USE_KEYBOARD
   usb_host_task();
+#endif
+  serial1_rx_fill();
+  serial1_tx_drain();
+}
+
+bool timer_callback(repeating_timer_t *rtimer) { // USB Host and the serial queue are executed by timer interrupt.
+  console_services();
   return true;
 }
 
+#ifdef SERVICECORE
+#define SVC_IDLE_TIME KBD_INT_TIME // Longest sleep of core 1, bounds the serial input and key repeat latency
+
+void setup1(void) {
+  while (!svcReady) {
+    tight_loop_contents();
+  }
+#if USE_KEYBOARD
+  USBHost.begin(0); // The USB host is served on the core that started it
+#endif
+}
+
+void loop1(void) {
+  uint32_t msg;
+
+  console_services();
+  svcIdle = true;
+  RB_BARRIER();
+  if (!_rb_count(&txQueue)) {
+    best_effort_wfe_or_timeout(make_timeout_time_us(SVC_IDLE_TIME)); // The FIFO push wakes it early
+  }
+  svcIdle = false;
+  while (rp2040.fifo.pop_nb(&msg));
+}
 #endif
 
 
@@ -170,10 +384,19 @@ SdFat32 SD;
 #define LED 25  // GPIO25
 #define LEDinv 0
 #define board_pico
+#define board_constats
 #define board_analog_io
 #define board_digital_io
 #define BOARD "Raspberry Pi Pico"
 
+#if defined(PICO_RP2350) && defined(RP2350_PSRAM_CS)
+#ifndef COMCACHE
+#define COMCACHE 32768 // The .COM image cache, only built in with PSRAM: PicoDVI and TinyUSB take most of the SRAM
+#endif
+#define COMCACHE_ATTR PSRAM // Keep the .COM image cache in PSRAM when the board has it
+#define BANKSTORE_ATTR PSRAM // and the memory banks, when BANKSTORE is enabled
+#endif
+
 // =========================================================================================
 // Pin Documentation
 // =========================================================================================
@@ -229,10 +452,10 @@ DVItext1 display(DVI_RES_640x240p60, pico_sock_cfg);
 
 uint16_t underCursor = ' ';
 
-void putch_display(uint8_t ch) {
+// Draws one character, the caller takes care of the cursor
+static void draw_display(uint8_t ch) {
     auto x = display.getCursorX();
     auto y = display.getCursorY();
-    display.drawPixel(x, y, underCursor);
     if(((ch >= 0x20) && (ch <= 0x7E)) || ((ch >= 0x80) && (ch <= 0xFF))) { //ASCII Character
         display.write(ch);
     } else {
@@ -276,15 +499,140 @@ void putch_display(uint8_t ch) {
 
         }
     }
-    x = display.getCursorX();
-    y = display.getCursorY();
+}
+
+static void hide_cursor(void) {
+    display.drawPixel(display.getCursorX(), display.getCursorY(), underCursor);
+}
+
+static void show_cursor(void) {
+    auto x = display.getCursorX();
+    auto y = display.getCursorY();
     underCursor = display.getPixel(x, y);
     display.drawPixel(x, y, 0xDB);
 }
+
+// Display queue
+// Console output for the display is queued and drawn about 60 times a second, at most
+// DISPQ_BUDGET us at a time, so the screen is updated once per tick instead of once per
+// character. The tick timer only raises dispTick: the drawing is done by display_service,
+// from the console calls of the emulation, so the interrupts serving the USB host and the
+// serial queues are never held up by it. The tick isn't synced to the DVI frames.
+#define FRAME_INT_TIME 16667 // Display tick interval us (60Hz)
+
+RINGBUF dispQueue;
+static repeating_timer_t ftimer;
+static volatile bool dispTick = false;
+
+static struct {
+    uint32_t bytes;    // Characters drawn since boot
+    uint32_t rate;     // Characters drawn during the last second
+    volatile uint32_t ticks; // Display ticks since boot
+    uint32_t overruns; // Ticks that ran out of budget with output still queued
+    uint32_t lastBytes;
+    uint32_t lastTicks;
+} dispStats;
+
+bool frame_callback(repeating_timer_t *ftimer) {
+    ++dispStats.ticks;
+    dispTick = true;
+    return true;
+}
+
+// Draws the queued characters for up to budget us
+static void display_draw(uint32_t budget) {
+    uint32_t start = time_us_32();
+    uint8_t *p;
+    uint32_t n;
+
+    if (!_rb_count(&dispQueue)) return;
+    hide_cursor();
+    while (time_us_32() - start < budget && (n = _rb_peek(&dispQueue, &p, 32))) {
+        for (uint32_t i = 0; i < n; ++i)
+            draw_display(p[i]);
+        _rb_skip(&dispQueue, n);
+        dispStats.bytes += n;
+    }
+    show_cursor();
+}
+
+// Called by the console calls, draws once per tick
+void display_service(void) {
+    if (!dispTick) return;
+    dispTick = false;
+    display_draw(DISPQ_BUDGET);
+    if (_rb_count(&dispQueue))
+        ++dispStats.overruns;
+    if (dispStats.ticks - dispStats.lastTicks >= 60) {
+        dispStats.rate = dispStats.bytes - dispStats.lastBytes;
+        dispStats.lastBytes = dispStats.bytes;
+        dispStats.lastTicks = dispStats.ticks;
+    }
+}
+
+// Waiting for room or for a flush draws without waiting for the tick
+static void display_drain(void) {
+    display_draw(UINT32_MAX);
+}
+
+void putch_display(uint8_t ch) {
+    if (dispQueue.buf) {
+        _rb_put(&dispQueue, ch);
+        display_service();
+    } else {
+        hide_cursor();
+        draw_display(ch);
+        show_cursor();
+    }
+}
+
+// The cursor is only erased and redrawn once per block
+void putblk_display(const uint8_t *buf, size_t len) {
+    if (dispQueue.buf) {
+        _rb_write(&dispQueue, buf, len);
+        display_service();
+    } else {
+        hide_cursor();
+        while (len--)
+            draw_display(*buf++);
+        show_cursor();
+    }
+}
+
+// Draws everything queued, before drawing directly
+void display_flush(void) {
+    if (dispQueue.buf) _rb_flush(&dispQueue);
+}
+#endif
+
+// Console statistics, copied to a block of 6 double words at addr
+// total bytes drawn, bytes drawn in the last second, display ticks, ticks over budget,
+// microseconds blocked waiting for the queues, bytes dropped from the queues
+uint8_t _constats(uint16_t addr) {
+    uint32_t stats[6] = { 0 };
+
+#if USE_DISPLAY
+    stats[0] = dispStats.bytes;
+    stats[1] = dispStats.rate;
+    stats[2] = dispStats.ticks;
+    stats[3] = dispStats.overruns;
+    stats[4] = dispQueue.blocked;
+    stats[5] = dispQueue.dropped;
 #endif
+    stats[4] += txQueue.blocked;
+    stats[5] += txQueue.dropped;
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 4; ++j)
+            _RamWrite(addr++, stats[i] >> (j * 8));
+    }
+    return 0;
+}
 
 
 bool port_init_early() {
+#ifdef SERVICECORE
+  rbSpinLock = spin_lock_init(spin_lock_claim_unused(true));
+#endif
 #if USE_DISPLAY
 //vreg_set_voltage(VREG_VOLTAGE_1_20);
 //delay(10);
@@ -292,15 +640,24 @@ bool port_init_early() {
     return false;
   }
   _putch_hook = putch_display;
+  _putblk_hook = putblk_display;
+  // The display is drawn from the queue at each display tick
+  if (_rb_init(&dispQueue, DISPQ_SIZE, DISPQ_POLICY, DISPQ_MAXSIZE, display_drain) &&
+      !add_repeating_timer_us( FRAME_INT_TIME/*us*/, frame_callback, NULL, &ftimer )) {
+    free(dispQueue.buf); // No timer, draw directly
+    dispQueue.buf = NULL;
+  }
 #endif
 
+  console_rx_begin();
+
+#ifndef SERVICECORE
 #if USE_KEYBOARD
   USBHost.begin(0);
-  // USB Host is executed by timer interrupt.
-  add_repeating_timer_us( KBD_INT_TIME/*us*/, timer_callback, NULL, &rtimer );
+#endif
 
-  _getch_hook = getch_usbh;
-  _kbhit_hook = kbhit_usbh;
+  // USB Host and the serial queues are executed by timer interrupt.
+  add_repeating_timer_us( KBD_INT_TIME/*us*/, timer_callback, NULL, &rtimer );
 #endif
 
 
@@ -340,14 +697,7 @@ extern "C"
 
 #if USE_KEYBOARD
 
-hid_keyboard_report_t old_report;
-
-bool report_contains(const hid_keyboard_report_t &report, uint8_t key) {
-  for (int i = 0; i < 6; i++) {
-    if (report.keycode[i] == key) return true;
-  }
-  return false;
-}
+static uint32_t keystate[8]; // One bit per keycode held down in the previous report
 
 void process_boot_kbd_report(uint8_t dev_addr, uint8_t idx, const hid_keyboard_report_t &report) {
 
@@ -355,10 +705,11 @@ void process_boot_kbd_report(uint8_t dev_addr, uint8_t idx, const hid_keyboard_r
   bool shift = report.modifier & 0x22;
   bool ctrl = report.modifier & 0x11;
 
-  bool num = old_report.reserved & 1;
-  bool caps = old_report.reserved & 2;
+  bool num = keyboard_leds & 1;
+  bool caps = keyboard_leds & 2;
 
-  uint8_t code = 0;
+  uint32_t now[8] = { 0 };
+  uint32_t pressed[8];
 
   if (report.keycode[0] == 1 && report.keycode[1] == 1) {
     // keyboard says it has exceeded max kro
@@ -369,8 +720,18 @@ void process_boot_kbd_report(uint8_t dev_addr, uint8_t idx, const hid_keyboard_r
   old_ascii = -1;
 
   for (auto keycode : report.keycode) {
-    if (keycode == 0) continue;
-    if (report_contains(old_report, keycode)) continue;
+    now[keycode >> 5] |= 1u << (keycode & 31);
+  }
+  now[0] &= ~1u; // keycode 0 is an empty slot
+  for (int i = 0; i < 8; i++) {
+    pressed[i] = now[i] & ~keystate[i];
+    keystate[i] = now[i];
+  }
+
+  for (auto keycode : report.keycode) { // Report order is kept for keys pressed together
+    uint32_t bit = 1u << (keycode & 31);
+    if (!(pressed[keycode >> 5] & bit)) continue;
+    pressed[keycode >> 5] &= ~bit;
 
     /* key is newly pressed */
     if (keycode == HID_KEY_NUM_LOCK) {
@@ -382,36 +743,22 @@ void process_boot_kbd_report(uint8_t dev_addr, uint8_t idx, const hid_keyboard_r
 #endif
       caps = !caps;
     } else {
-      for (const auto &mapper : keycode_to_ascii) {
-        if (!(keycode >= mapper.first && keycode <= mapper.last))
-          continue;
-        if (mapper.flags & FLAG_SHIFT && !shift)
-          continue;
-        if (mapper.flags & FLAG_NUMLOCK && !num)
-          continue;
-        if (mapper.flags & FLAG_CTRL && !ctrl)
-          continue;
-        if (mapper.flags & FLAG_LUT) {
-          code = lut[mapper.code][keycode - mapper.first];
-        } else {
-          code = keycode - mapper.first + mapper.code;
+      uint16_t entry = keymap.code[(shift ? KEYMAP_SHIFT : 0) | (ctrl ? KEYMAP_CTRL : 0) | (num ? KEYMAP_NUM : 0)][keycode];
+      if (entry & KEYMAP_MAPPED) {
+        uint8_t code = entry;
+        if ((entry & KEYMAP_ALPHA) && (shift ^ caps)) {
+          code ^= ('a' ^ 'A');
         }
-        if (mapper.flags & FLAG_ALPHABETIC) {
-          if (shift ^ caps) {
-            code ^= ('a' ^ 'A');
-          }
-        }
-        if (ctrl) code &= 0x1f;
         if (alt) code ^= 0x80;
         send_ascii(code, initial_repeat_time); // send code
-        break;
       }
     }
   }
 
 //uint8_t leds = (caps | (num << 1));
-  keyboard_leds = (num | (caps << 1));
-  if (keyboard_leds != old_report.reserved) {
+  uint8_t leds = (num | (caps << 1));
+  if (keyboard_leds != leds) {
+    keyboard_leds = leds;
     keyboard_leds_changed = true;
     // no worky
     //auto r = tuh_hid_set_report(dev_addr, idx/*idx*/, 0/*report_id*/, HID_REPORT_TYPE_OUTPUT/*report_type*/, &leds, sizeof(leds));
@@ -419,8 +766,6 @@ void process_boot_kbd_report(uint8_t dev_addr, uint8_t idx, const hid_keyboard_r
   } else {
     keyboard_leds_changed = false;
   }
-  old_report = report;
-  old_report.reserved = keyboard_leds;
 }
 
 /*
@@ -546,7 +891,7 @@ void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t idx)
     keyboard_dev_addr = 0;
     keyboard_idx = 0;
     keyboard_leds = 0;
-    old_report = {0};
+    memset(keystate, 0, sizeof(keystate));
   }
 }
 
@@ -1,8 +1,339 @@
 #ifndef HOST_H
 #define HOST_H
 
+/*
+	Host services (BDOS call 231 - F_BDOSCALL)
+
+	Runs natively work that is slow to emulate. DE points to a parameter block,
+	usually placed in the DMA buffer. Words are 16 bits and longs 32 bits, little endian.
+	Addresses and lengths refer to the emulated RAM (current bank); a block must not
+	wrap around 0xFFFF. Blocks are worked on a host span at a time (see _RamSpan), so they
+	may cross the page frames of BANKSTORE or the start of the common memory.
+
+	+0	byte	function (HS_xxx)
+	+1	byte	status returned (also in A): HS_OK, HS_NOTFOUND (also blocks that differ) or HS_ERROR
+	+2	...		arguments and results, per function:
+
+	HS_VERSION	+2 word  API version (BCD)          +4 word  number of functions
+	HS_MOVE		+2 word  source   +4 word  dest     +6 word  length (overlap allowed)
+	HS_FILL		+2 word  dest     +4 word  length   +6 byte  value
+	HS_COMPARE	+2 word  block 1  +4 word  block 2  +6 word  length
+				+8 word  offset of the first difference (returned)
+	HS_SEARCH	+2 word  block    +4 word  length   +6 word  pattern  +8 word  pattern length
+				+10 word offset of the first match (returned)
+	HS_CRC16	+2 word  block    +4 word  length   +6 word  initial value, replaced by the CRC
+				(CCITT polynomial 0x1021, as used by XMODEM)
+	HS_CRC32	+2 word  block    +4 word  length   +6 long  initial value, replaced by the CRC
+				(IEEE 802.3, as used by ZIP; pass 0 to start)
+	HS_SORT		+2 word  records  +4 word  count    +6 byte  record size
+				+7 byte  key offset  +8 byte  key length  +9 byte  flags (bit 0 = descending)
+				Sorts fixed size records in place, keys compared as unsigned bytes
+	HS_MUL32	+2 long  a        +6 long  b        +10 long a * b (low 32 bits)
+	HS_DIV32	+2 long  a        +6 long  b        +10 long a / b  +14 long a % b
+*/
+
+#define HS_APIVERSION	0x10
+
+#define HS_VERSION		0
+#define HS_MOVE			1
+#define HS_FILL			2
+#define HS_COMPARE		3
+#define HS_SEARCH		4
+#define HS_CRC16		5
+#define HS_CRC32		6
+#define HS_SORT			7
+#define HS_MUL32		8
+#define HS_DIV32		9
+#define HS_COUNT		10
+
+#define HS_OK			0x00
+#define HS_NOTFOUND		0x01	// Also HS_COMPARE with different blocks
+#define HS_ERROR		0xff
+
+uint32 _RamRead32(uint16 address) {
+	return(_RamRead16(address) | ((uint32)_RamRead16(address + 2) << 16));
+}
+
+void _RamWrite32(uint16 address, uint32 value) {
+	_RamWrite16(address, value & 0xffff);
+	_RamWrite16(address + 2, value >> 16);
+}
+
+// A block of emulated RAM doesn't wrap around 0xFFFF
+static uint8 _hostRange(uint16 address, uint16 len) {
+	return((uint32)address + len <= 0x10000UL);
+}
+
+// Bytes of a block that are contiguous on the host from address (a page frame with BANKSTORE)
+static uint16 _hostSpan(uint16 address, uint32 len) {
+	uint32 n = _RamSpan(address);
+
+	return(n < len ? n : len);
+}
+
+// Copies between the emulated RAM and a host buffer, a span at a time
+static void _hostRead(uint8* buf, uint16 address, uint16 len) {
+	uint16 n;
+
+	for (; len; address += n, buf += n, len -= n) {
+		n = _hostSpan(address, len);
+		memcpy(buf, _RamSysAddr(address), n);
+	}
+}
+
+static void _hostWrite(uint16 address, const uint8* buf, uint16 len) {
+	uint16 n;
+
+	for (; len; address += n, buf += n, len -= n) {
+		n = _hostSpan(address, len);
+		memcpy(_RamSysAddr(address), buf, n);
+	}
+}
+
+// Offset of the first difference between two blocks, len if they are the same
+static uint16 _hostCompare(uint16 a, uint16 b, uint16 len) {
+	uint16 i = 0, n;
+	uint8 *p, *q;
+
+	for (; i < len; i += n) {
+		n = _hostSpan(b + i, _hostSpan(a + i, len - i));
+		p = _RamSysAddr(a + i);
+		q = _RamSysAddr(b + i);
+		if (memcmp(p, q, n)) {
+			while (*p++ == *q++)
+				++i;
+			break;
+		}
+	}
+	return(i);
+}
+
+static uint16 _crc16(const uint8* p, uint16 len, uint16 crc) {
+	uint8 i;
+
+	while (len--) {
+		crc ^= (uint16)*p++ << 8;
+		for (i = 0; i < 8; ++i)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return(crc);
+}
+
+static uint32 _crc32(const uint8* p, uint16 len, uint32 crc) {
+	static MACHINE_LOCAL uint32 table[256];
+	uint32 c;
+	uint16 i;
+	uint8 j;
+
+	if (!table[1]) {
+		for (i = 0; i < 256; ++i) {
+			for (c = i, j = 0; j < 8; ++j)
+				c = c & 1 ? (c >> 1) ^ 0xEDB88320UL : c >> 1;
+			table[i] = c;
+		}
+	}
+	crc = ~crc;
+	while (len--)
+		crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return(~crc);
+}
+
+static MACHINE_LOCAL uint8 hostBuf[2][256];		// Bounce buffers, for the blocks that can't be worked on in place
+static MACHINE_LOCAL uint8 sortKeyOff, sortKeyLen, sortDesc;
+
+static int _sortCompare(const void* a, const void* b) {
+	int r = memcmp((const uint8*)a + sortKeyOff, (const uint8*)b + sortKeyOff, sortKeyLen);
+	return(sortDesc ? -r : r);
+}
+
+// Compares records i and j of a block spanning several page frames
+static int _sortCompareRam(uint16 base, uint8 size, uint16 i, uint16 j) {
+	int r;
+
+	_hostRead(hostBuf[0], base + i * size + sortKeyOff, sortKeyLen);
+	_hostRead(hostBuf[1], base + j * size + sortKeyOff, sortKeyLen);
+	r = memcmp(hostBuf[0], hostBuf[1], sortKeyLen);
+	return(sortDesc ? -r : r);
+}
+
+static void _sortSwapRam(uint16 base, uint8 size, uint16 i, uint16 j) {
+	_hostRead(hostBuf[0], base + i * size, size);
+	_hostRead(hostBuf[1], base + j * size, size);
+	_hostWrite(base + i * size, hostBuf[1], size);
+	_hostWrite(base + j * size, hostBuf[0], size);
+}
+
+// Heapsort of the records in the emulated RAM, when they aren't contiguous on the host for qsort
+static void _sortRam(uint16 base, uint16 count, uint8 size) {
+	uint16 start = count / 2, end = count, root, child;
+
+	while (end > 1) {
+		if (start) {
+			--start;						// Building the heap
+		} else {
+			_sortSwapRam(base, size, 0, --end);	// Moving its top to the sorted end
+		}
+		for (root = start; (child = 2 * root + 1) < end; root = child) {
+			if (child + 1 < end && _sortCompareRam(base, size, child, child + 1) < 0)
+				++child;
+			if (_sortCompareRam(base, size, root, child) >= 0)
+				break;
+			_sortSwapRam(base, size, root, child);
+		}
+	}
+}
+
 uint8 hostbdos(uint16 dmaaddr) {
-	return(0x00);
+	uint8 fn = _RamRead(dmaaddr);
+	uint16 a1 = _RamRead16(dmaaddr + 2);
+	uint16 a2 = _RamRead16(dmaaddr + 4);
+	uint16 a3 = _RamRead16(dmaaddr + 6);
+	uint8 result = HS_ERROR;
+	uint8 *p, *q;
+
+	switch (fn) {
+		case HS_VERSION: {
+			_RamWrite16(dmaaddr + 2, HS_APIVERSION);
+			_RamWrite16(dmaaddr + 4, HS_COUNT);
+			result = HS_OK;
+			break;
+		}
+		case HS_MOVE: {
+			uint16 n, done;
+
+			if (_hostRange(a1, a3) && _hostRange(a2, a3)) {
+				if (a2 > a1 && a2 < a1 + a3) {		// Overlaps upwards, copied from the end through the bounce buffer
+					for (done = a3; done; done -= n) {
+						n = done < sizeof(hostBuf[0]) ? done : sizeof(hostBuf[0]);
+						_hostRead(hostBuf[0], a1 + done - n, n);
+						_hostWrite(a2 + done - n, hostBuf[0], n);
+					}
+				} else {
+					for (done = 0; done < a3; done += n) {
+						n = _hostSpan(a2 + done, _hostSpan(a1 + done, a3 - done));
+						memmove(_RamSysAddr(a2 + done), _RamSysAddr(a1 + done), n);
+					}
+				}
+				result = HS_OK;
+			}
+			break;
+		}
+		case HS_FILL: {
+			uint8 value = _RamRead(dmaaddr + 6);
+			uint16 n;
+
+			if (_hostRange(a1, a2)) {
+				for (; a2; a1 += n, a2 -= n) {
+					n = _hostSpan(a1, a2);
+					memset(_RamSysAddr(a1), value, n);
+				}
+				result = HS_OK;
+			}
+			break;
+		}
+		case HS_COMPARE: {
+			uint16 i;
+
+			if (_hostRange(a1, a3) && _hostRange(a2, a3)) {
+				i = _hostCompare(a1, a2, a3);
+				result = i < a3 ? HS_NOTFOUND : HS_OK;
+				_RamWrite16(dmaaddr + 8, i);
+			}
+			break;
+		}
+		case HS_SEARCH: {
+			uint16 plen = _RamRead16(dmaaddr + 8);
+			uint16 off, last, n;
+			uint8 first;
+
+			if (plen && plen <= a2 && _hostRange(a1, a2) && _hostRange(a3, plen)) {
+				result = HS_NOTFOUND;
+				first = _RamRead(a3);
+				last = a2 - plen;		// Last offset where the pattern fits
+				for (off = 0; off <= last; ) {
+					n = _hostSpan(a1 + off, (uint32)last - off + 1);
+					p = _RamSysAddr(a1 + off);
+					if (!(q = (uint8*)memchr(p, first, n))) {
+						off += n;
+						continue;
+					}
+					off += q - p;
+					if (_hostCompare(a1 + off, a3, plen) == plen) {	// The match may go on in the next span
+						_RamWrite16(dmaaddr + 10, off);
+						result = HS_OK;
+						break;
+					}
+					++off;
+				}
+			}
+			break;
+		}
+		case HS_CRC16: {
+			uint16 n;
+
+			if (_hostRange(a1, a2)) {
+				for (; a2; a1 += n, a2 -= n) {
+					n = _hostSpan(a1, a2);
+					a3 = _crc16(_RamSysAddr(a1), n, a3);
+				}
+				_RamWrite16(dmaaddr + 6, a3);
+				result = HS_OK;
+			}
+			break;
+		}
+		case HS_CRC32: {
+			uint32 crc = _RamRead32(dmaaddr + 6);
+			uint16 n;
+
+			if (_hostRange(a1, a2)) {
+				for (; a2; a1 += n, a2 -= n) {
+					n = _hostSpan(a1, a2);
+					crc = _crc32(_RamSysAddr(a1), n, crc);
+				}
+				_RamWrite32(dmaaddr + 6, crc);
+				result = HS_OK;
+			}
+			break;
+		}
+		case HS_SORT: {
+			uint8 size = _RamRead(dmaaddr + 6);
+			uint32 len = (uint32)a2 * size;
+
+			sortKeyOff = _RamRead(dmaaddr + 7);
+			sortKeyLen = _RamRead(dmaaddr + 8);
+			sortDesc = _RamRead(dmaaddr + 9) & 1;
+			if (size && sortKeyOff + sortKeyLen <= size && len < 0x10000UL && _hostRange(a1, len)) {
+				if (_hostSpan(a1, len) == len) {
+					qsort(_RamSysAddr(a1), a2, size, _sortCompare);
+				} else {
+					_sortRam(a1, a2, size);
+				}
+				result = HS_OK;
+			}
+			break;
+		}
+		case HS_MUL32: {
+			_RamWrite32(dmaaddr + 10, _RamRead32(dmaaddr + 2) * _RamRead32(dmaaddr + 6));
+			result = HS_OK;
+			break;
+		}
+		case HS_DIV32: {
+			uint32 a = _RamRead32(dmaaddr + 2);
+			uint32 b = _RamRead32(dmaaddr + 6);
+
+			if (b) {
+				_RamWrite32(dmaaddr + 10, a / b);
+				_RamWrite32(dmaaddr + 14, a % b);
+				result = HS_OK;
+			}
+			break;
+		}
+		default: {
+			break;
+		}
+	}
+	_RamWrite(dmaaddr + 1, result);
+	return(result);
 }
 
 #endif
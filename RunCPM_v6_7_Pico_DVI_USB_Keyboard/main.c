@@ -34,34 +34,64 @@ should be kept the same.
 
 // AUX: device configuration
 #ifdef USE_PUN
-FILE* pun_dev;
-int pun_open = FALSE;
+MACHINE_LOCAL FILE* pun_dev;
+MACHINE_LOCAL int pun_open = FALSE;
 #endif
 
 // PRT: device configuration
 #ifdef USE_LST
-FILE* lst_dev;
-int lst_open = FALSE;
+MACHINE_LOCAL FILE* lst_dev;
+MACHINE_LOCAL int lst_open = FALSE;
+#endif
+
+// Binary trace file
+#ifdef TRACE
+MACHINE_LOCAL FILE* trace_dev;
+MACHINE_LOCAL int trace_open = FALSE;
+#endif
+
+// Machine snapshot file
+#ifdef SNAPSHOT
+MACHINE_LOCAL FILE* snap_dev;
+#endif
+
+// Session record/replay file
+#ifdef REPLAY
+MACHINE_LOCAL FILE* replay_dev;
 #endif
 
 #include "ram.h"		// ram.h - Implements the RAM
+#ifdef REPLAY
+#include "replay.h"		// replay.h - Records or replays the inputs of a session
+#endif
 #include "console.h"	// console.h - Defines all the console abstraction functions
 #include "cpu.h"		// cpu.h - Implements the emulated CPU
+#ifdef COMCACHE
+#include "comcache.h"	// comcache.h - Resident .COM image cache
+#endif
 #include "disk.h"		// disk.h - Defines all the disk access abstraction functions
 #include "host.h"		// host.h - Custom host-specific BDOS call
+#include "clock.h"		// clock.h - Date and time kept in CP/M format
+#ifdef TRACE
+#include "trace.h"	// trace.h - Binary BIOS/BDOS call trace
+#endif
 #include "cpm.h"		// cpm.h - Defines the CPM structures and calls
+#ifdef SNAPSHOT
+#include "snap.h"		// snap.h - Saves and resumes the whole machine
+#endif
 #ifdef CCP_INTERNAL
 #include "ccp.h"		// ccp.h - Defines a simple internal CCP
 #endif
 
-int main(int argc, char* argv[]) {
+// Runs one machine until CP/M is ended (EXIT or BIOS 0)
+void _runcpm(void) {
+	uint8 ended = FALSE;	// Set when a resumed session ends CP/M on its own
 
 #ifdef DEBUGLOG
 	_sys_deletefile((uint8*)LogName);
 #endif
 
 #ifdef STREAMIO
-	_host_init(argc, &argv[0]);
 	_streamioInit();
 #endif
 	_console_init();
@@ -84,6 +114,7 @@ int main(int argc, char* argv[]) {
 	_puts("\r\n");
 #endif
 #if BANKS > 1
+	_RamInit();
 	_puts("Banked Memory: ");
 	_puthex8(BANKS);
 	_puts(" banks\r\n");
@@ -92,7 +123,13 @@ int main(int argc, char* argv[]) {
 #ifdef ABDOS
 	_PatchBIOS();
 #endif
-	while (TRUE) {
+#ifdef REPLAY
+	_replayOpen();
+#endif
+#ifdef SNAPSHOT
+	ended = _snapResume();	// Carries on with a saved session, if there is one
+#endif
+	while (!ended) {
 		_puts(CCPHEAD);
 		_PatchCPM();		// Patches the CP/M entry points and other things in
 		Status = 0;
@@ -107,6 +144,11 @@ int main(int argc, char* argv[]) {
 
 		// Loads an autoexec file if it exists and this is the first boot
 		// The file contents are loaded at ccpAddr+8 up to 126 bytes then the size loaded is stored at ccpAddr+7
+#ifdef SNAPSHOT
+		if (snapResumed)	// A resumed session doesn't run the autoexec again
+			snapResumed = FALSE;
+		else
+#endif
 		if (firstBoot) {
 			if (_sys_exists((uint8*)AUTOEXEC)) {
 				uint16 cmd = CCPaddr + 8;
@@ -141,15 +183,57 @@ int main(int argc, char* argv[]) {
 #ifdef USE_LST
 		if (lst_dev)
 			_sys_fflush(lst_dev);
+#endif
+#ifdef TRACE
+		_traceFlush();
 #endif
 	}
+#ifdef TRACE
+	_traceFlush();
+#endif
+#ifdef REPLAY
+	_replayClose();
+#endif
 
 	_puts("\r\n");
 	_console_reset();
 #ifdef STREAMIO
 	_streamioReset();
 #endif
+}
+
+#ifdef MULTIMACHINE
+// Closes the devices of a machine once it has ended, however it ended
+void _runcpm_close(void) {
+#ifdef USE_PUN
+	if (pun_dev)
+		_sys_fclose(pun_dev);
+	pun_dev = NULL;
+#endif
+#ifdef USE_LST
+	if (lst_dev)
+		_sys_fclose(lst_dev);
+	lst_dev = NULL;
+#endif
+#ifdef TRACE
+	_traceFlush();
+	if (trace_dev)
+		_sys_fclose(trace_dev);
+	trace_dev = NULL;
+#endif
+}
+#endif
+
+int main(int argc, char* argv[]) {
+#ifdef STREAMIO
+	_host_init(argc, &argv[0]);
+#endif
+#ifdef MULTIMACHINE
+	return(_host_run(_runcpm, _runcpm_close) ? 1 : 0);	// One thread per machine or batch job
+#else
+	_runcpm();
 	return(0);
+#endif
 }
 
 #endif
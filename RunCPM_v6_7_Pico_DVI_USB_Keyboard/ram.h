@@ -3,39 +3,74 @@
 
 /* see main.c for definition */
 
+/*
+	Banked memory (BANKS > 1)
+
+	Each bank is a 64K block of RAM, bank 1 first. The Z80 address space is seen through a
+	table of 16 pages of 4K, each entry pointing at the block the page comes from (biased so
+	it is indexed by the full address), so an access is a shift and an indexed load.
+	Pages from COMMONBASE up always come from bank 1: this is the common memory holding the
+	CCP, BDOS and BIOS. Selecting a bank only rewrites the entries of the pages below it.
+
+	With BANKSTORE the banks live in a backing store instead (PSRAM on the RP2350, reached
+	through _sys_bankread/_sys_bankwrite) and only BANKSTORE page frames of 4K are kept in
+	SRAM: the common memory, the pages of the selected bank and the most recently used pages
+	of the others. Selecting a bank maps the pages already in SRAM and loads the others,
+	evicting the least recently used frames not in use. A frame is written back only if it
+	is dirty, which is the case once its page has been written or handed out as a pointer.
+*/
+
 #ifndef RAM_FAST
-static uint8 RAM[MEMSIZE];			// Definition of the emulated RAM
+#ifdef BANKSTORE
+#if BANKSTORE < 20
+#error "BANKSTORE needs at least 20 frames (one bank, the common memory and room to page)"
+#endif
+
+typedef struct {
+	uint8	bank;					// Bank and page held (bank 0 = free or common memory)
+	uint8	page;
+	uint8	mapped;					// In the page table, never evicted
+	uint8	dirty;					// Differs from the store
+	uint32	used;					// Last use, for LRU eviction
+} RAMFRAME;
+
+static MACHINE_LOCAL uint8	ramFrame[BANKSTORE][0x1000];	// The page frames (SRAM)
+static MACHINE_LOCAL RAMFRAME	ramFrameInfo[BANKSTORE];
+static MACHINE_LOCAL uint8	ramResident[BANKS][16];			// Frame + 1 holding each page of each bank, 0 if none
+static MACHINE_LOCAL uint8	ramPageFrame[16];				// Frame mapped at each page
+static MACHINE_LOCAL uint8*	ramPage[16];
+static MACHINE_LOCAL uint16	ramDirty = 0;					// Pages written since the dirty bits were last collected
+static MACHINE_LOCAL uint32	ramClock = 0;
+static MACHINE_LOCAL uint8	ramLastFrame = 0xff;			// Frame returned by the last _RamBankAddr, kept by the next
+static MACHINE_LOCAL uint32	ramPageIns = 0;					// Paging statistics
+static MACHINE_LOCAL uint32	ramPageOuts = 0;
+
+#define _RamPtr(a)	(ramPage[(a) >> 12] + ((a) & 0x0fff))
+#define _RamTouch(a)	ramDirty |= 1 << ((a) >> 12)
+#else
+static MACHINE_LOCAL uint8 RAM[MEMSIZE];			// Definition of the emulated RAM
+static MACHINE_LOCAL uint8* ramPage[16];			// Set by _RamInit, RAM isn't a constant when it is per thread
+
+#define _RamPtr(a)	(ramPage[(a) >> 12] + (a))
+#define _RamTouch(a)
+#endif
 
 uint8* _RamSysAddr(uint16 address) {
-	if (address < CCPaddr) {
-		return(&RAM[address * curBank]);
-	} else {
-		return(&RAM[address]);
-	}
+	_RamTouch(address);
+	return(_RamPtr(address));
 }
 
 uint8 _RamRead(uint16 address) {
-	if (address < CCPaddr) {
-		return(RAM[address * curBank]);
-	} else {
-		return(RAM[address]);
-	}
+	return(*_RamPtr(address));
 }
 
 uint16 _RamRead16(uint16 address) {
-	if (address < CCPaddr) {
-		return(RAM[address * curBank] + (RAM[(address * curBank) + 1] << 8));
-	} else {
-		return(RAM[address] + (RAM[address + 1] << 8));
-	}
+	return(_RamRead(address) | (_RamRead(address + 1) << 8));
 }
 
 void _RamWrite(uint16 address, uint8 value) {
-	if (address < CCPaddr) {
-		RAM[address * curBank] = value;
-	} else {
-		RAM[address] = value;
-	}
+	_RamTouch(address);
+	*_RamPtr(address) = value;
 }
 
 void _RamWrite16(uint16 address, uint16 value) {
@@ -43,6 +78,157 @@ void _RamWrite16(uint16 address, uint16 value) {
 	_RamWrite(address, value & 0xff);
 	_RamWrite(address + 1, (value >> 8) & 0xff);
 }
+
+#ifdef BANKSTORE
+// Moves the dirty bits of the mapped pages onto their frames
+static void _RamCollectDirty(void) {
+	uint8 i;
+
+	for (i = 0; ramDirty; ++i, ramDirty >>= 1)
+		if (ramDirty & 1)
+			ramFrameInfo[ramPageFrame[i]].dirty = TRUE;
+}
+
+// Returns the frame holding a page of a bank, loading it from the store if needed
+// Mapped frames and the frame in keep are never evicted
+static uint8 _RamFrame(uint8 bank, uint8 page, uint8 keep) {
+	uint8 f = ramResident[bank - 1][page];
+	RAMFRAME* e;
+	uint8 i;
+
+	if (f) {
+		ramFrameInfo[f - 1].used = ++ramClock;
+		return(f - 1);
+	}
+	_RamCollectDirty();
+	for (i = 0; i < BANKSTORE; ++i) {
+		e = &ramFrameInfo[i];
+		if (e->mapped || i == keep)
+			continue;
+		if (!e->bank) {
+			f = i + 1;
+			break;
+		}
+		if (!f || e->used < ramFrameInfo[f - 1].used)
+			f = i + 1;
+	}
+	e = &ramFrameInfo[--f];
+	if (e->bank) {
+		if (e->dirty) {
+			_sys_bankwrite((uint32)(e->bank - 1) * PAGESIZE + ((uint32)e->page << 12), ramFrame[f], 0x1000);
+			++ramPageOuts;
+		}
+		ramResident[e->bank - 1][e->page] = 0;
+	}
+	_sys_bankread((uint32)(bank - 1) * PAGESIZE + ((uint32)page << 12), ramFrame[f], 0x1000);
+	++ramPageIns;
+	e->bank = bank;
+	e->page = page;
+	e->dirty = FALSE;
+	e->used = ++ramClock;
+	ramResident[bank - 1][page] = f + 1;
+	return(f);
+}
 #endif
 
+// Maps a bank (1 to BANKS) below the common memory, other numbers are ignored
+void _RamSelect(uint8 bank) {
+	uint8 i;
+
+	if (bank < 1 || bank > BANKS)
+		return;
+	curBank = bank;
+#ifdef BANKSTORE
+	_RamCollectDirty();
+	for (i = 0; i < (COMMONBASE >> 12); ++i) {
+		ramFrameInfo[ramPageFrame[i]].mapped = FALSE;
+		ramPageFrame[i] = _RamFrame(bank, i, 0xff);
+		ramFrameInfo[ramPageFrame[i]].mapped = TRUE;
+		ramPage[i] = ramFrame[ramPageFrame[i]];
+	}
+#else
+	for (i = 0; i < (COMMONBASE >> 12); ++i)
+		ramPage[i] = RAM + (uint32)(bank - 1) * PAGESIZE;
+#endif
+}
+
+// Sets up the memory, bank 1 selected
+void _RamInit(void) {
+#ifdef BANKSTORE
+	uint8 i;
+
+	for (i = 0; i < 16; ++i) {				// The common memory takes the first frames for good
+		ramPageFrame[i] = i;
+		ramPage[i] = ramFrame[i];
+		ramFrameInfo[i].mapped = TRUE;
+	}
+	for (i = 0; i < (COMMONBASE >> 12); ++i)	// and bank 1 is loaded in place of the rest
+		ramFrameInfo[i].mapped = FALSE;
+#else
+	uint8 i;
+
+	for (i = 0; i < 16; ++i)				// The common memory is that of bank 1
+		ramPage[i] = RAM;
+#endif
+	_RamSelect(1);
+}
+#endif
+
+// Host address of a byte of any bank (with BANKSTORE, valid until the next call but one)
+uint8* _RamBankAddr(uint8 bank, uint16 address, uint8 write) {
+#ifdef RAM_FAST
+	return(RAM + address);
+#else
+	if (address < COMMONBASE && bank >= 1 && bank <= BANKS) {
+#ifdef BANKSTORE
+		ramLastFrame = _RamFrame(bank, address >> 12, ramLastFrame);
+		if (write)
+			ramFrameInfo[ramLastFrame].dirty = TRUE;
+		return(ramFrame[ramLastFrame] + (address & 0x0fff));
+#else
+		return(RAM + (uint32)(bank - 1) * PAGESIZE + address);
+#endif
+	}
+	if (write)
+		_RamTouch(address);
+	return(_RamPtr(address));
+#endif
+}
+
+// Moves a block between banks as the BIOS MOVE does (an LDIR, so overlapping forward moves replicate)
+void _RamMove(uint8 dstBank, uint16 dst, uint8 srcBank, uint16 src, uint16 len) {
+	uint8 *d, *s;
+	uint32 n;
+
+	while (len) {
+		n = len;
+#ifdef BANKSTORE
+		if (n > 0x1000UL - (dst & 0x0fff))						// Stops at the end of either page
+			n = 0x1000UL - (dst & 0x0fff);
+		if (n > 0x1000UL - (src & 0x0fff))
+			n = 0x1000UL - (src & 0x0fff);
+#else
+		if (dst < COMMONBASE && n > (uint32)(COMMONBASE - dst))	// Stops where either side reaches
+			n = COMMONBASE - dst;								// the common memory or wraps
+		if (src < COMMONBASE && n > (uint32)(COMMONBASE - src))
+			n = COMMONBASE - src;
+		if (n > 0x10000UL - dst)
+			n = 0x10000UL - dst;
+		if (n > 0x10000UL - src)
+			n = 0x10000UL - src;
+#endif
+		s = _RamBankAddr(srcBank, src, FALSE);
+		d = _RamBankAddr(dstBank, dst, TRUE);
+		if (d > s && d < s + n) {
+			n = 1;
+			*d = *s;
+		} else {
+			memmove(d, s, n);									// A move down may overlap, it copies as an LDIR would
+		}
+		dst += n;
+		src += n;
+		len -= n;
+	}
+}
+
 #endif
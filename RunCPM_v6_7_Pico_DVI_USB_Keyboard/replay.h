@@ -0,0 +1,244 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+	Session record and replay (REPLAY)
+
+	Every input the machine takes from outside is logged to ReplayName along with the
+	number of instructions executed when it was taken: the console characters (_getch)
+	and the console status polls that found one (_kbhit), the millis() and micros() reads
+	of F_UPTIME, F_UPTIMEUS and the clock, the date and time the clock was seeded with, the
+	free card space and the _HardwareIn values. When the session ends the memory of every
+	bank and the files of every drive are hashed into two closing records.
+
+	If ReplayName is there at boot the session is replayed from it instead: each input is
+	handed back at the same instruction, so the session runs again exactly as recorded,
+	without anyone typing, and at its end the hashes are checked. A replay that asks for
+	an input of another kind, or at another point, has diverged; it is reported and the
+	rest of the session runs live. Console polls that found nothing are not logged, a
+	replayed poll only finds the key that was due at that instruction.
+
+	The recording covers what the machine reads, not the host it runs on: replay it on a
+	copy of the drive folders it started from (-r on POSIX shares one), on the same file
+	system so directory searches list the files in the same order. Host timings given to
+	programs (BDOS call 235) and the -i console script, which is read before _getch and
+	is replayed by giving it again, are not logged.
+*/
+
+#define RP_KBHIT	1					// Record kinds
+#define RP_GETCH	2
+#define RP_MILLIS	3
+#define RP_MICROS	4
+#define RP_CLOCK	5					// Seeded date and time, day << 17 | seconds
+#define RP_FREE		6
+#define RP_PORT		7
+#define RP_RAM		8					// Closing hashes
+#define RP_FILES	9
+
+#define REPLAY_OFF		0				// Modes
+#define REPLAY_RECORD	1
+#define REPLAY_PLAY		2
+#define REPLAY_LIVE		3				// Replay past its inputs, or diverged: waits for the end to be checked
+
+typedef struct {						// 16 bytes, little endian (as written by the host)
+	unsigned long long at;				// Instructions executed when the input was taken
+	uint32	value;
+	uint8	kind;						// RP_xxx
+	uint8	pad[3];
+} REPLAYREC;
+
+static const char replayMagic[16] = "RunCPM replay";
+static MACHINE_LOCAL uint8		replayMode = REPLAY_OFF;
+static MACHINE_LOCAL REPLAYREC	replayNext;		// Next record to be replayed
+static MACHINE_LOCAL uint8		replayMore = FALSE;	// replayNext holds a record
+static MACHINE_LOCAL uint8		replayDiverged = FALSE;
+static MACHINE_LOCAL uint32	replayCount = 0;	// Inputs recorded or replayed
+
+static void _replayPut(uint8 kind, uint32 value) {
+	REPLAYREC r;
+
+	memset(&r, 0, sizeof(r));
+	r.at = runStats.instructions;
+	r.value = value;
+	r.kind = kind;
+	_sys_fwrite((uint8*)&r, sizeof(r), replay_dev);
+	++replayCount;
+}
+
+static void _replayFetch(void) {
+	replayMore = _sys_fread((uint8*)&replayNext, sizeof(REPLAYREC), replay_dev) == sizeof(REPLAYREC);
+}
+
+// The replayed program asks for something the recorded one didn't, or not there
+static void _replayDiverge(void) {
+	char line[96];
+
+	sprintf(line, "\r\nReplay diverged at instruction %llu, input %lu\r\n", runStats.instructions, (unsigned long)replayCount + 1);
+	_puts(line);
+	replayDiverged = TRUE;
+	replayMode = REPLAY_LIVE;
+}
+
+// Takes the next record if it is an input of this kind due now. A read (must) diverges otherwise, a poll only if it was due earlier
+static uint8 _replayTake(uint8 kind, uint32* value, uint8 must) {
+	if (replayMore && replayNext.kind == kind && replayNext.at == runStats.instructions) {
+		*value = replayNext.value;
+		++replayCount;
+		_replayFetch();
+		return(TRUE);
+	}
+	if (must) {
+		if (replayMore && replayNext.kind == RP_RAM && replayNext.at == runStats.instructions && kind == RP_GETCH)
+			replayMode = REPLAY_LIVE;		// Where the recorded console input came to its end
+		else
+			_replayDiverge();
+	} else if (replayMore && replayNext.at < runStats.instructions) {
+		_replayDiverge();
+	}
+	return(FALSE);
+}
+
+// The value read, or the one replayed in its place
+#define REPLAYED(kind, live) _replayRead(kind, live)
+
+uint32 _replayRead(uint8 kind, uint32 live) {
+	uint32 value;
+
+	if (replayMode == REPLAY_RECORD)
+		_replayPut(kind, live);
+	else if (replayMode == REPLAY_PLAY && _replayTake(kind, &value, TRUE))
+		return(value);
+	return(live);
+}
+
+int _replayKbhit(void) {
+	uint32 value;
+	int result;
+
+	if (replayMode == REPLAY_PLAY) {
+		if (_replayTake(RP_KBHIT, &value, FALSE))
+			return(value);
+		if (replayMode == REPLAY_PLAY)
+			return(0);
+	}
+	result = _kbhit();
+	if (result && replayMode == REPLAY_RECORD)
+		_replayPut(RP_KBHIT, result);
+	return(result);
+}
+
+uint8 _replayGetch(void) {
+	uint32 value;
+	uint8 ch;
+
+	if (replayMode == REPLAY_PLAY && _replayTake(RP_GETCH, &value, TRUE))
+		return(value);
+	ch = _getch();
+	if (replayMode == REPLAY_RECORD)
+		_replayPut(RP_GETCH, ch);
+	return(ch);
+}
+
+#ifdef STREAMIO
+void _replayAbortIfEof(void) {
+	if (replayMode != REPLAY_PLAY)		// The replayed input is still to come
+		_abort_if_kbd_eof();
+}
+#endif
+
+// FNV-1a hash of the memory of every bank
+static uint32 _replayRamHash(void) {
+	uint32 h = 2166136261UL;
+	uint8* p;
+	uint8 bank, page;
+	uint16 i;
+
+	for (bank = 1; bank <= BANKS; ++bank) {
+		page = 0;
+		do {
+			if (bank > 1 && ((uint16)page << 8) >= COMMONBASE)	// The common memory is hashed with bank 1
+				break;
+			p = _RamBankAddr(bank, (uint16)page << 8, FALSE);
+			for (i = 0; i < 256; ++i)
+				h = (h ^ p[i]) * 16777619UL;
+		} while (++page);
+	}
+	return(h);
+}
+
+// Hash of the files of every drive
+static uint32 _replayFilesHash(void) {
+	uint32 h = 0;
+	uint8 drive;
+
+	for (drive = 'A'; drive <= 'P'; ++drive)
+		h += _sys_drivehash(drive);
+	return(h);
+}
+
+// Replays ReplayName if it is there, otherwise records the session to it
+void _replayOpen(void) {
+	char magic[16];
+
+	if (_sys_exists((uint8*)ReplayName)) {
+		replay_dev = _sys_fopen_r((uint8*)ReplayName);
+		if (!replay_dev)
+			return;
+		if (_sys_fread((uint8*)magic, sizeof(magic), replay_dev) != sizeof(magic) || memcmp(magic, replayMagic, sizeof(magic))) {
+			_sys_fclose(replay_dev);
+			_puts(ReplayName " is not a session recording, ignored\r\n");
+			return;
+		}
+		_replayFetch();
+		replayMode = REPLAY_PLAY;
+		_puts("Replaying the session in " ReplayName "\r\n");
+	} else {
+		replay_dev = _sys_fopen_w((uint8*)ReplayName);
+		if (!replay_dev)
+			return;
+		_sys_fwrite((const uint8*)replayMagic, sizeof(replayMagic), replay_dev);
+		replayMode = REPLAY_RECORD;
+		_puts("Recording the session to " ReplayName "\r\n");
+	}
+	replayCount = 0;
+	replayDiverged = FALSE;
+}
+
+// Ends the recording with the memory and file hashes, or checks them at the end of a replay
+void _replayClose(void) {
+	char line[160];
+	uint32 ram, files;
+
+	if (replayMode == REPLAY_OFF)
+		return;
+	ram = _replayRamHash();
+	files = _replayFilesHash();
+	if (replayMode == REPLAY_RECORD) {
+		sprintf(line, "\r\nRecorded %lu inputs over %llu instructions, RAM %08lX, files %08lX\r\n",
+			(unsigned long)replayCount, runStats.instructions, (unsigned long)ram, (unsigned long)files);
+		_replayPut(RP_RAM, ram);
+		_replayPut(RP_FILES, files);
+	} else if (replayDiverged) {
+		strcpy(line, "\r\nReplay FAILED, it diverged\r\n");
+	} else if (!replayMore || replayNext.kind != RP_RAM || replayNext.at != runStats.instructions) {
+		sprintf(line, "\r\nReplay FAILED, it ended at instruction %llu, not where the recording did\r\n", runStats.instructions);
+	} else if (replayNext.value != ram) {
+		sprintf(line, "\r\nReplay FAILED, RAM %08lX instead of %08lX\r\n", (unsigned long)ram, (unsigned long)replayNext.value);
+	} else if (_replayFetch(), !replayMore || replayNext.kind != RP_FILES || replayNext.value != files) {
+		sprintf(line, "\r\nReplay FAILED, files %08lX instead of %08lX\r\n", (unsigned long)files, replayMore ? (unsigned long)replayNext.value : 0UL);
+	} else {
+		sprintf(line, "\r\nReplay OK, %lu inputs over %llu instructions, RAM %08lX, files %08lX\r\n",
+			(unsigned long)replayCount, runStats.instructions, (unsigned long)ram, (unsigned long)files);
+	}
+	_puts(line);
+	_sys_fclose(replay_dev);
+	replayMode = REPLAY_OFF;
+}
+
+#define _kbhit _replayKbhit					// From here on the console input goes through the log
+#define _getch _replayGetch
+#ifdef STREAMIO
+#define _abort_if_kbd_eof _replayAbortIfEof
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+/*
+	Byte ring buffers used to decouple the console from the host devices.
+
+	Each buffer has a single producer and a single consumer, so the head is only
+	moved by the producer and the tail only by the consumer. The output queues
+	(txQueue, dispQueue) are filled by the emulator and emptied by a timer
+	interrupt, DMA completion, another core or a thread. The input queue (rxQueue)
+	runs the other way: the timer, core or thread serving the devices fills it and
+	the emulator empties it. RB_GROW is only for queues the emulator fills, as the
+	producer frees the old buffer. The platform may define RB_LOCK()/RB_UNLOCK()
+	before including this file; they are only taken on the slow paths (dropping,
+	growing and draining). tools/rbtest.c runs the policies on a host (make test).
+*/
+
+#ifndef RB_LOCK
+#define RB_LOCK()
+#define RB_UNLOCK()
+#endif
+
+#ifndef RB_BARRIER
+#define RB_BARRIER()	__sync_synchronize()
+#endif
+
+#ifndef RB_TIME
+#define RB_TIME()	0			// Microsecond clock used to account the time spent blocked
+#endif
+
+/* Overflow policies */
+#define RB_BLOCK	0		// Waits for the consumer to make room
+#define RB_DROP		1		// Discards the oldest queued bytes to make room
+#define RB_GROW		2		// Doubles the buffer up to maxSize, then blocks
+
+typedef struct {
+	uint8*	buf;
+	uint32	size;				// Always a power of two
+	uint32	maxSize;			// Largest size RB_GROW may reach
+	volatile uint32 head;		// Free running write index (producer)
+	volatile uint32 tail;		// Free running read index (consumer)
+	volatile uint32 busy;		// Bytes handed to the consumer by _rb_peek and not yet skipped
+	uint8*	retired;			// Previous buffer after a grow, freed by the producer
+	uint32	retiredSpan;		// Bytes the consumer was still reading from it when it was retired
+	uint8	policy;
+	uint32	dropped;			// Number of bytes discarded by RB_DROP
+	uint32	blocked;			// Microseconds the producer spent waiting for room
+	void	(*drain)(void);		// Called while waiting for room or for a flush
+} RINGBUF;
+
+// Allocates the buffer, size is rounded up to a power of two
+uint8 _rb_init(RINGBUF* q, uint32 size, uint8 policy, uint32 maxSize, void (*drain)(void)) {
+	uint32 s = 16;
+
+	while (s < size)
+		s <<= 1;
+	q->buf = (uint8*)malloc(s);
+	q->size = q->buf ? s : 0;
+	q->maxSize = maxSize < s ? s : maxSize;
+	q->head = q->tail = q->busy = 0;
+	q->retired = NULL;
+	q->retiredSpan = 0;
+	q->policy = policy;
+	q->dropped = 0;
+	q->blocked = 0;
+	q->drain = drain;
+	return(q->buf != NULL);
+}
+
+// Number of bytes waiting to be consumed
+uint32 _rb_count(RINGBUF* q) {
+	return(q->head - q->tail);
+}
+
+// Number of bytes that can be put without waiting
+uint32 _rb_free(RINGBUF* q) {
+	return(q->size - (q->head - q->tail));
+}
+
+// Doubles the buffer, must be called with the lock taken
+static uint8 _rb_grow(RINGBUF* q) {
+	uint32 n = q->head - q->tail;
+	uint32 i;
+	uint8* b;
+
+	if (q->size >= q->maxSize || q->retired)
+		return(FALSE);
+	if (!(b = (uint8*)malloc(q->size << 1)))
+		return(FALSE);
+	for (i = 0; i < n; ++i)
+		b[i] = q->buf[(q->tail + i) & (q->size - 1)];
+	q->retired = q->buf;	// A DMA transfer may still be reading from it
+	q->retiredSpan = q->busy;
+	q->buf = b;
+	q->size <<= 1;
+	q->tail = 0;
+	q->head = n;
+	return(TRUE);
+}
+
+// Frees the buffer retired by a grow once the consumer has released the span it was reading from it
+// This is left to the producer, as the consumer may be an interrupt handler where free() isn't safe
+static void _rb_reap(RINGBUF* q) {
+	uint8* b = NULL;
+
+	RB_LOCK();
+	if (q->retired && q->tail >= q->retiredSpan) {
+		b = q->retired;
+		q->retired = NULL;
+	}
+	RB_UNLOCK();
+	free(b);
+}
+
+// Makes room for at least one byte, according to the overflow policy
+static void _rb_room(RINGBUF* q) {
+	uint32 start = RB_TIME();
+
+	while (q->head - q->tail == q->size) {
+		if (q->retired)
+			_rb_reap(q);
+		if (q->policy != RB_BLOCK) {
+			uint8 done = FALSE;
+			RB_LOCK();
+			if (q->policy == RB_GROW) {
+				done = _rb_grow(q);
+			} else if (!q->busy) {
+				q->tail += q->size >> 2;	// Drops the oldest quarter at once
+				q->dropped += q->size >> 2;
+				done = TRUE;
+			}
+			RB_UNLOCK();
+			if (done) {
+				if (q->retired)
+					_rb_reap(q);
+				break;
+			}
+		}
+		if (q->drain)
+			q->drain();
+	}
+	q->blocked += RB_TIME() - start;
+}
+
+// Puts one byte
+void _rb_put(RINGBUF* q, uint8 ch) {
+	if (q->head - q->tail == q->size)
+		_rb_room(q);
+	q->buf[q->head & (q->size - 1)] = ch;
+	RB_BARRIER();
+	++q->head;
+}
+
+// Puts a block of bytes, copying whole spans when there's room
+void _rb_write(RINGBUF* q, const uint8* data, uint32 len) {
+	uint32 n, pos;
+
+	while (len) {
+		if (q->head - q->tail == q->size)
+			_rb_room(q);
+		pos = q->head & (q->size - 1);
+		n = _rb_free(q);
+		if (n > q->size - pos)
+			n = q->size - pos;		// Up to the end of the buffer
+		if (n > len)
+			n = len;
+		memcpy(&q->buf[pos], data, n);
+		RB_BARRIER();
+		q->head += n;
+		data += n;
+		len -= n;
+	}
+}
+
+// Gets one byte, or -1 if the buffer is empty
+int _rb_get(RINGBUF* q) {
+	uint8 ch;
+
+	if (q->head == q->tail)
+		return(-1);
+	ch = q->buf[q->tail & (q->size - 1)];
+	RB_BARRIER();
+	++q->tail;
+	return(ch);
+}
+
+// Returns the longest contiguous readable span (up to max bytes) for a bulk consumer
+// The bytes stay in the buffer until released with _rb_skip
+uint32 _rb_peek(RINGBUF* q, uint8** data, uint32 max) {
+	uint32 pos = q->tail & (q->size - 1);
+	uint32 n = q->head - q->tail;
+
+	if (n > q->size - pos)
+		n = q->size - pos;
+	if (n > max)
+		n = max;
+	*data = &q->buf[pos];
+	q->busy = n;
+	return(n);
+}
+
+// Releases bytes obtained with _rb_peek
+void _rb_skip(RINGBUF* q, uint32 n) {
+	RB_BARRIER();
+	q->tail += n;
+	q->busy = 0;
+}
+
+// Waits until the consumer has taken everything
+void _rb_flush(RINGBUF* q) {
+	while (q->head != q->tail || q->busy) {
+		if (q->drain)
+			q->drain();
+	}
+}
+
+#endif
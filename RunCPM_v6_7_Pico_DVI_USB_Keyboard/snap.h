@@ -0,0 +1,227 @@
+#ifndef SNAP_H
+#define SNAP_H
+
+/*
+	Machine snapshots (SNAPSHOT)
+
+	A snapshot holds the whole machine in SnapName: the memory of every bank, the Z80
+	registers and the BDOS state (DMA address, drive, user, login and read only vectors,
+	bank selections and the LST: and PUN: files in use). It is saved by the CCP SNAP
+	command, or by typing SNAPKEY (if not 0) while a program waits for a key. The latter is taken as
+	of the start of the BDOS or BIOS call being served: the registers are the ones it was
+	entered with and the PC points at its trap (see cpu.h), so once resumed the program
+	makes the same call again and waits for its key as it did. At the next boot the
+	snapshot is read back in one pass and deleted, and the session carries on.
+
+	Memory goes in 256 byte pages, each a tag followed by the page, or by a single byte
+	when the page is all that byte (zeroed or never used memory), so a mostly empty
+	machine takes a few KB.
+*/
+
+#define SNAP_FILL	0x00				// Page tags
+#define SNAP_RAW	0x01
+
+typedef struct {
+	char	magic[16];
+	uint16	layout[4];					// BIOSjmppage, BDOSjmppage, CCPaddr and BANKS of the build that saved it
+	uint32	trap;						// PC of the BDOS/BIOS trap being served, 0 if saved from the internal CCP
+	int32	reg[14];					// AF BC DE HL IX IY PC SP AF1 BC1 DE1 HL1 IFF IR
+	uint16	dmaAddr, roVector, loginVector;
+	uint8	cDrive, oDrive, userCode, mask8bit;
+	uint8	curBank, srcBank, dstBank, ioBank, isXmove;
+	uint8	lstOpen, punOpen;
+	char	lstFile[17], punFile[17];
+} SNAPSTATE;
+
+static const char snapMagic[16] = "RunCPM snapshot";
+static MACHINE_LOCAL uint8 snapResumed = FALSE;		// Set when a session was resumed, until the CCP picks it up
+
+static void _snapLayout(uint16* layout) {
+	layout[0] = BIOSjmppage;
+	layout[1] = BDOSjmppage;
+	layout[2] = CCPaddr;
+	layout[3] = BANKS;
+}
+
+// Saves the machine to SnapName, returns FALSE if it can't be written
+uint8 _snapSave(void) {
+	SNAPSTATE s;
+	uint8 tag[2];
+	uint8* p;
+	uint8 bank, page;
+	uint8 result;
+
+	memset(&s, 0, sizeof(s));
+	memcpy(s.magic, snapMagic, sizeof(s.magic));
+	_snapLayout(s.layout);
+	s.trap = snapTrap;
+	s.reg[0] = snapTrap ? snapAF : AF;
+	s.reg[1] = snapTrap ? snapBC : BC;
+	s.reg[2] = snapTrap ? snapDE : DE;
+	s.reg[3] = snapTrap ? snapHL : HL;
+	s.reg[4] = IX;
+	s.reg[5] = IY;
+	s.reg[6] = snapTrap;
+	s.reg[7] = SP;
+	s.reg[8] = AF1;
+	s.reg[9] = BC1;
+	s.reg[10] = DE1;
+	s.reg[11] = HL1;
+	s.reg[12] = IFF;
+	s.reg[13] = IR;
+	s.dmaAddr = dmaAddr;
+	s.roVector = roVector;
+	s.loginVector = loginVector;
+	s.cDrive = cDrive;
+	s.oDrive = oDrive;
+	s.userCode = userCode;
+	s.mask8bit = mask8bit;
+	s.curBank = curBank;
+	s.srcBank = srcBank;
+	s.dstBank = dstBank;
+	s.ioBank = ioBank;
+	s.isXmove = isXmove;
+#ifdef USE_LST
+	s.lstOpen = lst_open && lst_dev;
+	if (s.lstOpen)
+		_sys_fflush(lst_dev);					// The resumed session appends to what is there now
+	memcpy(s.lstFile, lst_file, sizeof(s.lstFile));
+#endif
+#ifdef USE_PUN
+	s.punOpen = pun_open && pun_dev;
+	if (s.punOpen)
+		_sys_fflush(pun_dev);
+	memcpy(s.punFile, pun_file, sizeof(s.punFile));
+#endif
+
+	_sys_deletefile((uint8*)SnapName);
+	snap_dev = _sys_fopen_w((uint8*)SnapName);
+	if (!snap_dev)
+		return(FALSE);
+	result = _sys_fwrite((uint8*)&s, sizeof(s), snap_dev) == sizeof(s);
+	for (bank = 1; bank <= BANKS && result; ++bank) {
+		page = 0;
+		do {
+			if (bank > 1 && ((uint16)page << 8) >= COMMONBASE)	// The common memory is saved with bank 1
+				break;
+			p = _RamBankAddr(bank, (uint16)page << 8, FALSE);
+			if (!memcmp(p, p + 1, 255)) {
+				tag[0] = SNAP_FILL;
+				tag[1] = *p;
+				result = _sys_fwrite(tag, 2, snap_dev) == 2;
+			} else {
+				tag[0] = SNAP_RAW;
+				result = _sys_fwrite(tag, 1, snap_dev) == 1 && _sys_fwrite(p, 256, snap_dev) == 256;
+			}
+		} while (++page && result);
+	}
+	_sys_fclose(snap_dev);
+	if (!result)
+		_sys_deletefile((uint8*)SnapName);
+	return(result);
+}
+
+// Resumes the session saved in SnapName, if there is one, and deletes it
+// Returns TRUE if the resumed program ended CP/M (BIOS 0) before giving control back
+uint8 _snapResume(void) {
+	SNAPSTATE s;
+	uint16 layout[4];
+	uint8 tag[2];
+	uint8* p;
+	uint8 bank, page;
+	uint8 result;
+
+	if (!_sys_exists((uint8*)SnapName))
+		return(FALSE);
+	snap_dev = _sys_fopen_r((uint8*)SnapName);
+	if (!snap_dev)
+		return(FALSE);
+	_snapLayout(layout);
+	if (_sys_fread((uint8*)&s, sizeof(s), snap_dev) != sizeof(s) || memcmp(s.magic, snapMagic, sizeof(s.magic)) ||
+		memcmp(s.layout, layout, sizeof(layout))) {
+		_sys_fclose(snap_dev);
+		_puts("Snapshot " SnapName " is not from this build, ignored\r\n");
+		return(FALSE);
+	}
+
+	_PatchCPM();								// Sets up the BDOS, then the memory goes on top
+	result = TRUE;
+	for (bank = 1; bank <= BANKS && result; ++bank) {
+		page = 0;
+		do {
+			if (bank > 1 && ((uint16)page << 8) >= COMMONBASE)
+				break;
+			p = _RamBankAddr(bank, (uint16)page << 8, TRUE);
+			if ((result = _sys_fread(tag, 1, snap_dev) == 1)) {
+				if (tag[0] == SNAP_FILL) {
+					if ((result = _sys_fread(tag + 1, 1, snap_dev) == 1))
+						memset(p, tag[1], 256);
+				} else {
+					result = _sys_fread(p, 256, snap_dev) == 256;
+				}
+			}
+		} while (++page && result);
+	}
+	_sys_fclose(snap_dev);
+	_sys_deletefile((uint8*)SnapName);
+	if (!result) {
+		_puts("Snapshot " SnapName " is truncated, CP/M restarted\r\n");
+		return(FALSE);
+	}
+
+	dmaAddr = s.dmaAddr;
+	roVector = s.roVector;
+	loginVector = s.loginVector;
+	cDrive = s.cDrive;
+	oDrive = s.oDrive;
+	userCode = s.userCode;
+	mask8bit = s.mask8bit;
+	srcBank = s.srcBank;
+	dstBank = s.dstBank;
+	ioBank = s.ioBank;
+	isXmove = s.isXmove;
+#ifdef RAM_FAST
+	curBank = s.curBank;
+#else
+	_RamSelect(s.curBank);
+#endif
+#ifdef USE_LST
+	memcpy(lst_file, s.lstFile, sizeof(s.lstFile));
+	if (s.lstOpen) {
+		lst_dev = _sys_fopen_a((uint8*)lst_file);
+		lst_open = TRUE;
+	}
+#endif
+#ifdef USE_PUN
+	memcpy(pun_file, s.punFile, sizeof(s.punFile));
+	if (s.punOpen) {
+		pun_dev = _sys_fopen_a((uint8*)pun_file);
+		pun_open = TRUE;
+	}
+#endif
+	snapResumed = TRUE;
+	_puts("Session resumed from " SnapName "\r\n");
+
+	if (s.trap) {								// A program was waiting for a key: it asks again
+		AF = s.reg[0];
+		BC = s.reg[1];
+		DE = s.reg[2];
+		HL = s.reg[3];
+		IX = s.reg[4];
+		IY = s.reg[5];
+		PC = s.reg[6];
+		SP = s.reg[7];
+		AF1 = s.reg[8];
+		BC1 = s.reg[9];
+		DE1 = s.reg[10];
+		HL1 = s.reg[11];
+		IFF = s.reg[12];
+		IR = s.reg[13];
+		Status = 0;
+		Z80run();
+		return(Status == 1);
+	}
+	return(FALSE);
+}
+
+#endif
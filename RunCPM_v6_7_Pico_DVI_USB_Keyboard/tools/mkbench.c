@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: MIT
+
+/*
+	mkbench - Writes the RunCPM benchmark suite into a drive folder tree
+
+	Build: cc -o mkbench mkbench.c
+	Usage: mkbench <dir>
+	       <dir> holds the drive folders: the SD card root on the Pico, the -d
+	       folder (or the current one) of a host build
+
+	The workloads go to A/0 and the 500 files searched by DIRS to B/0. SUITE.SUB runs
+	each of them under the internal CCP BENCH command and AUTOEXEC.TXT (replaced if
+	there) runs SUITE at boot, so every boot appends a line per workload to BENCH.CSV:
+	the build, the command, the elapsed time, then the instructions, BDOS calls, disk
+	bytes and console bytes, each also per second. RunCPM needs RUNSTATS for BENCH.
+	On a host build "runcpm -d <dir> < /dev/null > /dev/null" runs the suite and exits.
+
+	  MIX      instruction mix kernel (loads, ALU, stack, calls), 32 million instructions
+	  FILEIO   writes a 1MB file sequentially, reads it back and deletes it
+	  DIRS     searches B:*.* ten times
+	  CONDUMP  prints 10,000 lines of 54 characters
+
+	ZEXDOC.COM and MBASIC.COM are not shipped; when they are in A/0 already, SUITE runs
+	them too (ZEXDOC takes minutes on a host and hours on a Pico, MBASIC runs LOOP.BAS).
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+#define DIRFILES 500
+
+// The workloads, all loaded at 0100h and returning to the CCP with RET
+
+static const uint8_t mix[] = {
+	0x21, 0x00, 0x10,						// 0100 LD HL,1000h
+	0x11, 0x00, 0x00,						// 0103 LD DE,0
+	0x3e, 0x14,								// 0106 LD A,PASSES
+	0x32, 0x3b, 0x01,						// 0108 LD (cnt),A
+											// outer:
+	0x0e, 0x00,								// 010B LD C,0
+											// middle:
+	0x06, 0x00,								// 010D LD B,0
+											// inner:
+	0x7e,									// 010F LD A,(HL)
+	0x80,									// 0110 ADD A,B
+	0x77,									// 0111 LD (HL),A
+	0x2c,									// 0112 INC L
+	0xab,									// 0113 XOR E
+	0x5f,									// 0114 LD E,A
+	0xc5,									// 0115 PUSH BC
+	0xcd, 0x29, 0x01,						// 0116 CALL sub
+	0xc1,									// 0119 POP BC
+	0x10, 0xf3,								// 011A DJNZ inner
+	0x0d,									// 011C DEC C
+	0x20, 0xee,								// 011D JR NZ,middle
+	0x3a, 0x3b, 0x01,						// 011F LD A,(cnt)
+	0x3d,									// 0122 DEC A
+	0x32, 0x3b, 0x01,						// 0123 LD (cnt),A
+	0x20, 0xe3,								// 0126 JR NZ,outer
+	0xc9,									// 0128 RET
+											// sub:
+	0x7a,									// 0129 LD A,D
+	0x07,									// 012A RLCA
+	0x8b,									// 012B ADC A,E
+	0x57,									// 012C LD D,A
+	0xe6, 0x0f,								// 012D AND 0Fh
+	0xfe, 0x08,								// 012F CP 08h
+	0x38, 0x01,								// 0131 JR C,skip
+	0x13,									// 0133 INC DE
+											// skip:
+	0xe5,									// 0134 PUSH HL
+	0x62,									// 0135 LD H,D
+	0x6b,									// 0136 LD L,E
+	0x29,									// 0137 ADD HL,HL
+	0xeb,									// 0138 EX DE,HL
+	0xe1,									// 0139 POP HL
+	0xc9,									// 013A RET
+											// cnt:
+	0x00,									// 013B DB 0
+};
+
+static const uint8_t fileio[] = {
+	0x0e, 0x13,								// 0100 LD C,19
+	0x11, 0x81, 0x01,						// 0102 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 0105 CALL BDOS
+	0x0e, 0x16,								// 0108 LD C,22
+	0x11, 0x81, 0x01,						// 010A LD DE,fcb
+	0xcd, 0x05, 0x00,						// 010D CALL BDOS
+	0x3c,									// 0110 INC A
+	0x28, 0x55,								// 0111 JR Z,err
+	0x21, 0x00, 0x20,						// 0113 LD HL,8192
+											// wloop:
+	0xe5,									// 0116 PUSH HL
+	0x0e, 0x15,								// 0117 LD C,21
+	0x11, 0x81, 0x01,						// 0119 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 011C CALL BDOS
+	0xe1,									// 011F POP HL
+	0xb7,									// 0120 OR A
+	0x20, 0x45,								// 0121 JR NZ,err
+	0x2b,									// 0123 DEC HL
+	0x7c,									// 0124 LD A,H
+	0xb5,									// 0125 OR L
+	0x20, 0xee,								// 0126 JR NZ,wloop
+	0x0e, 0x10,								// 0128 LD C,16
+	0x11, 0x81, 0x01,						// 012A LD DE,fcb
+	0xcd, 0x05, 0x00,						// 012D CALL BDOS
+	0xaf,									// 0130 XOR A
+	0x32, 0x8d, 0x01,						// 0131 LD (fcb+12),A
+	0x32, 0xa1, 0x01,						// 0134 LD (fcb+32),A
+	0x0e, 0x0f,								// 0137 LD C,15
+	0x11, 0x81, 0x01,						// 0139 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 013C CALL BDOS
+	0x3c,									// 013F INC A
+	0x28, 0x26,								// 0140 JR Z,err
+	0x21, 0x00, 0x20,						// 0142 LD HL,8192
+											// rloop:
+	0xe5,									// 0145 PUSH HL
+	0x0e, 0x14,								// 0146 LD C,20
+	0x11, 0x81, 0x01,						// 0148 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 014B CALL BDOS
+	0xe1,									// 014E POP HL
+	0xb7,									// 014F OR A
+	0x20, 0x16,								// 0150 JR NZ,err
+	0x2b,									// 0152 DEC HL
+	0x7c,									// 0153 LD A,H
+	0xb5,									// 0154 OR L
+	0x20, 0xee,								// 0155 JR NZ,rloop
+	0x0e, 0x10,								// 0157 LD C,16
+	0x11, 0x81, 0x01,						// 0159 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 015C CALL BDOS
+	0x0e, 0x13,								// 015F LD C,19
+	0x11, 0x81, 0x01,						// 0161 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 0164 CALL BDOS
+	0xc9,									// 0167 RET
+											// err:
+	0x0e, 0x09,								// 0168 LD C,9
+	0x11, 0x71, 0x01,						// 016A LD DE,msg
+	0xcd, 0x05, 0x00,						// 016D CALL BDOS
+	0xc9,									// 0170 RET
+											// msg:
+	0x46, 0x49, 0x4c, 0x45, 0x49, 0x4f, 0x20, 0x66, 0x61, 0x69, 0x6c, 0x65,	// 0171 DB 'FILEIO failed',13,10,'$'
+	0x64, 0x0d, 0x0a, 0x24,
+											// fcb:
+	0x00, 0x42, 0x45, 0x4e, 0x43, 0x48, 0x20, 0x20, 0x20, 0x24, 0x24, 0x24,	// 0181 DB 0,'BENCH   $$$',0...
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t dirs[] = {
+	0x3e, 0x0a,								// 0100 LD A,10
+	0x32, 0x24, 0x01,						// 0102 LD (cnt),A
+											// pass:
+	0x0e, 0x11,								// 0105 LD C,17
+	0x11, 0x25, 0x01,						// 0107 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 010A CALL BDOS
+											// more:
+	0x3c,									// 010D INC A
+	0x28, 0x0a,								// 010E JR Z,next
+	0x0e, 0x12,								// 0110 LD C,18
+	0x11, 0x25, 0x01,						// 0112 LD DE,fcb
+	0xcd, 0x05, 0x00,						// 0115 CALL BDOS
+	0x18, 0xf3,								// 0118 JR more
+											// next:
+	0x3a, 0x24, 0x01,						// 011A LD A,(cnt)
+	0x3d,									// 011D DEC A
+	0x32, 0x24, 0x01,						// 011E LD (cnt),A
+	0x20, 0xe2,								// 0121 JR NZ,pass
+	0xc9,									// 0123 RET
+											// cnt:
+	0x00,									// 0124 DB 0
+											// fcb:
+	0x02, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f,	// 0125 DB 2,'???????????',0...
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t condump[] = {
+	0x21, 0x10, 0x27,						// 0100 LD HL,10000
+											// loop:
+	0xe5,									// 0103 PUSH HL
+	0x0e, 0x09,								// 0104 LD C,9
+	0x11, 0x13, 0x01,						// 0106 LD DE,line
+	0xcd, 0x05, 0x00,						// 0109 CALL BDOS
+	0xe1,									// 010C POP HL
+	0x2b,									// 010D DEC HL
+	0x7c,									// 010E LD A,H
+	0xb5,									// 010F OR L
+	0x20, 0xf1,								// 0110 JR NZ,loop
+	0xc9,									// 0112 RET
+											// line:
+	0x54, 0x68, 0x65, 0x20, 0x71, 0x75, 0x69, 0x63, 0x6b, 0x20, 0x62, 0x72,	// 0113 DB '...',13,10,'$'
+	0x6f, 0x77, 0x6e, 0x20, 0x66, 0x6f, 0x78, 0x20, 0x6a, 0x75, 0x6d, 0x70,
+	0x73, 0x20, 0x6f, 0x76, 0x65, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c,
+	0x61, 0x7a, 0x79, 0x20, 0x64, 0x6f, 0x67, 0x20, 0x30, 0x31, 0x32, 0x33,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x0d, 0x0a, 0x24,
+};
+
+static const struct {
+	const char* name;
+	const uint8_t* code;
+	size_t len;
+} workloads[] = {
+	{ "MIX", mix, sizeof(mix) },
+	{ "FILEIO", fileio, sizeof(fileio) },
+	{ "DIRS", dirs, sizeof(dirs) },
+	{ "CONDUMP", condump, sizeof(condump) },
+};
+
+static const char loopbas[] =
+	"10 FOR I=1 TO 5000\r\n"
+	"20 A=I*I/3+SQR(I)\r\n"
+	"30 NEXT I\r\n"
+	"40 SYSTEM\r\n"
+	"\x1a";
+
+static const char* base;
+
+static int writefile(const char* name, const void* buf, size_t len) {
+	char path[FILENAME_MAX];
+	FILE* f;
+
+	snprintf(path, sizeof(path), "%s/%s", base, name);
+	if (!(f = fopen(path, "wb")) || fwrite(buf, 1, len, f) != len || fclose(f)) {
+		fprintf(stderr, "mkbench: cannot write %s\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+static int exists(const char* name) {
+	char path[FILENAME_MAX];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/%s", base, name);
+	return !stat(path, &st);
+}
+
+static void makedir(const char* name) {
+	char path[FILENAME_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", base, name);
+	mkdir(path, 0777);
+}
+
+int main(int argc, char* argv[]) {
+	char suite[512] = "";
+	char name[FILENAME_MAX];
+	uint8_t record[128];
+	size_t i;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: mkbench <dir>\n");
+		return 1;
+	}
+	base = argv[1];
+	makedir("A");
+	makedir("A/0");
+	makedir("B");
+	makedir("B/0");
+
+	for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i) {
+		snprintf(name, sizeof(name), "A/0/%s.COM", workloads[i].name);
+		if (!writefile(name, workloads[i].code, workloads[i].len))
+			return 1;
+		snprintf(suite + strlen(suite), sizeof(suite) - strlen(suite), "BENCH %s\r\n", workloads[i].name);
+	}
+	if (exists("A/0/ZEXDOC.COM"))
+		strcat(suite, "BENCH ZEXDOC\r\n");
+	if (exists("A/0/MBASIC.COM")) {
+		if (!writefile("A/0/LOOP.BAS", loopbas, sizeof(loopbas) - 1))
+			return 1;
+		strcat(suite, "BENCH MBASIC LOOP\r\n");
+	}
+
+	memset(record, 0x1a, sizeof(record));
+	for (i = 0; i < DIRFILES; ++i) {
+		snprintf(name, sizeof(name), "B/0/F%03u.DAT", (unsigned)i);
+		if (!writefile(name, record, sizeof(record)))
+			return 1;
+	}
+
+	if (!writefile("A/0/SUITE.SUB", suite, strlen(suite)) || !writefile("AUTOEXEC.TXT", "SUITE\r\n", 7))
+		return 1;
+	printf("%s", suite);
+	return 0;
+}
@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: MIT
+
+/*
+	rbtest - Runs the console queue of ringbuf.h against a pty standing in for the Pico UART
+
+	Build: make rbtest (or cc -pthread -o rbtest rbtest.c)
+	Usage: rbtest [-v]
+	       -v prints the counters of every run
+	Run by "make test", with CFLAGS="-g -fsanitize=address" to check the memory use too.
+
+	A thread plays the DMA drain of serial1_tx_drain: it takes up to CHUNK bytes with
+	_rb_peek, sends them to the master side of a pty at BYTES bytes per TICK and only
+	then releases them with _rb_skip, so the bytes are read from the queue while it's
+	marked busy, as the DMA does. Another thread reads the slave side as the terminal
+	would. The emulator side queues a numbered byte stream faster than it is sent, with both
+	_rb_put and _rb_write, under each overflow policy, and what reaches the terminal is
+	checked:
+	  RB_BLOCK  everything arrives in order, and the producer was blocked
+	  RB_DROP   what arrives is in order, ends with the last byte, and the gaps are
+	            whole quarters of the queue adding up to the dropped count
+	  RB_GROW   everything arrives in order and the queue reaches its largest size,
+	            which takes every old buffer to be reaped while transfers ran from it
+	Exits with 0 when all of them pass.
+*/
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <termios.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef unsigned char	uint8;
+typedef unsigned int	uint32;
+#define FALSE 0
+#define TRUE 1
+
+static uint32 micros(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return((uint32)(t.tv_sec * 1000000 + t.tv_nsec / 1000));
+}
+
+static pthread_mutex_t rbMutex = PTHREAD_MUTEX_INITIALIZER;
+#define RB_LOCK()	pthread_mutex_lock(&rbMutex)
+#define RB_UNLOCK()	pthread_mutex_unlock(&rbMutex)
+#define RB_TIME()	micros()
+#include "../ringbuf.h"
+
+#define SENT	(256 * 1024)		// Bytes queued by each run
+#define CHUNK	256					// Largest "DMA transfer", as TXQ_DMA_CHUNK
+#define BYTES	64					// Bytes sent to the pty per tick
+#define TICK	100					// Microseconds per tick, as KBD_INT_TIME
+#define PACE	512					// Bytes queued per tick, faster than they are sent
+
+static RINGBUF q;
+static int ptyMaster, ptySlave;
+static volatile uint8 stop;
+static volatile uint32 expect;		// Bytes the terminal waits for, known once the queue is flushed
+static uint8* got;
+static uint32 gotLen;
+
+// Byte number pos of the stream, with no short period so a gap can't go unnoticed
+static uint8 _stream(uint32 pos) {
+	return((uint8)((pos * 2654435761u) >> 24));
+}
+
+// Waiting for room only gives the consumer thread a chance, it is the only consumer
+static void _wait(void) {
+	sched_yield();
+}
+
+static void* _uart_dma(void* arg) {
+	uint8* p;
+	uint32 n, i, m;
+
+	while (!stop || _rb_count(&q)) {
+		RB_LOCK();
+		n = _rb_peek(&q, &p, CHUNK);
+		RB_UNLOCK();
+		if (!n) {
+			usleep(TICK);
+			continue;
+		}
+		for (i = 0; i < n; i += m) {		// The transfer reads p with the lock released
+			m = n - i < BYTES ? n - i : BYTES;
+			if (write(ptyMaster, p + i, m) != (ssize_t)m)
+				exit(2);
+			usleep(TICK);
+		}
+		RB_LOCK();
+		_rb_skip(&q, n);
+		RB_UNLOCK();
+		usleep(TICK);						// The next transfer starts at the next timer tick
+	}
+	return(NULL);
+}
+
+static void* _terminal(void* arg) {
+	struct pollfd p = { 0, POLLIN, 0 };
+	ssize_t n;
+
+	p.fd = ptySlave;
+	while (gotLen < expect) {
+		if (poll(&p, 1, 100) <= 0)
+			continue;
+		n = read(ptySlave, got + gotLen, SENT - gotLen);
+		if (n <= 0)
+			exit(2);
+		gotLen += n;
+	}
+	return(NULL);
+}
+
+static int _openpty(void) {
+	struct termios t;
+
+	if ((ptyMaster = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(ptyMaster) || unlockpt(ptyMaster) ||
+		(ptySlave = open(ptsname(ptyMaster), O_RDWR | O_NOCTTY)) < 0 || tcgetattr(ptySlave, &t))
+		return(FALSE);
+	cfmakeraw(&t);						// No echo and no translation, the bytes go through as they are
+	return(!tcsetattr(ptySlave, TCSANOW, &t));
+}
+
+// The terminal got the bytes of the stream from pos on, as far as the next 4 go
+static int _match(uint32 i, uint32 pos) {
+	uint32 k;
+
+	for (k = 0; k < 4 && i + k < gotLen; ++k)
+		if (pos + k >= SENT || got[i + k] != _stream(pos + k))
+			return(FALSE);
+	return(TRUE);
+}
+
+// Checks what the terminal got, returns the number of bytes found missing, or -1 if out of order
+static long _check(uint32 quarter) {
+	uint32 pos = 0, i, gap, b = 0;
+	long lost = 0;
+
+	for (i = 0; i < gotLen; ++i, ++pos) {
+		if (pos < SENT && got[i] == _stream(pos))
+			continue;
+		if (!quarter)
+			return(-1);
+		for (gap = quarter; pos + gap < SENT; gap += quarter) {	// Drops take whole quarters of the queue
+			for (b = 0; b < 4 && b <= i && !_match(i - b, pos - b + gap); ++b);	// It may have begun where a few bytes happened to match
+			if (b < 4 && b <= i)
+				break;
+		}
+		if (pos + gap >= SENT)
+			return(-1);
+		i -= b;
+		pos += gap - b;
+		lost += gap;
+	}
+	return(pos == SENT ? lost : -1);
+}
+
+static int _run(const char* name, uint8 policy, uint32 size, uint32 maxSize, int verbose) {
+	pthread_t dma, term;
+	uint8 block[37];
+	uint32 pos = 0, n, i;
+	long lost;
+	int ok;
+
+	if (!_rb_init(&q, size, policy, maxSize, _wait))
+		return(FALSE);
+	stop = FALSE;
+	expect = SENT;
+	gotLen = 0;
+	pthread_create(&dma, NULL, _uart_dma, NULL);
+	pthread_create(&term, NULL, _terminal, NULL);
+	while (pos < SENT) {
+		if (pos / PACE != (pos + sizeof(block)) / PACE)
+			usleep(TICK);
+		n = 1 + pos % sizeof(block);		// Blocks of 1 to 37 bytes, the odd ones a byte at a time
+		if (n > SENT - pos)
+			n = SENT - pos;
+		for (i = 0; i < n; ++i)
+			block[i] = _stream(pos + i);
+		if (pos & 1) {
+			for (i = 0; i < n; ++i)
+				_rb_put(&q, block[i]);
+		} else {
+			_rb_write(&q, block, n);
+		}
+		pos += n;
+	}
+	_rb_flush(&q);
+	stop = TRUE;
+	pthread_join(dma, NULL);
+	expect = SENT - q.dropped;
+	pthread_join(term, NULL);
+
+	lost = _check(policy == RB_DROP ? q.size >> 2 : 0);
+	switch (policy) {
+		case RB_BLOCK:
+			ok = lost == 0 && q.blocked;
+			break;
+		case RB_DROP:
+			ok = lost == (long)q.dropped && q.dropped;
+			break;
+		default:
+			ok = lost == 0 && q.size == maxSize;
+	}
+	if (verbose || !ok)
+		printf("%-8s %s: got %u of %u bytes, size %u, dropped %u, blocked %u us\n", name, ok ? "ok" : "FAILED",
+			gotLen, SENT, q.size, q.dropped, q.blocked);
+	free(q.retired);
+	free(q.buf);
+	return(ok);
+}
+
+int main(int argc, char* argv[]) {
+	int verbose = argc > 1 && !strcmp(argv[1], "-v");
+	int ok;
+
+	if (!_openpty() || !(got = (uint8*)malloc(SENT))) {
+		perror("rbtest");
+		return(2);
+	}
+	ok = _run("RB_BLOCK", RB_BLOCK, 1024, 1024, verbose);
+	ok &= _run("RB_DROP", RB_DROP, 1024, 1024, verbose);
+	ok &= _run("RB_GROW", RB_GROW, 64, 4096, verbose);
+	printf(ok ? "ringbuf: all policies passed\n" : "ringbuf: FAILED\n");
+	return(ok ? 0 : 1);
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: MIT
+
+/*
+	tracedec - Decodes a RunCPM binary trace (RunCPM.trc, see trace.h)
+	into the same text format written by DEBUGLOG to RunCPM.log
+
+	Build: cc -o tracedec tracedec.c
+	Usage: tracedec [-t] RunCPM.trc
+	       -t prefixes every call with its host timestamp (microseconds)
+	Where records were lost (the RAM buffer filled up before the emulation was idle
+	to write it) the output says how many, and the total is given at the end.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TR_BDOSIN	0
+#define TR_BDOSOUT	1
+#define TR_BIOSIN	2
+#define TR_BIOSOUT	3
+#define TR_LOST		4
+
+typedef struct {				// Must match TRACEREC in trace.h
+	uint32_t	time;
+	uint32_t	hash;
+	uint8_t		type;
+	uint8_t		fn;
+	uint16_t	caller;
+	uint16_t	af, bc, de, hl;
+	uint16_t	ix, iy, sp, pc;
+	uint16_t	dma;
+	uint8_t		drive;
+	uint8_t		user;
+} TRACEREC;
+
+typedef char TRACERECSIZE[sizeof(TRACEREC) == 32 ? 1 : -1];	// 32 bytes, 16 to a sector
+
+static const char *CPMCalls[41] =
+{
+	"System Reset", "Console Input", "Console Output", "Reader Input", "Punch Output", "List Output", "Direct I/O",
+	"Get IOByte", "Set IOByte", "Print String", "Read Buffered", "Console Status", "Get Version", "Reset Disk",
+	"Select Disk", "Open File", "Close File", "Search First", "Search Next", "Delete File", "Read Sequential",
+	"Write Sequential", "Make File", "Rename File", "Get Login Vector", "Get Current Disk", "Set DMA Address",
+	"Get Alloc", "Write Protect Disk", "Get R/O Vector", "Set File Attr", "Get Disk Params", "Get/Set User",
+	"Read Random", "Write Random", "Get File Size", "Set Random Record", "Reset Drive", "N/A", "N/A",
+	"Write Random 0 fill"
+};
+
+static const char *BIOSCalls[33] =
+{
+	"boot", "wboot", "const", "conin", "conout", "list", "punch/aux", "reader", "home", "seldsk", "settrk", "setsec", "setdma",
+	"read", "write", "listst", "sectran", "conost", "auxist", "auxost", "devtbl", "devini", "drvtbl", "multio", "flush", "move",
+	"time", "selmem", "setbnk", "xmove", "userf", "reserv1", "reserv2"
+};
+
+static void logRegs(const TRACEREC *r) {
+	uint8_t J, I;
+	char Flags[9] = {'S', 'Z', '5', 'H', '3', 'P', 'N', 'C', 0};
+	uint8_t c = r->af >> 8;
+
+	if ((c < 32) || (c > 126))
+		c = 46;
+	for (J = 0, I = r->af & 0xff; J < 8; ++J, I <<= 1)
+		Flags[J] = I & 0x80 ? Flags[J] : '.';
+	printf("  BC:%04x DE:%04x HL:%04x AF:%02x(%c)|%s| IX:%04x IY:%04x SP:%04x PC:%04x\n",
+		r->bc, r->de, r->hl, r->af >> 8, c, Flags, r->ix, r->iy, r->sp, r->pc);
+}
+
+static void logChar(const char *txt, uint8_t c) {
+	printf("        %s = %02xh:%3d (%c)\n", txt, c, c, c > 31 && c < 127 ? c : '.');
+}
+
+int main(int argc, char *argv[]) {
+	TRACEREC r;
+	FILE *f;
+	int times = 0;
+	unsigned long n = 0, lost = 0;
+
+	if (argc > 1 && !strcmp(argv[1], "-t")) {
+		times = 1;
+		--argc;
+		++argv;
+	}
+	if (argc != 2) {
+		fprintf(stderr, "Usage: tracedec [-t] RunCPM.trc\n");
+		return(1);
+	}
+	if (!(f = fopen(argv[1], "rb"))) {
+		perror(argv[1]);
+		return(1);
+	}
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		++n;
+		if (times && (r.type == TR_BDOSIN || r.type == TR_BIOSIN))
+			printf("\n[%10lu us]", (unsigned long)r.time);
+		switch (r.type) {
+			case TR_BDOSIN: {
+				if (r.fn < 41)
+					printf("\nBdos call: %3d/%02xh (%s) IN from 0x%04x:\n", r.fn, r.fn, CPMCalls[r.fn], r.caller);
+				else
+					printf("\nBdos call: %3d/%02xh IN from 0x%04x:\n", r.fn, r.fn, r.caller);
+				logRegs(&r);
+				if (r.fn == 2 || r.fn == 4 || r.fn == 5 || r.fn == 6)
+					logChar("E", r.de & 0xff);
+				if (r.hash)
+					printf("        FCB hash = %08lx (%c%d:) DMA = %04x\n", (unsigned long)r.hash, 'A' + r.drive, r.user, r.dma);
+				break;
+			}
+			case TR_BDOSOUT: {
+				printf("              OUT:\n");
+				logRegs(&r);
+				if (r.fn == 1 || r.fn == 3 || r.fn == 6)
+					logChar("A", r.af >> 8);
+				break;
+			}
+			case TR_BIOSIN: {
+				if (r.fn / 3 < 33)
+					printf("\nBios call: %3d/%02xh (%s) IN:\n", r.fn, r.fn, BIOSCalls[r.fn / 3]);
+				else
+					printf("\nBios call: %3d/%02xh IN:\n", r.fn, r.fn);
+				logRegs(&r);
+				break;
+			}
+			case TR_BIOSOUT: {
+				printf("               OUT:\n");
+				logRegs(&r);
+				break;
+			}
+			case TR_LOST: {		// The buffer filled up before it was written, hash holds the count
+				printf("\n*** %lu records lost ***\n", (unsigned long)r.hash);
+				lost += r.hash;
+				break;
+			}
+			default: {
+				fprintf(stderr, "Bad record %lu (type %d)\n", n, r.type);
+				break;
+			}
+		}
+	}
+	fclose(f);
+	if (lost)
+		fprintf(stderr, "%lu records were lost, the trace has gaps\n", lost);
+	return(0);
+}
@@ -0,0 +1,130 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+	Binary call trace (replaces the text DEBUGLOG when speed matters)
+
+	Every BIOS/BDOS call produces two fixed size records (IN and OUT), stored in a
+	RAM ring buffer and written to TraceName when the emulation is idle: while it
+	waits for a key (everything), when a program polls the console (whole sectors)
+	and on warm boot, so the calls themselves never wait for the card. Nothing is
+	formatted on the emulation side; tools/tracedec.c turns the file back into the
+	RunCPM.log text format (without the memory dumps). If the buffer fills up before
+	it is written the oldest records are overwritten and counted as lost, and a
+	TR_LOST record is written where they were.
+*/
+
+#define TR_BDOSIN	0
+#define TR_BDOSOUT	1
+#define TR_BIOSIN	2
+#define TR_BIOSOUT	3
+#define TR_LOST		4			// Records were lost here, hash holds how many
+
+typedef struct {				// 32 bytes, little endian (as written by the host)
+	uint32	time;				// Host microseconds
+	uint32	hash;				// FNV-1a hash of the FCB drive/name/type (FCB calls only)
+	uint8	type;				// TR_xxx
+	uint8	fn;					// BDOS function number or BIOS entry offset
+	uint16	caller;				// Address the call was made from
+	uint16	af, bc, de, hl;
+	uint16	ix, iy, sp, pc;
+	uint16	dma;				// Current DMA address
+	uint8	drive;				// Current drive
+	uint8	user;				// Current user
+} TRACEREC;
+
+typedef char _traceRecSize[sizeof(TRACEREC) == 32 ? 1 : -1];	// Fails to compile if a record doesn't tile a sector
+
+#define TRACE_PERSECTOR (512 / sizeof(TRACEREC))
+#if TRACE_SIZE % 16
+#error "TRACE_SIZE must be a multiple of the 16 records in a sector"
+#endif
+
+static MACHINE_LOCAL TRACEREC	traceBuf[TRACE_SIZE];	// TRACE_SIZE must be a multiple of TRACE_PERSECTOR
+static MACHINE_LOCAL uint32	traceHead = 0;			// Free running record indexes
+static MACHINE_LOCAL uint32	traceTail = 0;
+static MACHINE_LOCAL uint32	traceLost = 0;			// Records overwritten before being written to the card
+static MACHINE_LOCAL uint32	traceGap = 0;			// Of those, the ones not yet marked in the file
+static MACHINE_LOCAL uint8	traceOn = TRUE;
+
+// FNV-1a hash of the 12 bytes identifying a file in an FCB (attribute bits removed)
+uint32 _traceHash(uint16 fcbaddr) {
+	uint32 h = 2166136261UL;
+	uint8 i;
+
+	for (i = 0; i < 12; ++i) {
+		h ^= _RamRead(fcbaddr + i) & 0x7f;
+		h *= 16777619UL;
+	}
+	return(h);
+}
+
+void _traceRecord(uint8 type, uint8 fn, uint16 caller, uint8 isfcb) {
+	TRACEREC* r;
+
+	if (!traceOn)
+		return;
+	if (traceHead - traceTail == TRACE_SIZE) {
+		++traceTail;
+		++traceLost;
+		++traceGap;
+	}
+	r = &traceBuf[traceHead % TRACE_SIZE];
+	r->time = micros();
+	r->type = type;
+	r->fn = fn;
+	r->caller = caller;
+	r->af = AF;
+	r->bc = BC;
+	r->de = DE;
+	r->hl = HL;
+	r->ix = IX;
+	r->iy = IY;
+	r->sp = SP;
+	r->pc = PC;
+	r->dma = dmaAddr;
+	r->hash = isfcb ? _traceHash(DE) : 0;
+	r->drive = cDrive;
+	r->user = userCode;
+	++traceHead;
+}
+
+static void _traceWrite(TRACEREC* r, uint32 n) {
+	if (!trace_open) {
+		_sys_deletefile((uint8*)TraceName);
+		trace_dev = _sys_fopen_w((uint8*)TraceName);
+		trace_open = TRUE;
+	}
+	if (trace_dev)
+		_sys_fwrite((uint8*)r, n * sizeof(TRACEREC), trace_dev);
+}
+
+// Writes the waiting records to the card, once a sector is complete unless all is set
+void _traceDrain(uint8 all) {
+	TRACEREC gap;
+	uint32 n;
+
+	while ((n = traceHead - traceTail) >= (all ? 1 : TRACE_PERSECTOR)) {
+		if (traceGap) {									// The lost records came right before these
+			memset(&gap, 0, sizeof(gap));
+			gap.time = micros();
+			gap.type = TR_LOST;
+			gap.hash = traceGap;
+			_traceWrite(&gap, 1);
+			traceGap = 0;
+		}
+		if (n > TRACE_SIZE - traceTail % TRACE_SIZE)
+			n = TRACE_SIZE - traceTail % TRACE_SIZE;	// Up to the end of the buffer
+		_traceWrite(&traceBuf[traceTail % TRACE_SIZE], n);
+		traceTail += n;
+	}
+}
+
+// Writes everything to the card (on demand, on warm boot and on exit)
+void _traceFlush(void) {
+	_traceDrain(TRUE);
+	if (trace_dev)
+		_sys_fflush(trace_dev);
+}
+
+#endif